@@ -31,21 +31,27 @@ class timer {
     double _ctime;
     double _deltat;
 
+    // not glfwGetTime, so that the timer also works in headless apps where GLFW isn't initialized
+    static double now() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
   public:
     timer() {
-        last_time = curr_time = glfwGetTime();
+        last_time = curr_time = now();
         _deltat               = 0;
         _ctime                = 0;
     }
 
     void reset() {
-        last_time = curr_time = glfwGetTime();
+        last_time = curr_time = now();
         _ctime                = 0;
         _deltat               = 0;
     }
 
     void update() {
-        curr_time = glfwGetTime();
+        curr_time = now();
 
         _deltat = curr_time - last_time;
         _ctime += _deltat;
@@ -58,6 +64,21 @@ class timer {
     inline float delta_time() const { return (float)_deltat; }
 };
 
+// caps the frame rate by sleeping until the next frame is due. sleeps can wake up a millisecond
+// or two late, so the last stretch before the deadline is spun instead
+class frame_limiter {
+    std::chrono::steady_clock::time_point next_frame;
+
+  public:
+    // frames per second, 0 for no limit
+    float max_fps;
+
+    frame_limiter() : next_frame(std::chrono::steady_clock::now()), max_fps(0.f) {}
+
+    // call once per frame, returns when the next frame should start
+    void wait();
+};
+
 class app;
 
 struct input_handler {
@@ -77,7 +98,13 @@ struct input_handler {
 class app {
     bool _did_resize;
 
+    void init_window(const std::string& title, vec2 winsize);
+
   public:
+    // headless apps have no window, surface or real swap chain, and render into offscreen images
+    // instead. GLFW is never initialized
+    bool           headless;
+    ivec2          offscreen_size;
     timer          tm;
     GLFWwindow*    wnd;
     vk::Instance   instance;
@@ -87,12 +114,21 @@ class app {
 #endif
     std::unique_ptr<device>     dev;
     std::unique_ptr<swap_chain> swapchain;
-
-    app(const std::string& title, vec2 winsize);
+    // signaled when the GPU has finished executing the last submitted frame
+    vk::UniqueFence             frame_fence;
+    frame_limiter               limiter;
+
+    app(const std::string& title,
+        vec2               winsize,
+        bool               headless = false,
+        present_options    present  = {});
     virtual ~app();
 
     void run(bool print_debug_fps = true);
 
+    // checked before each frame in `run`. headless apps never close on their own
+    virtual bool should_close() { return !headless && glfwWindowShouldClose(wnd) == GLFW_TRUE; }
+
     virtual vk::CommandBuffer render(float t, float dt, uint32_t image_index) = 0;
     virtual void              update(float t, float dt)                       = 0;
 
@@ -105,6 +141,7 @@ class app {
     virtual void post_submit(uint32_t image_index) {}
 
     inline ivec2 size() const {
+        if(headless) return offscreen_size;
         ivec2 wh;
         glfwGetFramebufferSize(wnd, &wh.x, &wh.y);
         return wh;
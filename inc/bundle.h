@@ -26,10 +26,12 @@ struct material {
 
     json serialize() const;
 
+    // returns true if anything changed, and marks the material for upload
     bool build_gui(frame_state& fs);
 
-    uint32            _render_index;
-    vk::DescriptorSet desc_set;
+    uint32 _render_index;
+    // set when the renderer needs to upload the gpu_material
+    bool   _dirty = true;
 };
 
 struct texture_data {
@@ -78,6 +80,7 @@ EL_OBJ class bundle : public std::enable_shared_from_this<bundle> {
     std::unordered_map<std::string, texture_data> textures;
     std::unordered_map<std::string, json>         render_graphs;
     std::shared_ptr<material>                     selected_material;
+    // set when materials are added or removed, individual edits only mark the material dirty
     bool                                          materials_changed;
     std::string                                   init_script;
 
@@ -1,12 +1,55 @@
 #pragma once
 #include "renderer.h"
 
+enum class gbuffer_layout {
+    /// three RGBA32F layers: view position + u, view normal + v, albedo + material index
+    wide,
+    /// a single RGBA32UI layer with a packed normal, albedo, uv and material index. light nodes
+    /// reconstruct the position from the depth buffer instead
+    compact
+};
+
+const size_t gbuffer_compact_prototype_id = 0x00010004;
+
+// which renderables a geometry buffer node draws. the phase follows from how the node is connected
+// to an occlusion cull node when the graph is compiled
+enum class occlusion_phase {
+    /// every renderable, there's no occlusion culling
+    none,
+    /// the renderables that were visible last frame. the node's depth feeds the cull node
+    first,
+    /// the renderables that the cull node found to be newly visible, drawn on top of the first
+    /// phase. the node's occlusion input comes from the cull node
+    second
+};
+
 struct gbuffer_geom_render_node_prototype : public single_pipeline_render_node_prototype {
-    gbuffer_geom_render_node_prototype(device* dev, renderer*);
+    struct node_data : public single_pipeline_node_data {
+        occlusion_phase                       phase;
+        class hiz_cull_render_node_prototype* culler;
+
+        node_data() : phase(occlusion_phase::none), culler(nullptr) {}
+    };
+
+    gbuffer_layout layout;
+
+    gbuffer_geom_render_node_prototype(
+        device* dev, renderer*, gbuffer_layout layout = gbuffer_layout::wide
+    );
 
-    size_t id() const override { return 0x00010000; }
+    size_t id() const override {
+        return layout == gbuffer_layout::compact ? gbuffer_compact_prototype_id : 0x00010000;
+    }
 
-    const char* name() const override { return "Geometry Buffer"; };
+    const char* name() const override {
+        return layout == gbuffer_layout::compact ? "Geometry Buffer (Compact)" : "Geometry Buffer";
+    };
+
+    bool scales_with_render_resolution() const override { return true; }
+
+    std::unique_ptr<render_node_data> initialize_node_data() override {
+        return std::make_unique<node_data>();
+    }
 
     void collect_descriptor_layouts(
         render_node*                           node,
@@ -38,8 +81,22 @@ struct gbuffer_geom_render_node_prototype : public single_pipeline_render_node_p
     void build_gui(renderer* r, render_node* node) override;
 };
 
+const size_t GLOBAL_BUF_DIRECTIONAL_LIGHTS = 8;
+
+struct gpu_directional_light {
+    // view space direction
+    vec4    direction;
+    vec3    color;
+    // layer in the shadow map, or -1 if the light has no shadow
+    int32_t shadow_index;
+    mat4    shadow_viewproj;
+};
+
+// shades every directional light in a single full screen pass
 class directional_light_render_node_prototype : public single_pipeline_render_node_prototype {
     std::shared_ptr<class directional_light_shadowmap_render_node_prototype> shadowmap_node_proto;
+    gpu_directional_light*                                                   mapped_lights;
+    size_t                                                                   light_capacity;
 
   public:
     directional_light_render_node_prototype(device* dev);
@@ -48,6 +105,10 @@ class directional_light_render_node_prototype : public single_pipeline_render_no
 
     const char* name() const override { return "Directional Light"; };
 
+    bool scales_with_render_resolution() const override { return true; }
+
+    size_t subpass_repeat_count(renderer* r, render_node* node) override;
+
     void collect_descriptor_layouts(
         render_node*                           node,
         std::vector<vk::DescriptorPoolSize>&   pool_sizes,
@@ -125,14 +186,100 @@ class directional_light_shadowmap_render_node_prototype : public render_node_pro
     std::unique_ptr<render_node_data> deserialize_node_data(const json& data) override;
 };
 
+const size_t GLOBAL_BUF_POINT_LIGHT_VOLUMES = 7;
+
+struct gpu_point_light_volume {
+    mat4 world;
+    // (attenuation, radius, _, _)
+    vec4 param;
+    vec4 color;
+    vec4 view_pos;
+};
+
+// draws every visible point light as one instanced draw of a sphere volume
 struct point_light_render_node_prototype : public single_pipeline_render_node_prototype {
-    std::unique_ptr<mesh> sphere_mesh;
+    std::unique_ptr<mesh>   sphere_mesh;
+    gpu_point_light_volume* mapped_volumes;
+    size_t                  volume_capacity, num_visible_lights;
+
     point_light_render_node_prototype(device* dev);
 
     size_t id() const override { return 0x00010002; }
 
     const char* name() const override { return "Point Light"; };
 
+    bool scales_with_render_resolution() const override { return true; }
+
+    size_t subpass_repeat_count(renderer* r, render_node* node) override;
+
+    void collect_descriptor_layouts(
+        render_node*                           node,
+        std::vector<vk::DescriptorPoolSize>&   pool_sizes,
+        std::vector<vk::DescriptorSetLayout>&  layouts,
+        std::vector<vk::UniqueDescriptorSet*>& outputs
+    ) override;
+    void update_descriptor_sets(
+        renderer*                            r,
+        render_node*                         node,
+        std::vector<vk::WriteDescriptorSet>& writes,
+        arena<vk::DescriptorBufferInfo>&     buf_infos,
+        arena<vk::DescriptorImageInfo>&      img_infos
+    ) override;
+    void generate_pipelines(
+        renderer* r, render_node* node, vk::RenderPass render_pass, uint32_t subpass
+    ) override;
+    void generate_command_buffer_inline(
+        renderer*          r,
+        render_node*       node,
+        vk::CommandBuffer& cb,
+        size_t             subpass_index,
+        const frame_state& fs
+    ) override;
+
+    void build_gui(renderer* r, render_node* node) override;
+};
+
+const size_t GLOBAL_BUF_POINT_LIGHTS   = 4;
+const size_t GLOBAL_BUF_LIGHT_CLUSTERS = 5;
+const size_t GLOBAL_BUF_LIGHT_INDICES  = 6;
+
+struct gpu_point_light {
+    // view space position, radius of influence
+    vec4 view_pos_radius;
+    // color, quadratic attenuation
+    vec4 color_attenuation;
+};
+
+// shades every point light in a single full screen pass. lights are binned on the CPU into a
+// grid of view space clusters (screen tiles x exponential depth slices) and each pixel only loops
+// over the lights of its cluster
+class clustered_point_light_render_node_prototype : public single_pipeline_render_node_prototype {
+    gpu_point_light* mapped_lights;
+    uvec2*           mapped_clusters;  // (offset into light indices, light count)
+    uint32_t*        mapped_light_indices;
+    size_t           light_capacity, index_capacity;
+
+    // per visible light, the inclusive range of clusters it touches
+    std::vector<std::pair<uvec3, uvec3>> light_cluster_ranges;
+
+    // returns the depth slice parameters: (scale, bias, near, far)
+    vec4 bin_lights(renderer* r);
+
+  public:
+    uvec3  grid_size;
+    size_t num_visible_lights, num_light_indices;
+    bool   overflowed;
+
+    clustered_point_light_render_node_prototype(device* dev);
+
+    size_t id() const override { return 0x00010005; }
+
+    const char* name() const override { return "Clustered Point Lights"; };
+
+    bool scales_with_render_resolution() const override { return true; }
+
+    size_t subpass_repeat_count(renderer* r, render_node* node) override;
+
     void collect_descriptor_layouts(
         render_node*                           node,
         std::vector<vk::DescriptorPoolSize>&   pool_sizes,
@@ -1,21 +1,46 @@
 #pragma once
 #include "cmmn.h"
 #include "vk_mem_alloc.h"
+#include <array>
+#include <deque>
+
+/// what an allocation is used for, so that memory usage can be attributed
+enum class memory_category {
+    /// images backing render graph framebuffers
+    framebuffer,
+    /// vertex and index buffers
+    mesh,
+    /// sampled textures
+    texture,
+    /// uniform and storage buffers for shader parameters
+    uniform,
+    /// host visible memory used to upload to device local memory
+    staging,
+    other
+};
+
+const size_t memory_category_count = (size_t)memory_category::other + 1;
+
+const char* memory_category_name(memory_category c);
 
 struct buffer {
-    class device* dev;
-    VkBuffer      buf;
-    VmaAllocation alloc;
-    uint64        id;
+    class device*   dev;
+    VkBuffer        buf;
+    VmaAllocation   alloc;
+    uint64          id;
+    memory_category category;
+    vk::DeviceSize  size;
 
-    buffer() : buf(VK_NULL_HANDLE), dev(nullptr), id(0) {}
+    buffer()
+        : buf(VK_NULL_HANDLE), dev(nullptr), id(0), category(memory_category::other), size(0) {}
 
     buffer(
         device*                 dev,
         vk::DeviceSize          size,
         vk::BufferUsageFlags    bufuse,
         vk::MemoryPropertyFlags memuse,
-        void**                  persistant_map = nullptr
+        void**                  persistant_map = nullptr,
+        memory_category         category       = memory_category::other
     );
 
     /*buffer(const buffer&& buf) : dev(std::move(buf.dev)), buf(std::move(buf.buf)),
@@ -31,11 +56,47 @@ struct buffer {
     ~buffer();
 };
 
+// a persistently mapped ring of staging memory. allocations are handed out in order and retired
+// together under the timeline value of the upload batch that reads them, then reclaimed once that
+// value has completed
+class staging_ring {
+    std::unique_ptr<buffer> buf;
+    char*                   mapped;
+    vk::DeviceSize          capacity, head, tail, used, pending;
+
+    struct region {
+        vk::DeviceSize end, bytes;
+        uint64_t       value;
+    };
+
+    std::deque<region> regions;
+
+  public:
+    staging_ring(class device* dev, vk::DeviceSize capacity);
+
+    // returns the offset of the allocation, or nothing if there isn't room until more uploads
+    // complete
+    std::optional<vk::DeviceSize> allocate(vk::DeviceSize size, vk::DeviceSize alignment);
+
+    // everything allocated since the last call is in use until `value` completes
+    void retire(uint64_t value);
+    void reclaim(uint64_t completed_value);
+
+    inline vk::Buffer     buffer_handle() const { return vk::Buffer(buf->buf); }
+    inline void*          mapped_at(vk::DeviceSize offset) const { return mapped + offset; }
+    inline vk::DeviceSize bytes_used() const { return used; }
+    inline vk::DeviceSize size() const { return capacity; }
+};
+
+const vk::DeviceSize staging_ring_size = 64 * 1024 * 1024;
+
 struct image {
     class device*       dev;
     vk::ImageCreateInfo info;
     VkImage             img;
     VmaAllocation       alloc;
+    memory_category     category;
+    vk::DeviceSize      size;
     image(
         device*                             dev,
         vk::ImageCreateFlags                createflags,
@@ -47,9 +108,10 @@ struct image {
         vk::MemoryPropertyFlags             memuse,
         uint32_t                            mip_count,
         uint32_t                            array_layers,
-        std::optional<vk::UniqueImageView*> iv      = {},
-        vk::ImageViewType                   iv_type = {},
-        vk::ImageSubresourceRange           iv_sr   = {}
+        std::optional<vk::UniqueImageView*> iv       = {},
+        vk::ImageViewType                   iv_type  = {},
+        vk::ImageSubresourceRange           iv_sr    = {},
+        memory_category                     category = memory_category::other
     );
 
     image(
@@ -78,7 +140,7 @@ struct image {
     );
 
     static inline uint32_t calculate_mipmap_count(size_t w, size_t h) {
-        return (uint32_t)floor(log2(glm::min((float)w, (float)h)));
+        return (uint32_t)floor(log2((float)glm::max(w, h))) + 1;
     }
 
     operator vk::Image() { return vk::Image(img); }
@@ -87,29 +149,53 @@ struct image {
 };
 
 class app;
+class upload_service;
+
+struct memory_heap_stats {
+    bool           device_local;
+    // as reported by VK_EXT_memory_budget if it's supported, otherwise estimated by VMA
+    vk::DeviceSize usage, budget;
+    // bytes in VMA's memory blocks, and the part of that actually handed out to allocations
+    vk::DeviceSize block_bytes, allocation_bytes;
+};
 
 class device {
   public:
     struct queue_families {
         int graphics = -1;
         int present  = -1;
+        // prefers a family without graphics or compute, falls back to the graphics family
+        int transfer = -1;
 
         queue_families() {}
 
         queue_families(vk::PhysicalDevice pd, app* app);
 
-        bool complete() { return graphics >= 0 && present >= 0; }
+        bool complete() { return graphics >= 0 && present >= 0 && transfer >= 0; }
     } qu_fam;
 
     vk::UniqueCommandPool                         cmdpool;
     vk::Queue                                     graphics_qu;
     vk::Queue                                     present_qu;
+    vk::Queue                                     transfer_qu;
     VmaAllocator                                  allocator;
     vk::UniqueDevice                              dev;
     vk::PhysicalDevice                            pdevice;
     std::map<std::string, vk::UniqueShaderModule> shader_module_cache;
     std::vector<vk::UniqueCommandBuffer>          tmp_cmd_buffers;
-    std::vector<std::unique_ptr<buffer>>          tmp_upload_buffers;
+    std::unique_ptr<staging_ring>                 staging;
+    std::unique_ptr<upload_service>               uploads;
+    // true on integrated GPUs and software devices where device local memory can also be mapped,
+    // so resources can be written directly instead of going through staging
+    bool                                          unified_memory;
+    bool                                          memory_budget_supported;
+
+    // bytes and number of live allocations for each memory_category
+    std::array<vk::DeviceSize, memory_category_count> category_bytes;
+    std::array<size_t, memory_category_count>         category_allocations;
+    void track_allocation(memory_category c, vk::DeviceSize size, bool freed);
+
+    std::vector<memory_heap_stats> heap_stats() const;
 
     device(app* app);
 
@@ -127,6 +213,7 @@ class device {
     vk::ShaderModule load_shader(const std::filesystem::path& path);
 
     vk::UniquePipeline create_graphics_pipeline(const vk::GraphicsPipelineCreateInfo& cfo);
+    vk::UniquePipeline create_compute_pipeline(const vk::ComputePipelineCreateInfo& cfo);
 
     void clear_tmps();
 
@@ -8,7 +8,7 @@
 EL_TYPEDEF using entity_id = size_t;
 EL_TYPEDEF using system_id = size_t;
 
-enum class static_systems : system_id { transform, light, camera, renderer };
+enum class static_systems : system_id { transform, light, camera, renderer, stress_motion };
 
 struct frame_state {
     float                                 t, dt;
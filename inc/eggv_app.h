@@ -5,15 +5,51 @@
 #include "imgui.h"
 #include "physics.h"
 #include "renderer.h"
+#include "stress_scene.h"
 
 const float physics_fixed_time_step = 1.f / 60.f;
 
 struct eggv_cmdline_args {
     vec2                  resolution;
     std::filesystem::path bundle_path;
+    // `-p frames path`: capture a CPU profile of the first `profile_frames` frames, including
+    // startup
+    uint32_t              profile_frames;
+    std::filesystem::path profile_path;
+    // `--headless --frames N --size WxH`: render N frames offscreen without a window, then write
+    // per-frame timings to `timings_path` (`--timings path`) and, if `screenshot_path` is set
+    // (`--png path`), the last frame as a PNG
+    bool                  headless;
+    uint32_t              headless_frames;
+    std::filesystem::path timings_path;
+    std::filesystem::path screenshot_path;
+    // `--dynamic-resolution ms`: scale the render resolution to keep the GPU frame time under
+    // `target_gpu_ms`, 0 to render at full resolution
+    float                 target_gpu_ms;
+    // `--stats-csv path`: write the frame counters of every frame to a CSV file
+    std::filesystem::path stats_csv_path;
+    // `--stress-scene key=value,...`: generate a stress scene after the init script has run
+    std::optional<stress_scene_desc> stress_scene;
+    // `--present-mode fifo|fifo-relaxed|mailbox|immediate` and `--swap-images N`: how the swap
+    // chain presents, see `present_options`
+    present_options                  present;
+    // `--max-fps N`: limit the frame rate, 0 for no limit
+    float                            max_fps;
     eggv_cmdline_args(int argc, const char* argv[]);
 };
 
+// timings for one frame of a headless run, in milliseconds
+struct frame_timing {
+    // wall clock time since the previous frame started
+    float frame_ms;
+    // time spent in `update` and recording command buffers
+    float cpu_ms;
+    // from the first to the last timestamp the renderer wrote in this frame
+    float gpu_ms;
+    // width of the scaled render viewport over the swap chain width, 1 without dynamic resolution
+    float render_scale;
+};
+
 struct script_repl_window_t;
 
 class eggv_app : public app {
@@ -36,15 +72,28 @@ class eggv_app : public app {
     void init_script_runtime();
 
     void build_gui();
+    void build_frame_pacing_gui();
 
     reactphysics3d::PhysicsCommon phys_cmmn;
     reactphysics3d::PhysicsWorld* phys_world;
 
     float ui_key_cooldown;
     float physics_sim_time;
+    // set by the frame pacing window, the swap chain is recreated with its new options at the next
+    // update
+    bool  recreate_swap_chain;
 
     std::unique_ptr<script_repl_window_t> script_repl_window;
 
+    // headless benchmark state
+    uint32_t                  headless_frames;
+    std::vector<frame_timing> frame_timings;
+    float                     frame_cpu_ms;
+    uint32_t                  last_image_index;
+    std::filesystem::path     timings_path, screenshot_path;
+
+    void write_screenshot(const std::filesystem::path& path);
+
   public:
     std::shared_ptr<emlisp::runtime> script_runtime;
     std::shared_ptr<bundle>          bndl;
@@ -54,5 +103,10 @@ class eggv_app : public app {
     void              resize() override;
     void              update(float t, float dt) override;
     vk::CommandBuffer render(float t, float dt, uint32_t image_index) override;
+    void              post_submit(uint32_t image_index) override;
+    bool              should_close() override;
     ~eggv_app() override;
+
+    // after a headless run, write the timings report and the screenshot if one was requested
+    void write_headless_results();
 };
@@ -0,0 +1,86 @@
+#pragma once
+#include "cmmn.h"
+#include <array>
+#include <atomic>
+
+// kinds of work counted each frame
+enum class frame_counter {
+    /// draw commands recorded
+    draw_calls,
+    /// instances drawn, summed over every draw call
+    instances,
+    /// triangles drawn, counting every instance
+    triangles,
+    pipeline_binds,
+    descriptor_binds,
+    /// vertex and index buffer binds
+    buffer_binds,
+    /// objects that were skipped because they can't be seen
+    culled_objects,
+    /// bytes copied to the GPU through staging or written straight into device memory
+    uploaded_bytes,
+    /// buffer and image allocations
+    allocations,
+    /// entities whose world transform was recomputed
+    entities_updated,
+    /// rigid bodies in the physics world, counted once per physics step
+    physics_bodies,
+    /// bytes freed by the script runtime's garbage collector
+    script_gc_bytes
+};
+
+const size_t frame_counter_count = (size_t)frame_counter::script_gc_bytes + 1;
+
+const char* frame_counter_name(frame_counter c);
+
+// counts how much work each frame did. any subsystem can `add` to a counter as it goes, and
+// `end_frame` moves the totals into a short history, and into a CSV file if one is being recorded
+namespace frame_stats {
+// frames of history kept for the graphs
+const size_t history_length = 240;
+
+extern std::array<std::atomic<uint64_t>, frame_counter_count> current;
+
+inline void add(frame_counter c, uint64_t n = 1) {
+    current[(size_t)c].fetch_add(n, std::memory_order_relaxed);
+}
+
+// count one draw call of `instances` instances with `triangles` triangles each
+inline void add_draw(uint64_t triangles, uint64_t instances = 1) {
+    add(frame_counter::draw_calls);
+    add(frame_counter::instances, instances);
+    add(frame_counter::triangles, triangles * instances);
+}
+
+// call once per frame, after the frame has been submitted
+void end_frame();
+
+// totals of the last finished frame
+uint64_t last(frame_counter c);
+
+float average(frame_counter c);
+
+// the last `history_length` totals of a counter as a ring buffer, starting at `history_offset`
+const std::array<float, history_length>& history(frame_counter c);
+size_t                                   history_offset();
+
+// frame times also go into a histogram, since a few slow frames are easy to miss in an average.
+// buckets are `frame_time_max_ms / frame_time_buckets` wide, the last one also counts every
+// slower frame
+const size_t frame_time_buckets = 100;
+const float  frame_time_max_ms  = 50.f;
+
+// call once per frame with the wall clock time the frame took
+void record_frame_time(float ms);
+// frames in each bucket since the last `reset_frame_times`
+const std::array<float, frame_time_buckets>& frame_time_histogram();
+// the time that a fraction `p` of the last `history_length` frames took at most, ie 0.99 for the
+// 99th percentile
+float frame_time_percentile(float p);
+void  reset_frame_times();
+
+// write one row per frame to `path` until `end_csv`, returns false if the file can't be opened
+bool begin_csv(const std::filesystem::path& path);
+void end_csv();
+bool recording_csv();
+}  // namespace frame_stats
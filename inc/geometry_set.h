@@ -41,6 +41,14 @@ EL_OBJ EL_ALWAYS_SHARED class geometry_set {
             std::unique_ptr<reactphysics3d::TriangleVertexArray>>>
                             phys_mesh_cache;
     mio::shared_mmap_source data;
+    // every mesh in the set is uploaded into these, so that consecutive draws from the same set
+    // don't have to rebind anything
+    std::shared_ptr<buffer> vertex_buffer, index_buffer;
+    // only mapped on unified memory devices, where meshes are copied straight from the file
+    char*                   mapped_vertices;
+    char*                   mapped_indices;
+    std::vector<int32_t>    first_vertices;
+    std::vector<uint32_t>   first_indices;
 
   public:
     device*     dev;
@@ -48,6 +56,8 @@ EL_OBJ EL_ALWAYS_SHARED class geometry_set {
 
     geometry_set(device* dev, const std::filesystem::path& path);
     std::shared_ptr<mesh>                              load_mesh(size_t index);
+    // upload every mesh in the set with a single submission
+    EL_M void                                          load_all_meshes();
     std::optional<reactphysics3d::PolygonVertexArray*> load_convex_hull(size_t index);
     reactphysics3d::TriangleMesh*                      load_physics_mesh(
                              reactphysics3d::PhysicsCommon* phy, size_t index
@@ -1,6 +1,7 @@
 #pragma once
 #include "bundle.h"
 #include "cmmn.h"
+#include "frame_stats.h"
 #include <reactphysics3d/collision/PolygonVertexArray.h>
 
 using geom_file::vertex;
@@ -17,10 +18,17 @@ constexpr static vk::VertexInputAttributeDescription vertex_attribute_descriptio
 #include "device.h"
 
 struct mesh {
-    std::unique_ptr<buffer> vertex_buffer;
-    std::unique_ptr<buffer> index_buffer;
+    // meshes loaded from a geometry set share these with the rest of the set
+    std::shared_ptr<buffer> vertex_buffer;
+    std::shared_ptr<buffer> index_buffer;
     uint32_t                vertex_count, index_count;
+    // where the mesh starts in its buffers, in vertices and indices
+    int32_t                 vertex_offset;
+    uint32_t                first_index;
+    // upload timeline value after which the buffers can be drawn from
+    uint64_t                ready_value;
 
+    // create buffers just for this mesh
     mesh(
         device*                           dev,
         uint32_t                          vcount,
@@ -29,6 +37,48 @@ struct mesh {
         const std::function<void(void*)>& write_buffer
     );
 
+    // upload into a region of buffers that are shared with other meshes
+    mesh(
+        device*                           dev,
+        std::shared_ptr<buffer>           vertex_buffer,
+        std::shared_ptr<buffer>           index_buffer,
+        int32_t                           vertex_offset,
+        uint32_t                          first_index,
+        uint32_t                          vcount,
+        size_t                            vsize,
+        uint32_t                          icount,
+        const std::function<void(void*)>& write_buffer
+    );
+
+    // refer to a region of shared buffers that has already been written, ie directly through a
+    // mapping on unified memory devices
+    mesh(
+        std::shared_ptr<buffer> vertex_buffer,
+        std::shared_ptr<buffer> index_buffer,
+        int32_t                 vertex_offset,
+        uint32_t                first_index,
+        uint32_t                vcount,
+        uint32_t                icount
+    )
+        : vertex_buffer(std::move(vertex_buffer)), index_buffer(std::move(index_buffer)),
+          vertex_count(vcount), index_count(icount), vertex_offset(vertex_offset),
+          first_index(first_index), ready_value(0) {}
+
+    // bind the mesh's buffers unless `bound` says they already are, ie because the previous mesh
+    // came from the same geometry set
+    inline void bind(vk::CommandBuffer& cb, const buffer** bound) const {
+        if(*bound == vertex_buffer.get()) return;
+        cb.bindVertexBuffers(0, {vertex_buffer->buf}, {0});
+        cb.bindIndexBuffer(index_buffer->buf, 0, vk::IndexType::eUint16);
+        frame_stats::add(frame_counter::buffer_binds, 2);
+        *bound = vertex_buffer.get();
+    }
+
+    inline void draw(vk::CommandBuffer& cb, uint32_t instance_count = 1) const {
+        cb.drawIndexed(index_count, instance_count, first_index, vertex_offset, 0);
+        frame_stats::add_draw(index_count / 3, instance_count);
+    }
+
     template<typename VertexT>
     mesh(device* dev, const std::vector<VertexT>& vertices, const std::vector<uint16>& indices)
         : mesh(
@@ -45,4 +95,28 @@ struct mesh {
                 );
             }
         ) {}
+
+  private:
+    void upload(device* dev, size_t vsize, const std::function<void(void*)>& write_buffer);
+};
+
+// groups the uploads of many meshes, ie a whole geometry set or everything the init script
+// creates, into one submission that goes out as soon as the batch finishes instead of with the
+// next frame. meshes always record into `dev->uploads`, so the batch only decides when the
+// submission happens
+class mesh_upload_batch {
+    device* dev;
+    bool    finished;
+
+  public:
+    mesh_upload_batch(device* dev) : dev(dev), finished(false) {}
+
+    mesh_upload_batch(const mesh_upload_batch&)            = delete;
+    mesh_upload_batch& operator=(const mesh_upload_batch&) = delete;
+
+    // submit every upload recorded so far and return the timeline value at which all of the
+    // meshes in the batch are ready
+    uint64_t finish();
+
+    ~mesh_upload_batch();
 };
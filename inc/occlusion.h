@@ -0,0 +1,129 @@
+#pragma once
+#include "renderer.h"
+
+const size_t hiz_cull_prototype_id = 0x00010006;
+
+const size_t GLOBAL_BUF_CULL_OBJECTS    = 9;
+const size_t GLOBAL_BUF_CULL_VISIBILITY = 10;
+const size_t GLOBAL_BUF_CULL_COMMANDS   = 11;
+const size_t GLOBAL_BUF_CULL_COUNTS     = 12;
+
+// levels in the depth pyramid, enough for a 32k wide framebuffer
+const uint32_t max_hiz_levels = 16;
+
+// one renderable as the cull shader and the geometry buffer's indirect draws see it, laid out to
+// match `cull_object` in shaders/occlusion.h
+struct gpu_cull_object {
+    mat4     world;
+    vec4     bounds_min, bounds_max;
+    uint32_t index_count, first_index;
+    int32_t  vertex_offset;
+    uint32_t material_index;
+    // the count and first command of the object's batch in the second phase
+    uint32_t count_index, command_base;
+    // nonzero if the object was drawn in the first phase
+    uint32_t drawn;
+    uint32_t _pad;
+};
+
+// a run of objects that share vertex and index buffers, drawn by one indirect count draw
+struct cull_batch {
+    const mesh* m;
+    uint32_t    first, count;
+};
+
+// two phase occlusion culling. the geometry buffer feeding this node's depth input draws the
+// objects that were visible last frame, then this node builds a depth pyramid from that depth
+// and tests every object's bounds against it. objects that turn out to be visible but weren't
+// drawn yet get an indirect draw command for a second geometry buffer node, which takes this
+// node's output as its occlusion input. visibility is read back on the CPU the next frame to
+// pick the first phase, which works since only one frame is ever in flight
+class hiz_cull_render_node_prototype : public render_node_prototype {
+    struct node_data : public render_node_data {
+        vk::UniquePipeline build_from_depth, build, cull;
+    };
+
+    vk::UniqueSampler sampler;
+
+    // levels 1.. of the pyramid, level 0 is the node's output framebuffer
+    std::unique_ptr<image>           pyramid;
+    vk::UniqueImageView              pyramid_view;
+    std::vector<vk::UniqueImageView> pyramid_level_views;
+    uint32_t                         level_count;
+    // (re)create the pyramid if the swap chain changed size
+    void                             create_pyramid(renderer* r);
+
+    gpu_cull_object*                mapped_objects;
+    uint32_t*                       mapped_visibility;
+    vk::DrawIndexedIndirectCommand* mapped_commands;
+    uint32_t*                       mapped_counts;
+    size_t                          object_capacity, batch_capacity;
+
+    // the entity of each object last frame, in object order, to read back visibility
+    std::vector<entity_id>              last_objects;
+    std::unordered_map<entity_id, bool> last_visible;
+    bool                                prepared;
+
+  public:
+    std::vector<cull_batch> batches;
+    size_t                  num_objects, num_visible;
+
+    hiz_cull_render_node_prototype(device* dev);
+
+    size_t id() const override { return hiz_cull_prototype_id; }
+
+    const char* name() const override { return "Hi-Z Occlusion Cull"; }
+
+    node_kind kind() const override { return node_kind::compute; }
+
+    std::unique_ptr<render_node_data> initialize_node_data() override {
+        return std::make_unique<node_data>();
+    }
+
+    // true if a node with this prototype is part of the compiled graph
+    bool active(renderer* r) const;
+
+    // read back last frame's visibility, then fill the object buffer and the first phase draws.
+    // called by the first phase geometry buffer, later calls in the same frame do nothing
+    void prepare(renderer* r);
+
+    // the offsets of a batch's commands and count in the indirect buffers
+    inline vk::DeviceSize command_offset(size_t batch, bool second_phase) const {
+        return (batches[batch].first + (second_phase ? object_capacity : 0))
+               * sizeof(vk::DrawIndexedIndirectCommand);
+    }
+
+    inline vk::DeviceSize count_offset(size_t batch, bool second_phase) const {
+        return (batch + (second_phase ? batch_capacity : 0)) * sizeof(uint32_t);
+    }
+
+    size_t subpass_repeat_count(renderer* r, render_node* node) override;
+
+    void resize(renderer* r, render_node* node) override;
+
+    void collect_descriptor_layouts(
+        render_node*                           node,
+        std::vector<vk::DescriptorPoolSize>&   pool_sizes,
+        std::vector<vk::DescriptorSetLayout>&  layouts,
+        std::vector<vk::UniqueDescriptorSet*>& outputs
+    ) override;
+    void update_descriptor_sets(
+        renderer*                            r,
+        render_node*                         node,
+        std::vector<vk::WriteDescriptorSet>& writes,
+        arena<vk::DescriptorBufferInfo>&     buf_infos,
+        arena<vk::DescriptorImageInfo>&      img_infos
+    ) override;
+    void generate_pipelines(
+        renderer* r, render_node* node, vk::RenderPass render_pass, uint32_t subpass
+    ) override;
+    void generate_command_buffer_inline(
+        renderer*          r,
+        render_node*       node,
+        vk::CommandBuffer& cb,
+        size_t             subpass_index,
+        const frame_state& fs
+    ) override;
+
+    void build_gui(renderer* r, render_node* node) override;
+};
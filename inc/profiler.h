@@ -0,0 +1,63 @@
+#pragma once
+#include "cmmn.h"
+#include <atomic>
+
+// a CPU profiler made of scoped zones. while a capture is running, each thread records the zones
+// it leaves into its own ring buffer, and once the capture ends the rings are written out as a
+// Chrome trace (chrome://tracing or ui.perfetto.dev). outside of a capture a zone costs one
+// relaxed atomic load
+namespace profiler {
+struct zone_event {
+    // must outlive the capture, ie a string literal or a system's name
+    std::string_view name;
+    uint64_t         start_ns, end_ns;
+};
+
+// events kept per thread, older events are overwritten once a ring is full
+const size_t ring_capacity = 1 << 16;
+
+extern std::atomic<bool> capturing;
+
+uint64_t now_ns();
+
+void record(std::string_view name, uint64_t start_ns, uint64_t end_ns);
+
+// start a capture that is written to `path` after `frames` calls to `end_frame`
+void begin_capture(std::filesystem::path path, uint32_t frames);
+
+// stop the capture now and write out everything that has been recorded
+void finish_capture();
+
+// mark the end of a frame on the main thread
+void end_frame();
+
+inline bool is_capturing() { return capturing.load(std::memory_order_relaxed); }
+
+class scoped_zone {
+    std::string_view name;
+    // zero if there was no capture running when the zone was entered
+    uint64_t         start_ns;
+
+  public:
+    scoped_zone(std::string_view name)
+        : name(name), start_ns(is_capturing() ? now_ns() : 0) {}
+
+    scoped_zone(const scoped_zone&)            = delete;
+    scoped_zone& operator=(const scoped_zone&) = delete;
+
+    ~scoped_zone() {
+        if(start_ns != 0) record(name, start_ns, now_ns());
+    }
+};
+}  // namespace profiler
+
+#define PROFILE_ZONE_CONCAT_INNER(a, b) a##b
+#define PROFILE_ZONE_CONCAT(a, b)       PROFILE_ZONE_CONCAT_INNER(a, b)
+
+// profile the rest of the enclosing scope. define EGGV_NO_PROFILER to compile zones out entirely
+#ifdef EGGV_NO_PROFILER
+#define PROFILE_ZONE(name)
+#else
+#define PROFILE_ZONE(name) \
+    profiler::scoped_zone PROFILE_ZONE_CONCAT(_profile_zone_, __LINE__)(name)
+#endif
@@ -0,0 +1,257 @@
+#pragma once
+#include "cmmn.h"
+#include "ecs.h"
+#include "mem_arena.h"
+#include <utility>
+
+class renderer;
+
+using framebuffer_ref = size_t;
+
+enum class framebuffer_type { color, depth, depth_stencil };
+
+enum class framebuffer_mode {
+    /// framebuffer is bound as an input attachement
+    input_attachment,
+    /// framebuffer is bound only as shader input
+    shader_input,
+    /// framebuffer used as source for blending onto the output at a matching index
+    blend_input,
+    /// framebuffer is a render target
+    output,
+    /// framebuffer is bound as a storage image, only valid for compute nodes
+    storage
+};
+
+enum class framebuffer_subpass_binding_order { parallel, sequential };
+
+const uint32_t framebuffer_count_is_subpass_count = (uint32_t)-1;
+
+struct framebuffer_desc {
+    std::string                       name;
+    vk::Format                        format;
+    framebuffer_type                  type;
+    framebuffer_mode                  mode;
+    uint32_t                          count;
+    framebuffer_subpass_binding_order subpass_binding_order;
+
+    framebuffer_desc(
+        std::string                       name,
+        vk::Format                        fmt,
+        framebuffer_type                  ty,
+        framebuffer_mode                  mode  = framebuffer_mode::input_attachment,
+        uint32_t                          count = 1,
+        framebuffer_subpass_binding_order bo    = framebuffer_subpass_binding_order::parallel
+    )
+        : name(std::move(name)), format(fmt), type(ty), mode(mode), count(count),
+          subpass_binding_order(bo) {}
+};
+
+struct render_node_data {
+    virtual json serialize() const { return json{}; }
+
+    virtual ~render_node_data() = default;
+};
+
+struct single_pipeline_node_data : public render_node_data {
+    vk::UniquePipeline pipeline;
+
+    json serialize() const override { return json{}; }
+
+    ~single_pipeline_node_data() override = default;
+};
+
+enum class node_kind {
+    /// node runs as one or more subpasses inside a render pass
+    graphics,
+    /// node runs outside of any render pass, and can read and write whole framebuffers at once
+    compute
+};
+
+struct render_node_prototype {
+    vk::UniqueDescriptorSetLayout desc_layout;
+    vk::UniquePipelineLayout      pipeline_layout;
+    std::vector<framebuffer_desc> inputs, outputs;
+
+    virtual node_kind kind() const { return node_kind::graphics; }
+
+    virtual size_t subpass_repeat_count(class renderer* r, struct render_node* node) { return 1; }
+
+    // nodes that return true render at the renderer's dynamic resolution, into the top left corner
+    // of their framebuffers, whenever their pass doesn't use the swap chain image
+    virtual bool scales_with_render_resolution() const { return false; }
+
+    virtual void collect_descriptor_layouts(
+        struct render_node*                    node,
+        std::vector<vk::DescriptorPoolSize>&   pool_sizes,
+        std::vector<vk::DescriptorSetLayout>&  layouts,
+        std::vector<vk::UniqueDescriptorSet*>& outputs
+    ) {}
+
+    virtual void update_descriptor_sets(
+        class renderer*                      r,
+        struct render_node*                  node,
+        std::vector<vk::WriteDescriptorSet>& writes,
+        arena<vk::DescriptorBufferInfo>&     buf_infos,
+        arena<vk::DescriptorImageInfo>&      img_infos
+    ) {}
+
+    // compute nodes get a null render pass
+    virtual void generate_pipelines(
+        class renderer* r, struct render_node* node, vk::RenderPass render_pass, uint32_t subpass
+    ) {}
+
+    // compute nodes record their dispatches here as well, outside of any render pass
+    virtual void generate_command_buffer_inline(
+        class renderer*     r,
+        struct render_node* node,
+        vk::CommandBuffer&  cb,
+        size_t              subpass_index,
+        const frame_state&  fs
+    ) {}
+
+    // called when the swap chain only changed size, instead of recompiling the graph. framebuffers
+    // have already been reallocated, and `update_descriptor_sets` runs right after. nodes with
+    // their own resources sized to the swap chain recreate them here
+    virtual void resize(class renderer* r, struct render_node* node) {}
+
+    virtual std::optional<std::vector<vk::UniqueCommandBuffer>> generate_command_buffer(
+        class renderer* r, struct render_node* node
+    ) {
+        return {};
+    }
+
+    virtual void build_gui(class renderer* r, struct render_node* node) {}
+
+    virtual std::unique_ptr<render_node_data> deserialize_node_data(const json& data) {
+        return initialize_node_data();
+    }
+
+    virtual std::unique_ptr<render_node_data> initialize_node_data() { return nullptr; }
+
+    virtual const char* name() const { return "fail"; }
+
+    virtual size_t id() const        = 0;
+    virtual ~render_node_prototype() = default;
+};
+
+struct render_node {
+    bool                                                visited;
+    uint32_t                                            pass_index, subpass_index, subpass_count;
+    std::optional<std::vector<vk::UniqueCommandBuffer>> subpass_commands;
+    vk::UniqueDescriptorSet                             desc_set;
+
+    size_t                                                                    id;
+    std::shared_ptr<render_node_prototype>                                    prototype;
+    std::vector<std::pair<std::optional<std::weak_ptr<render_node>>, size_t>> inputs;
+    std::vector<framebuffer_ref>                                              outputs;
+    std::unique_ptr<render_node_data>                                         data;
+
+    render_node(std::shared_ptr<render_node_prototype> prototype);
+    render_node(renderer*, size_t id, json data);
+
+    inline std::shared_ptr<render_node> input_node(size_t i) const {
+        if(!inputs[i].first.has_value()) return nullptr;
+        return inputs[i].first->lock();
+    }
+
+    inline std::optional<framebuffer_ref> input_framebuffer(size_t i) const {
+        auto inp = input_node(i);
+        if(inp == nullptr) return {};
+        return inp->outputs[inputs[i].second];
+    }
+
+    json serialize() const;
+
+    virtual ~render_node() = default;
+};
+
+// the swap chain image is always framebuffer 1, 0 means "no framebuffer"
+const framebuffer_ref swap_chain_framebuffer = 1;
+
+// a framebuffer as assigned by the graph compiler, without any actual image backing it
+struct compiled_framebuffer {
+    framebuffer_ref  ref;
+    vk::Format       format;
+    framebuffer_type type;
+    uint32_t         layers;
+    // true if the framebuffer should be viewed as an array, even if it only has one layer
+    bool             arrayed;
+    // true if some compute node binds the framebuffer as a storage image
+    bool             storage;
+    // every (node id, output index) pair that renders into this framebuffer. more than one user
+    // means the framebuffer is aliased, ie by a node that blends onto its input
+    std::vector<std::pair<size_t, size_t>> users;
+};
+
+struct compiled_subpass {
+    std::shared_ptr<render_node>           node;
+    uint32_t                               rep_index;
+    std::vector<vk::AttachmentReference>   input_attachments, color_attachments;
+    std::optional<vk::AttachmentReference> depth_attachment;
+};
+
+// an image barrier on a whole framebuffer, recorded before a pass begins
+struct compiled_barrier {
+    framebuffer_ref        fb;
+    vk::ImageLayout        old_layout, new_layout;
+    vk::PipelineStageFlags src_stage, dst_stage;
+    vk::AccessFlags        src_access, dst_access;
+};
+
+// either a single render pass containing a run of graphics nodes, or a run of compute nodes
+struct compiled_pass {
+    node_kind                                 kind;
+    std::vector<std::shared_ptr<render_node>> nodes;
+
+    // graphics passes only
+    std::vector<vk::AttachmentDescription> attachments;
+    std::map<framebuffer_ref, uint32_t>    attachment_refs;
+    std::vector<compiled_subpass>          subpasses;
+    std::vector<vk::SubpassDependency>     dependencies;
+
+    // synchronization with previous passes, recorded before the pass begins. the memory barrier
+    // covers buffers written by a preceding compute pass
+    std::vector<compiled_barrier> barriers;
+    bool                          memory_barrier;
+
+    // create Vulkan subpass descriptions that point into `subpasses`
+    std::vector<vk::SubpassDescription> subpass_descriptions() const;
+
+    inline bool uses_swap_chain() const {
+        return attachment_refs.find(swap_chain_framebuffer) != attachment_refs.end();
+    }
+};
+
+// the device independent result of compiling a render graph: everything needed to create the
+// render passes and framebuffers, but only as plain data
+struct compiled_graph {
+    std::vector<compiled_framebuffer>         framebuffers;
+    std::vector<compiled_pass>                passes;
+    std::vector<std::shared_ptr<render_node>> subpass_order;
+    framebuffer_ref                           next_ref;
+    // recorded after the last pass, ie to get the swap chain image ready to present if nothing
+    // rendered to it
+    std::vector<compiled_barrier> final_barriers;
+
+    const compiled_framebuffer* framebuffer(framebuffer_ref ref) const;
+
+    size_t subpass_count() const;
+
+    // check that every attachment reference is in bounds, that every subpass that consumes the
+    // output of another subpass in the same pass has a dependency on it, and that every read of
+    // a framebuffer written in a previous pass has a barrier; returns a message for each problem
+    std::vector<std::string> validate() const;
+};
+
+// compile the graph reachable from `output_node` into a sequence of passes. each node's
+// `subpass_count` must already be set. framebuffer refs are handed out starting at `first_ref`.
+// this assigns `outputs`, `pass_index` and `subpass_index` on each node but otherwise touches no
+// device state
+compiled_graph compile_graph(
+    const std::vector<std::shared_ptr<render_node>>& graph,
+    const std::shared_ptr<render_node>&              output_node,
+    vk::Format                                       swap_chain_format,
+    framebuffer_ref                                  first_ref,
+    bool                                             log = false
+);
@@ -3,158 +3,27 @@
 #include "bundle.h"
 #include "cmmn.h"
 #include "ecs.h"
-#include "mem_arena.h"
 #include "mesh.h"
+#include "render_graph.h"
 #include "scene_components.h"
 #include "swap_chain.h"
+#include "upload_service.h"
 #include <utility>
 
-using framebuffer_ref = size_t;
-
-enum class framebuffer_type { color, depth, depth_stencil };
-
-enum class framebuffer_mode {
-    /// framebuffer is bound as an input attachement
-    input_attachment,
-    /// framebuffer is bound only as shader input
-    shader_input,
-    /// framebuffer used as source for blending onto the output at a matching index
-    blend_input,
-    /// framebuffer is a render target
-    output
-};
-
-enum class framebuffer_subpass_binding_order { parallel, sequential };
-
-const uint32_t framebuffer_count_is_subpass_count = (uint32_t)-1;
-
-struct framebuffer_desc {
-    std::string                       name;
-    vk::Format                        format;
-    framebuffer_type                  type;
-    framebuffer_mode                  mode;
-    uint32_t                          count;
-    framebuffer_subpass_binding_order subpass_binding_order;
-
-    framebuffer_desc(
-        std::string                       name,
-        vk::Format                        fmt,
-        framebuffer_type                  ty,
-        framebuffer_mode                  mode  = framebuffer_mode::input_attachment,
-        uint32_t                          count = 1,
-        framebuffer_subpass_binding_order bo    = framebuffer_subpass_binding_order::parallel
-    )
-        : name(std::move(name)), format(fmt), type(ty), mode(mode), count(count),
-          subpass_binding_order(bo) {}
-};
-
-struct render_node_data {
-    virtual json serialize() const { return json{}; }
-
-    virtual ~render_node_data() = default;
-};
-
-struct single_pipeline_node_data : public render_node_data {
-    vk::UniquePipeline pipeline;
-
-    json serialize() const override { return json{}; }
-
-    ~single_pipeline_node_data() override = default;
-};
-
-struct render_node_prototype {
-    vk::UniqueDescriptorSetLayout desc_layout;
-    vk::UniquePipelineLayout      pipeline_layout;
-    std::vector<framebuffer_desc> inputs, outputs;
-
-    virtual size_t subpass_repeat_count(class renderer* r, struct render_node* node) { return 1; }
-
-    virtual void collect_descriptor_layouts(
-        struct render_node*                    node,
-        std::vector<vk::DescriptorPoolSize>&   pool_sizes,
-        std::vector<vk::DescriptorSetLayout>&  layouts,
-        std::vector<vk::UniqueDescriptorSet*>& outputs
-    ) {}
-
-    virtual void update_descriptor_sets(
-        class renderer*                      r,
-        struct render_node*                  node,
-        std::vector<vk::WriteDescriptorSet>& writes,
-        arena<vk::DescriptorBufferInfo>&     buf_infos,
-        arena<vk::DescriptorImageInfo>&      img_infos
-    ) {}
-
-    virtual void generate_pipelines(
-        class renderer* r, struct render_node* node, vk::RenderPass render_pass, uint32_t subpass
-    ) {}
-
-    virtual void generate_command_buffer_inline(
-        class renderer*     r,
-        struct render_node* node,
-        vk::CommandBuffer&  cb,
-        size_t              subpass_index,
-        const frame_state&  fs
-    ) {}
-
-    virtual std::optional<std::vector<vk::UniqueCommandBuffer>> generate_command_buffer(
-        class renderer* r, struct render_node* node
-    ) {
-        return {};
-    }
-
-    virtual void build_gui(class renderer* r, struct render_node* node) {}
-
-    virtual std::unique_ptr<render_node_data> deserialize_node_data(const json& data) {
-        return initialize_node_data();
-    }
-
-    virtual std::unique_ptr<render_node_data> initialize_node_data() { return nullptr; }
-
-    virtual const char* name() const { return "fail"; }
-
-    virtual size_t id() const        = 0;
-    virtual ~render_node_prototype() = default;
-};
-
-struct render_node {
-    bool                                                visited;
-    uint32_t                                            subpass_index, subpass_count;
-    std::optional<std::vector<vk::UniqueCommandBuffer>> subpass_commands;
-    vk::UniqueDescriptorSet                             desc_set;
-
-    size_t                                                                    id;
-    std::shared_ptr<render_node_prototype>                                    prototype;
-    std::vector<std::pair<std::optional<std::weak_ptr<render_node>>, size_t>> inputs;
-    std::vector<framebuffer_ref>                                              outputs;
-    std::unique_ptr<render_node_data>                                         data;
-
-    render_node(std::shared_ptr<render_node_prototype> prototype);
-    render_node(renderer*, size_t id, json data);
-
-    inline std::shared_ptr<render_node> input_node(size_t i) const {
-        if(!inputs[i].first.has_value()) return nullptr;
-        return inputs[i].first->lock();
-    }
-
-    inline std::optional<framebuffer_ref> input_framebuffer(size_t i) const {
-        auto inp = input_node(i);
-        if(inp == nullptr) return {};
-        return inp->outputs[inputs[i].second];
-    }
-
-    json serialize() const;
-
-    virtual ~render_node() = default;
-};
-
 struct frame_uniforms {
-    mat4 view, proj;
+    mat4 view, proj, inv_proj;
+    // (width, height, 1/width, 1/height)
+    vec4 viewport;
 };
 
 struct gpu_material {
-    vec4 base_color;
+    vec4     base_color;
+    // index into the bindless texture array
+    uint32_t diffuse_tex;
+    uint32_t _pad[3];
 
-    gpu_material(material* mat) : base_color(mat->base_color, 1.f) {}
+    gpu_material(material* mat, uint32_t diffuse_tex)
+        : base_color(mat->base_color, 1.f), diffuse_tex(diffuse_tex), _pad{0, 0, 0} {}
 };
 
 struct framebuffer_values {
@@ -162,16 +31,20 @@ struct framebuffer_values {
     bool                             in_use;
     std::vector<vk::UniqueImageView> image_views;
     framebuffer_type                 type;
+    bool                             arrayed;
 
-    framebuffer_values() : img(nullptr), in_use(false), type(framebuffer_type::color) {}
+    framebuffer_values()
+        : img(nullptr), in_use(false), type(framebuffer_type::color), arrayed(false) {}
 
     framebuffer_values(
         std::unique_ptr<image>&&           img,
         bool                               in_use,
         std::vector<vk::UniqueImageView>&& image_views,
-        framebuffer_type                   type
+        framebuffer_type                   type,
+        bool                               arrayed
     )
-        : img(std::move(img)), in_use(in_use), image_views(std::move(image_views)), type(type) {}
+        : img(std::move(img)), in_use(in_use), image_views(std::move(image_views)), type(type),
+          arrayed(arrayed) {}
 
     inline bool is_array() const { return image_views.size() > 1; }
 
@@ -184,9 +57,19 @@ struct gpu_texture {
     std::shared_ptr<image> img;
     vk::UniqueImageView    img_view;
     uint64_t               imgui_tex_id;
-
-    gpu_texture(std::shared_ptr<image> img, vk::UniqueImageView img_view)
-        : img(std::move(img)), img_view(std::move(img_view)), imgui_tex_id(0) {}
+    // index into the bindless texture array
+    uint32_t               index;
+    // upload timeline value after which the texture can be sampled
+    uint64_t               ready_value;
+
+    gpu_texture(
+        std::shared_ptr<image> img,
+        vk::UniqueImageView    img_view,
+        uint32_t               index,
+        uint64_t               ready_value
+    )
+        : img(std::move(img)), img_view(std::move(img_view)), imgui_tex_id(0), index(index),
+          ready_value(ready_value) {}
 };
 
 EL_OBJ struct renderable {
@@ -203,9 +86,61 @@ EL_OBJ struct renderable {
     );
 };
 
+// a snapshot of GPU memory usage in MiB, for scripts
+EL_OBJ struct gpu_memory_stats {
+    EL_PROP(r) float framebuffer;
+    EL_PROP(r) float mesh;
+    EL_PROP(r) float texture;
+    EL_PROP(r) float uniform;
+    EL_PROP(r) float staging;
+    EL_PROP(r) float other;
+    // summed over device local heaps
+    EL_PROP(r) float usage;
+    EL_PROP(r) float budget;
+
+    gpu_memory_stats(device* dev);
+};
+
 const size_t GLOBAL_BUF_FRAME_UNIFORMS = 1;
 const size_t GLOBAL_BUF_MATERIALS      = 2;
 
+// size of the bindless texture array, every texture in the cache gets a slot
+const uint32_t max_bindless_textures = 4096;
+
+// GPU time spent in one render graph node
+struct gpu_node_timing {
+    float last_ms;
+    // exponential moving average, so it settles over roughly the last 20 frames
+    float avg_ms;
+};
+
+// number of nodes that can be timed in one frame, each one uses two timestamp queries
+const uint32_t max_timed_nodes = 128;
+
+// every graphics pipeline takes its viewport and scissor from the command buffer, so that the
+// render resolution can change without recreating pipelines
+const vk::DynamicState viewport_dynamic_states[]
+    = {vk::DynamicState::eViewport, vk::DynamicState::eScissor};
+const vk::PipelineDynamicStateCreateInfo viewport_dynamic_state{{}, 2, viewport_dynamic_states};
+
+// picks the fraction of the swap chain resolution to render at so that the GPU frame time stays
+// under a target
+struct dynamic_resolution_controller {
+    bool  enabled;
+    // milliseconds
+    float target_frame_time;
+    float min_scale, max_scale;
+    // fraction of the swap chain width and height that scaled nodes render
+    float scale;
+
+    dynamic_resolution_controller()
+        : enabled(false), target_frame_time(1000.f / 60.f), min_scale(0.5f), max_scale(1.f),
+          scale(1.f) {}
+
+    // adjust `scale` given the GPU time of the last frame
+    void update(float gpu_ms);
+};
+
 class renderer : public entity_system<renderable> {
     // THOUGHT: in some sense, the renderer is really another inner ECS `world` with its own
     // subsystems and components...
@@ -217,11 +152,25 @@ class renderer : public entity_system<renderable> {
     void build_gui_textures(const frame_state& fs);
 
     // render graph compilation helpers
-    void generate_attachment_descriptions(
-        std::vector<vk::AttachmentDescription>& attachments,
-        std::map<framebuffer_ref, uint32_t>&    attachment_refs
+    void generate_clear_values(const compiled_pass& pass, std::vector<vk::ClearValue>& cv);
+    void record_barriers(
+        vk::CommandBuffer&                   cb,
+        const std::vector<compiled_barrier>& barriers,
+        bool                                 memory_barrier,
+        uint32_t                             image_index
     );
-    void generate_clear_values();
+
+    // GPU profiling helpers. `begin_node_timing` returns the first of the node's two queries, or
+    // nothing if the node can't be timed
+    std::optional<uint32_t> begin_node_timing(vk::CommandBuffer& cb, render_node* node);
+    void end_node_timing(vk::CommandBuffer& cb, std::optional<uint32_t> query);
+
+    // set the viewport and scissor for a node, either the full swap chain size or the current
+    // render resolution
+    void set_viewport(vk::CommandBuffer& cb, bool scaled);
+
+    // point the renderer at a new or recreated swap chain and size the viewports to it
+    void use_swap_chain(swap_chain* swpc);
 
   public:  // TODO: a lot of this stuff should be private
     static const system_id id = (system_id)static_systems::renderer;
@@ -237,49 +186,71 @@ class renderer : public entity_system<renderable> {
     // "framebuffers" aka vk::Images that can be rendered to
     framebuffer_ref                               next_id;
     std::map<framebuffer_ref, framebuffer_values> buffers;
-    framebuffer_ref allocate_framebuffer(const framebuffer_desc&, uint32_t subpass_count);
-    // the actual Vulkan framebuffer objects that contain *all* attachments for a frame
-    std::vector<vk::UniqueFramebuffer> framebuffers;
-
-    // the render pass that was created from the render graph
-    vk::UniqueRenderPass                      render_pass;
-    std::vector<vk::ClearValue>               clear_values;
-    vk::RenderPassBeginInfo                   render_pass_begin_info;
-    std::vector<std::shared_ptr<render_node>> subpass_order;
-    vk::UniqueDescriptorPool                  desc_pool;
+    // back a compiled framebuffer with an image, reusing a free one if possible
+    void allocate_framebuffer(const compiled_framebuffer&);
+
+    // the render passes that were created from the render graph, one for each compiled pass.
+    // compute passes have no render pass
+    struct render_pass_values {
+        vk::UniqueRenderPass render_pass;
+        // the actual Vulkan framebuffer objects that contain all attachments for a frame
+        std::vector<vk::UniqueFramebuffer> framebuffers;
+        std::vector<vk::ClearValue>        clear_values;
+    };
+    std::vector<render_pass_values> passes;
+    vk::UniqueDescriptorPool        desc_pool;
+    void                            create_pass_framebuffers(size_t pass_index);
 
     // uniform/storage buffers for shader parameters
     std::map<size_t, std::unique_ptr<buffer>> global_buffers;
     frame_uniforms*                           mapped_frame_uniforms;
-    gpu_material*                             mapped_materials;
     uint32_t                                  num_gpu_mats;
 
+    // the material buffer is device local, changed materials are copied through the staging
+    // buffer at the start of each frame
+    std::unique_ptr<buffer> material_staging;
+    gpu_material*           mapped_material_staging;
+    void                    upload_dirty_materials(vk::CommandBuffer& cb);
+
     // texturing/materials
     std::unordered_map<std::string, gpu_texture> texture_cache;
+    // textures are uploaded through `dev->uploads`, and can't be sampled until their
+    // `ready_value` has completed
     gpu_texture&                                 create_texture2d(
                                         const std::string& name,
                                         uint32_t           width,
                                         uint32_t           height,
                                         vk::Format         fmt,
                                         size_t             data_size,
-                                        void*              data,
-                                        vk::CommandBuffer  uplcb
+                                        void*              data
                                     );
-    gpu_texture&      load_texture_from_bundle(const std::string& name, vk::CommandBuffer uplcb);
+    gpu_texture&      load_texture_from_bundle(const std::string& name);
     vk::UniqueSampler texture_sampler;
-    vk::UniqueDescriptorPool      material_desc_pool;
-    vk::UniqueDescriptorSetLayout material_desc_set_layout;
-
-    // render graph "compilation" from graph -> Vulkan render pass
-    void compile_render_graph();
-    void propagate_blended_framebuffers(std::shared_ptr<render_node> node);
-    void generate_subpasses(
-        const std::shared_ptr<render_node>&,
-        std::vector<vk::SubpassDescription>&,
-        std::vector<vk::SubpassDependency>&        dependencies,
-        const std::map<framebuffer_ref, uint32_t>& attachment_refs,
-        arena<vk::AttachmentReference>&            reference_pool
-    );
+    // every texture lives in one descriptor array, which nodes bind once as set 1. materials
+    // refer to textures by index
+    vk::UniqueDescriptorPool      texture_desc_pool;
+    vk::UniqueDescriptorSetLayout texture_desc_set_layout;
+    vk::DescriptorSet             texture_desc_set;
+    uint32_t                      next_texture_index;
+
+    // GPU timestamps are written around every node and read back at the start of the next frame,
+    // once the frame fence says the previous frame is done
+    vk::UniqueQueryPool               timestamp_pool;
+    // nanoseconds per timestamp tick
+    float                             timestamp_period;
+    uint64_t                          timestamp_mask;
+    // ids of the nodes timed in the last recorded frame, in query order
+    std::vector<size_t>               timed_nodes;
+    std::map<size_t, gpu_node_timing> node_timings;
+    float                             frame_gpu_ms;
+    // update `node_timings` and `frame_gpu_ms` from the last recorded frame, which must be done.
+    // returns false if there was nothing to read
+    bool                              read_timestamps();
+
+    // render graph "compilation" from graph -> compiled_graph -> Vulkan render pass
+    compiled_graph compiled;
+    float          compile_duration;
+    void           compile_render_graph();
 
     void load_initial_render_graph();
 
@@ -302,8 +273,8 @@ class renderer : public entity_system<renderable> {
 
     std::shared_ptr<bundle> current_bundle;
 
-    // call `f` on each renderable entity ie every entity with a mesh and transform
-    // provided as a helper for render nodes
+    // call `f` on each renderable entity ie every entity with a mesh and transform, skipping
+    // meshes that are still being uploaded. provided as a helper for render nodes
     void for_each_renderable(
         const std::function<void(entity_id, const renderable&, const transform&)>& f
     );
@@ -312,10 +283,22 @@ class renderer : public entity_system<renderable> {
     vk::Viewport full_viewport;
     vk::Rect2D   full_scissor;
 
+    // dynamic resolution. framebuffers are still allocated at the swap chain size, but nodes that
+    // scale with the render resolution only draw into `render_viewport`, and an upscale node
+    // stretches the result over the swap chain image. only active while the graph has an upscale
+    // node, since otherwise the scaled image would end up in a corner of the screen
+    dynamic_resolution_controller resolution;
+    vk::Viewport                  render_viewport;
+    vk::Rect2D                    render_scissor;
+    bool                          dynamic_resolution_active() const;
+
     // renderer lifecycle
     renderer(const std::shared_ptr<world>& w);
     void init(device* dev);
     void create_swapchain_dependencies(swap_chain* swpc);
+    // like `create_swapchain_dependencies`, but keeps the compiled graph, render passes and
+    // pipelines when only the swap chain's size changed. the device must be idle
+    void resize_swapchain_dependencies(swap_chain* swpc);
     void build_gui(frame_state& fs) override;
     void build_gui_for_entity(const frame_state& fs, entity_id selected_entity) override;
     void update(const frame_state& fs) override;
@@ -1,5 +1,6 @@
 #pragma once
 #include "cmmn.h"
+#include "frame_stats.h"
 #include "imgui.h"
 #include "imgui_impl_vulkan.h"
 #include "renderer.h"
@@ -19,17 +20,22 @@ struct simple_geom_render_node_prototype : public single_pipeline_render_node_pr
                              "depth", vk::Format::eUndefined, framebuffer_type::depth, framebuffer_mode::output},
         };
 
-        desc_layout = dev->create_desc_set_layout({vk::DescriptorSetLayoutBinding(
-            0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex
-        )});
+        desc_layout = dev->create_desc_set_layout(
+            {vk::DescriptorSetLayoutBinding(
+                 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex
+             ),
+             vk::DescriptorSetLayoutBinding(
+                 1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eFragment
+             )}
+        );
 
         vk::PushConstantRange push_consts[] = {
-            vk::PushConstantRange{vk::ShaderStageFlagBits::eVertex,   0,            sizeof(mat4)},
-            vk::PushConstantRange{vk::ShaderStageFlagBits::eFragment, sizeof(mat4), sizeof(vec3)},
+            vk::PushConstantRange{vk::ShaderStageFlagBits::eVertex,   0,            sizeof(mat4)  },
+            vk::PushConstantRange{vk::ShaderStageFlagBits::eFragment, sizeof(mat4), sizeof(uint32)},
         };
 
         vk::DescriptorSetLayout desc_layouts[]
-            = {desc_layout.get(), r->material_desc_set_layout.get()};
+            = {desc_layout.get(), r->texture_desc_set_layout.get()};
 
         pipeline_layout = dev->dev->createPipelineLayoutUnique(vk::PipelineLayoutCreateInfo{
             {}, 2, desc_layouts, 2, push_consts});
@@ -46,6 +52,7 @@ struct simple_geom_render_node_prototype : public single_pipeline_render_node_pr
         std::vector<vk::UniqueDescriptorSet*>& outputs
     ) override {
         pool_sizes.emplace_back(vk::DescriptorType::eUniformBuffer, 1);
+        pool_sizes.emplace_back(vk::DescriptorType::eStorageBuffer, 1);
         layouts.push_back(desc_layout.get());
         outputs.push_back(&node->desc_set);
     }
@@ -63,6 +70,16 @@ struct simple_geom_render_node_prototype : public single_pipeline_render_node_pr
         writes.emplace_back(
             node->desc_set.get(), 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, b
         );
+        if(r->global_buffers[GLOBAL_BUF_MATERIALS]) {
+            auto* m = buf_infos.alloc(vk::DescriptorBufferInfo(
+                r->global_buffers[GLOBAL_BUF_MATERIALS]->buf,
+                0,
+                r->num_gpu_mats * sizeof(gpu_material)
+            ));
+            writes.emplace_back(
+                node->desc_set.get(), 1, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, m
+            );
+        }
     }
 
     void generate_pipelines(
@@ -127,7 +144,7 @@ struct simple_geom_render_node_prototype : public single_pipeline_render_node_pr
             &multisample_state,
             &depth_stencil_state,
             &color_blending_state,
-            nullptr,
+            &viewport_dynamic_state,
             this->pipeline_layout.get(),
             render_pass,
             subpass
@@ -148,31 +165,26 @@ struct simple_geom_render_node_prototype : public single_pipeline_render_node_pr
             vk::PipelineBindPoint::eGraphics,
             this->pipeline_layout.get(),
             0,
-            {node->desc_set.get()},
+            {node->desc_set.get(), r->texture_desc_set},
             {}
         );
+        frame_stats::add(frame_counter::pipeline_binds);
+        frame_stats::add(frame_counter::descriptor_binds);
 
+        const buffer* bound = nullptr;
         r->for_each_renderable([&](entity_id id, auto mesh, auto transform) {
-            cb.bindDescriptorSets(
-                vk::PipelineBindPoint::eGraphics,
-                this->pipeline_layout.get(),
-                1,
-                {mesh.mat->desc_set},
-                {}
-            );
             const auto& m = mesh.m;
-            cb.bindVertexBuffers(0, {m->vertex_buffer->buf}, {0});
-            cb.bindIndexBuffer(m->index_buffer->buf, 0, vk::IndexType::eUint16);
+            m->bind(cb, &bound);
             cb.pushConstants<mat4>(
                 this->pipeline_layout.get(), vk::ShaderStageFlagBits::eVertex, 0, {transform.world}
             );
-            cb.pushConstants<vec3>(
+            cb.pushConstants<uint32>(
                 this->pipeline_layout.get(),
                 vk::ShaderStageFlagBits::eFragment,
                 sizeof(mat4),
-                {vec3(mesh.mat ? mesh.mat->base_color : vec3(0.5f, 0.f, 0.2f))}
+                {mesh.mat ? mesh.mat->_render_index : 0}
             );
-            cb.drawIndexed(m->index_count, 1, 0, 0, 0);
+            m->draw(cb);
         });
     }
 };
@@ -217,6 +229,11 @@ struct color_preview_render_node_prototype : public render_node_prototype {
         return std::make_unique<node_data>();
     }
 
+    // the framebuffer keeps its ref but gets new image views
+    void resize(renderer* r, render_node* node) override {
+        ((node_data*)node->data.get())->fb = -1;
+    }
+
     void build_gui(renderer* r, render_node* node) override {
         if(node->input_node(0) == nullptr) return;
 
@@ -249,3 +266,189 @@ struct color_preview_render_node_prototype : public render_node_prototype {
         }
     }
 };
+
+const size_t upscale_prototype_id = 0x0000fffb;
+
+// stretches a color framebuffer rendered at the dynamic resolution over its whole output, ie the
+// swap chain image. without dynamic resolution this is just a copy
+struct upscale_render_node_prototype : public single_pipeline_render_node_prototype {
+    vk::UniqueSampler sampler;
+
+    upscale_render_node_prototype(device* dev) {
+        inputs = {
+            framebuffer_desc{
+                             "color", vk::Format::eUndefined,
+                             framebuffer_type::color,
+                             framebuffer_mode::shader_input},
+        };
+        outputs = {
+            framebuffer_desc{
+                             "color", vk::Format::eUndefined,
+                             framebuffer_type::color,
+                             framebuffer_mode::output},
+        };
+
+        desc_layout = dev->create_desc_set_layout({vk::DescriptorSetLayoutBinding(
+            0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment
+        )});
+
+        vk::PushConstantRange push_consts[] = {
+            vk::PushConstantRange{vk::ShaderStageFlagBits::eFragment, 0, sizeof(vec4)}
+        };
+
+        pipeline_layout = dev->dev->createPipelineLayoutUnique(vk::PipelineLayoutCreateInfo{
+            {}, 1, &desc_layout.get(), 1, push_consts});
+
+        // the shader keeps its samples inside the rendered part of the input, so the address
+        // mode only matters at the very edge
+        sampler = dev->dev->createSamplerUnique(vk::SamplerCreateInfo{
+            {},
+            vk::Filter::eLinear,
+            vk::Filter::eLinear,
+            vk::SamplerMipmapMode::eNearest,
+            vk::SamplerAddressMode::eClampToEdge,
+            vk::SamplerAddressMode::eClampToEdge,
+            vk::SamplerAddressMode::eClampToEdge});
+    }
+
+    size_t id() const override { return upscale_prototype_id; }
+
+    const char* name() const override { return "Upscale"; }
+
+    void collect_descriptor_layouts(
+        render_node*                           node,
+        std::vector<vk::DescriptorPoolSize>&   pool_sizes,
+        std::vector<vk::DescriptorSetLayout>&  layouts,
+        std::vector<vk::UniqueDescriptorSet*>& outputs
+    ) override {
+        pool_sizes.emplace_back(vk::DescriptorType::eCombinedImageSampler, 1);
+        layouts.push_back(desc_layout.get());
+        outputs.push_back(&node->desc_set);
+    }
+
+    void update_descriptor_sets(
+        renderer*                            r,
+        render_node*                         node,
+        std::vector<vk::WriteDescriptorSet>& writes,
+        arena<vk::DescriptorBufferInfo>&     buf_infos,
+        arena<vk::DescriptorImageInfo>&      img_infos
+    ) override {
+        auto input = node->input_framebuffer(0);
+        if(!input.has_value() || input.value() == 0) return;
+        writes.emplace_back(
+            node->desc_set.get(),
+            0,
+            0,
+            1,
+            vk::DescriptorType::eCombinedImageSampler,
+            img_infos.alloc(vk::DescriptorImageInfo(
+                sampler.get(),
+                r->buffers[input.value()].image_views[0].get(),
+                vk::ImageLayout::eShaderReadOnlyOptimal
+            ))
+        );
+    }
+
+    void generate_pipelines(
+        renderer* r, render_node* node, vk::RenderPass render_pass, uint32_t subpass
+    ) override {
+        vk::PipelineShaderStageCreateInfo shader_stages[] = {
+            vk::PipelineShaderStageCreateInfo{
+                                              {},
+                                              vk::ShaderStageFlagBits::eVertex,
+                                              r->dev->load_shader("entire-screen.vert.spv"),
+                                              "main"},
+            vk::PipelineShaderStageCreateInfo{
+                                              {},
+                                              vk::ShaderStageFlagBits::eFragment,
+                                              r->dev->load_shader("upscale.frag.spv"),
+                                              "main"}
+        };
+
+        auto vertex_input_info = vk::PipelineVertexInputStateCreateInfo{};
+
+        auto input_assembly
+            = vk::PipelineInputAssemblyStateCreateInfo{{}, vk::PrimitiveTopology::eTriangleList};
+
+        auto viewport_state
+            = vk::PipelineViewportStateCreateInfo{{}, 1, &r->full_viewport, 1, &r->full_scissor};
+
+        auto rasterizer_state = vk::PipelineRasterizationStateCreateInfo{
+            {},
+            false,
+            false,
+            vk::PolygonMode::eFill,
+            vk::CullModeFlagBits::eNone,
+            vk::FrontFace::eCounterClockwise,
+            false,
+            0.f,
+            0.f,
+            0.f,
+            1.f};
+
+        auto multisample_state = vk::PipelineMultisampleStateCreateInfo{};
+
+        auto depth_stencil_state = vk::PipelineDepthStencilStateCreateInfo{};
+
+        vk::PipelineColorBlendAttachmentState color_blend_att[]
+            = {vk::PipelineColorBlendAttachmentState{}};
+        color_blend_att[0].colorWriteMask
+            = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG
+              | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA;
+        auto color_blending_state = vk::PipelineColorBlendStateCreateInfo{
+            {}, false, vk::LogicOp::eCopy, 1, color_blend_att};
+
+        auto cfo = vk::GraphicsPipelineCreateInfo(
+            {},
+            2,
+            shader_stages,
+            &vertex_input_info,
+            &input_assembly,
+            nullptr,
+            &viewport_state,
+            &rasterizer_state,
+            &multisample_state,
+            &depth_stencil_state,
+            &color_blending_state,
+            &viewport_dynamic_state,
+            this->pipeline_layout.get(),
+            render_pass,
+            subpass
+        );
+
+        this->create_pipeline(r, node, cfo);
+    }
+
+    void generate_command_buffer_inline(
+        renderer*          r,
+        render_node*       node,
+        vk::CommandBuffer& cb,
+        size_t             subpass_index,
+        const frame_state& fs
+    ) override {
+        cb.bindPipeline(vk::PipelineBindPoint::eGraphics, this->pipeline(node));
+        cb.bindDescriptorSets(
+            vk::PipelineBindPoint::eGraphics,
+            this->pipeline_layout.get(),
+            0,
+            {node->desc_set.get()},
+            {}
+        );
+        frame_stats::add(frame_counter::pipeline_binds);
+        frame_stats::add(frame_counter::descriptor_binds);
+        // (render width / full width, render height / full height, 1 / full width, 1 / full height)
+        cb.pushConstants<vec4>(
+            this->pipeline_layout.get(),
+            vk::ShaderStageFlagBits::eFragment,
+            0,
+            {vec4(
+                r->render_viewport.width / r->full_viewport.width,
+                r->render_viewport.height / r->full_viewport.height,
+                1.f / r->full_viewport.width,
+                1.f / r->full_viewport.height
+            )}
+        );
+        cb.draw(3, 1, 0, 0);
+        frame_stats::add_draw(1);
+    }
+};
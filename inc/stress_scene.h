@@ -0,0 +1,58 @@
+#pragma once
+#include "bundle.h"
+#include "renderer.h"
+#include "scene_components.h"
+
+// describes a procedurally generated scene for performance runs. the same description always
+// generates the same scene
+struct stress_scene_desc {
+    uint32_t seed;
+    uint32_t entities;
+    // children per entity, entities are added breadth first. 0 puts every entity directly under
+    // the scene's root
+    uint32_t branching;
+    // new materials to create, 0 uses the bundle's materials if it has any
+    uint32_t materials;
+    uint32_t point_lights, directional_lights;
+    // also pick meshes from the bundle's geometry sets, not only the generated shapes
+    bool     bundle_geometry;
+    // spin every entity a little each frame
+    bool     motion;
+    // entities and lights are scattered in a cube with this half size
+    float    extent;
+
+    stress_scene_desc()
+        : seed(1), entities(1000), branching(0), materials(8), point_lights(16),
+          directional_lights(1), bundle_geometry(true), motion(false), extent(100.f) {}
+
+    // parse comma separated `key=value` pairs, ie "entities=10000,branching=4,motion=1". keys are
+    // the field names, unknown keys throw
+    static stress_scene_desc parse(std::string_view spec);
+};
+
+struct stress_motion {
+    vec3  axis;
+    // radians per second
+    float speed;
+};
+
+// rotates generated entities about their own axis every frame
+class stress_motion_system : public entity_system<stress_motion> {
+  public:
+    static const system_id id = (system_id)static_systems::stress_motion;
+
+    stress_motion_system(const std::shared_ptr<world>& w) : entity_system<stress_motion>(w) {}
+
+    void update(const frame_state& fs) override;
+
+    std::string_view name() const override { return "Stress Motion"; }
+};
+
+// add the scene described by `desc` to `w` under a new entity, which is returned. generated
+// materials are added to `bndl`
+entity generate_stress_scene(
+    const std::shared_ptr<world>&  w,
+    const std::shared_ptr<bundle>& bndl,
+    device*                        dev,
+    const stress_scene_desc&       desc
+);
@@ -2,6 +2,16 @@
 #include "cmmn.h"
 #include "device.h"
 
+// what the swap chain asks the surface for. a present mode the surface doesn't support falls back
+// to FIFO, which is always available, and the image count is clamped to what the surface allows
+struct present_options {
+    vk::PresentModeKHR mode;
+    // 0 for one more than the surface's minimum
+    uint32_t           image_count;
+
+    present_options() : mode(vk::PresentModeKHR::eFifo), image_count(0) {}
+};
+
 struct swap_chain {
     device*                          dev;
     vk::UniqueSwapchainKHR           sch;
@@ -9,7 +19,22 @@ struct swap_chain {
     std::vector<vk::UniqueImageView> image_views;
     vk::Extent2D                     extent;
     vk::Format                       format;
-    vk::UniqueSemaphore              image_ava_sp, render_fin_sp;
+    vk::UniqueSemaphore              image_ava_sp;
+    // one per image, so that a semaphore is only signaled again once its image has been presented
+    // and acquired again
+    std::vector<vk::UniqueSemaphore> render_fin_sps;
+
+    // takes effect the next time the swap chain is recreated
+    present_options                 options;
+    vk::PresentModeKHR              present_mode;
+    std::vector<vk::PresentModeKHR> supported_present_modes;
+
+    // headless apps get plain images in place of a Vulkan swap chain. they are handed out in turn
+    // and can be copied back to the host
+    std::vector<std::unique_ptr<image>> offscreen_images;
+    uint32_t                            next_offscreen_image;
+
+    inline bool offscreen() const { return !offscreen_images.empty(); }
 
     /*std::unique_ptr<image> depth_buf;
     vk::UniqueImageView depth_view;*/
@@ -22,12 +47,14 @@ struct swap_chain {
         vk::RenderPass                                           rnp,
         std::function<void(size_t, std::vector<vk::ImageView>&)> additional_image_views
         = [](auto, auto) {},
-        bool include_depth = true
+        bool include_depth            = true,
+        bool include_swap_chain_image = true
     );
 
-    swap_chain(app* app, device* dev);
+    swap_chain(app* app, device* dev, present_options options = {});
     ~swap_chain();
 
   private:
     void create(app* app);
+    void create_offscreen(app* app);
 };
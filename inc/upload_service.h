@@ -0,0 +1,99 @@
+#pragma once
+#include "cmmn.h"
+#include "device.h"
+#include <deque>
+
+// host visible staging memory, valid until the batch it was allocated in has completed
+struct staging_allocation {
+    vk::Buffer     buf;
+    vk::DeviceSize offset;
+    void*          mapped;
+};
+
+// batches copies into device local buffers and images. copies are recorded on the transfer queue,
+// then ownership moves to the graphics queue, where mip chains are generated. each submitted
+// batch signals a value on a timeline semaphore; a resource can be used once `is_complete`
+// returns true for the value that was pending when it was uploaded
+class upload_service {
+    device*               dev;
+    vk::UniqueCommandPool transfer_cmdpool;
+    vk::UniqueSemaphore   timeline;
+    uint64_t              last_value;
+    // as of the last `collect` or `wait`, so that polling doesn't go to the driver every time
+    uint64_t              last_completed;
+    vk::DeviceSize        copy_alignment;
+    size_t                dedicated_staging_count;
+
+    struct pending_image {
+        std::shared_ptr<image> img;
+        uint32_t               width, height;
+    };
+
+    struct batch {
+        vk::UniqueCommandBuffer              transfer_cb, graphics_cb;
+        std::vector<std::unique_ptr<buffer>> staging;
+        std::vector<vk::BufferMemoryBarrier> buffer_barriers;
+        std::vector<vk::ImageMemoryBarrier>  image_barriers;
+        std::vector<pending_image>           images;
+        vk::PipelineStageFlags               dst_stages;
+        uint64_t                             value;
+    };
+
+    std::optional<batch> current;
+    std::deque<batch>    in_flight;
+
+    // true if the transfer queue belongs to a different family than the graphics queue
+    inline bool dedicated_transfer() const { return dev->qu_fam.transfer != dev->qu_fam.graphics; }
+
+    batch& current_batch();
+
+  public:
+    upload_service(device* dev);
+
+    // suballocates from `dev->staging`. uploads that are too big for the ring, or that don't fit
+    // while it's full, get a dedicated buffer that is freed with the batch
+    staging_allocation stage(vk::DeviceSize size);
+
+    // copy `size` bytes from `src` into `dst`. the copy is made visible to `dst_stage` and
+    // `dst_access` on the graphics queue
+    void copy_to_buffer(
+        const staging_allocation& src,
+        vk::DeviceSize            src_offset,
+        vk::Buffer                dst,
+        vk::DeviceSize            dst_offset,
+        vk::DeviceSize            size,
+        vk::PipelineStageFlags    dst_stage,
+        vk::AccessFlags           dst_access
+    );
+
+    // copy tightly packed texels from `src` into mip level 0 of `img` and generate the rest of its
+    // mip levels. the image ends up in eShaderReadOnlyOptimal
+    void copy_to_image(
+        const staging_allocation& src, const std::shared_ptr<image>& img, uint32_t w, uint32_t h
+    );
+
+    // number of mip levels to create for a texture, 1 if the format can't be blitted
+    uint32_t mip_count(vk::Format fmt, uint32_t w, uint32_t h) const;
+
+    // the timeline value that will be signaled when everything recorded so far is done
+    uint64_t pending_value() const;
+
+    // submit the current batch, if there is one, and return its timeline value
+    uint64_t submit();
+
+    uint64_t completed_value() const;
+
+    inline bool is_complete(uint64_t value) const { return value <= last_completed; }
+
+    void wait(uint64_t value);
+
+    // free the staging memory and command buffers of batches that have completed
+    void collect();
+
+    inline size_t batches_in_flight() const { return in_flight.size(); }
+
+    // number of uploads that didn't fit in the staging ring
+    inline size_t dedicated_staging_buffers() const { return dedicated_staging_count; }
+
+    ~upload_service();
+};
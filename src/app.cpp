@@ -1,4 +1,6 @@
 #include "app.h"
+#include "frame_stats.h"
+#include "profiler.h"
 
 VkResult CreateDebugReportCallbackEXT(
     VkInstance                          instance,
@@ -50,7 +52,7 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
     return VK_FALSE;
 }
 
-app::app(const std::string& title, vec2 winsize) {
+void app::init_window(const std::string& title, vec2 winsize) {
     if(!glfwInit()) throw std::runtime_error("GLFW init failed!");
     glfwSetErrorCallback([](int ec, const char* em) {
         if(ec == 865540) return;  // "invalid scancode"
@@ -111,6 +113,11 @@ app::app(const std::string& title, vec2 winsize) {
             );
         }
     });
+}
+
+app::app(const std::string& title, vec2 winsize, bool headless, present_options present)
+    : headless(headless), offscreen_size(winsize), wnd(nullptr) {
+    if(!headless) init_window(title, winsize);
 
     /* print validation layers
     auto ava_layers = vk::enumerateInstanceLayerProperties();
@@ -125,12 +132,14 @@ app::app(const std::string& title, vec2 winsize) {
         VK_MAKE_VERSION(0, 1, 0),
         "eggv",
         VK_MAKE_VERSION(0, 1, 0),
-        VK_API_VERSION_1_0};
-    icfo.pApplicationInfo     = &app_info;
-    uint         glfw_ext_cnt = 0;
-    const char** glfw_ext;
-    glfw_ext = glfwGetRequiredInstanceExtensions(&glfw_ext_cnt);
-    std::vector<const char*> extentions(glfw_ext, glfw_ext + glfw_ext_cnt);
+        VK_API_VERSION_1_2};
+    icfo.pApplicationInfo = &app_info;
+    std::vector<const char*> extentions;
+    if(!headless) {
+        uint         glfw_ext_cnt = 0;
+        const char** glfw_ext     = glfwGetRequiredInstanceExtensions(&glfw_ext_cnt);
+        extentions.assign(glfw_ext, glfw_ext + glfw_ext_cnt);
+    }
 #ifdef DEBUG
     extentions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
 #endif
@@ -156,12 +165,16 @@ app::app(const std::string& title, vec2 winsize) {
     );
 #endif
 
-    VkSurfaceKHR sf;
-    auto         res = glfwCreateWindowSurface((VkInstance)instance, wnd, nullptr, &sf);
-    surface          = vk::SurfaceKHR(sf);
+    if(!headless) {
+        VkSurfaceKHR sf;
+        auto         res = glfwCreateWindowSurface((VkInstance)instance, wnd, nullptr, &sf);
+        surface          = vk::SurfaceKHR(sf);
+    }
 
     dev       = std::make_unique<device>(this);
-    swapchain = std::make_unique<swap_chain>(this, dev.get());
+    swapchain = std::make_unique<swap_chain>(this, dev.get(), present);
+    frame_fence
+        = dev->dev->createFenceUnique(vk::FenceCreateInfo{vk::FenceCreateFlagBits::eSignaled});
 
     srand(std::chrono::system_clock::now().time_since_epoch().count());
 }
@@ -169,48 +182,109 @@ app::app(const std::string& title, vec2 winsize) {
 void app::run(bool pdfps) {
     tm.reset();
     update(tm.time(), tm.delta_time());
-    while(glfwWindowShouldClose(wnd) == GLFW_FALSE) {
-        tm.update();
-
-        auto image_index = swapchain->aquire_next();
-        if(!image_index.ok()
-           && (image_index.err() == vk::Result::eErrorOutOfDateKHR
-               || image_index.err() == vk::Result::eSuboptimalKHR))
-            resize();
-        auto                   cb = render(tm.time(), tm.delta_time(), image_index.unwrap());
-        vk::PipelineStageFlags wait_stages[] = {vk::PipelineStageFlagBits::eColorAttachmentOutput};
-        vk::SubmitInfo         sfo{
-            1,
-            &swapchain->image_ava_sp.get(),
-            wait_stages,
-            1,
-            &cb,
-            1,
-            &swapchain->render_fin_sp.get()};
-        dev->graphics_qu.submit(sfo, nullptr);
-        swapchain->present(image_index);
-        post_submit(image_index);
-        glfwPollEvents();
-        update(tm.time(), tm.delta_time());
-        dev->present_qu.waitIdle();
-        dev->clear_tmps();
+    while(!should_close()) {
+        {
+            PROFILE_ZONE("frame");
+            tm.update();
+
+            // the previous frame must be done before its command buffer and per-frame data are
+            // reused, and before the acquire semaphore it waited on is signaled again
+            {
+                PROFILE_ZONE("wait for frame fence");
+                dev->dev->waitForFences({frame_fence.get()}, true, UINT64_MAX);
+                dev->dev->resetFences({frame_fence.get()});
+            }
+            dev->clear_tmps();
+            auto image_index = [&] {
+                PROFILE_ZONE("acquire");
+                return swapchain->aquire_next();
+            }();
+            if(!image_index.ok()
+               && (image_index.err() == vk::Result::eErrorOutOfDateKHR
+                   || image_index.err() == vk::Result::eSuboptimalKHR))
+                resize();
+            vk::CommandBuffer cb;
+            {
+                PROFILE_ZONE("render");
+                cb = render(tm.time(), tm.delta_time(), image_index.unwrap());
+            }
+            {
+                PROFILE_ZONE("submit and present");
+                vk::PipelineStageFlags wait_stages[]
+                    = {vk::PipelineStageFlagBits::eColorAttachmentOutput};
+                // offscreen images are never acquired or presented, so there is nothing to wait
+                // for or signal
+                vk::SubmitInfo sfo{0, nullptr, nullptr, 1, &cb};
+                if(!headless) {
+                    sfo = vk::SubmitInfo{
+                        1,
+                        &swapchain->image_ava_sp.get(),
+                        wait_stages,
+                        1,
+                        &cb,
+                        1,
+                        &swapchain->render_fin_sps[image_index.unwrap()].get()};
+                }
+                dev->graphics_qu.submit(sfo, frame_fence.get());
+                swapchain->present(image_index);
+                post_submit(image_index);
+            }
+            {
+                PROFILE_ZONE("poll events");
+                if(!headless) glfwPollEvents();
+            }
+            update(tm.time(), tm.delta_time());
+            {
+                PROFILE_ZONE("frame limiter");
+                limiter.wait();
+            }
+        }
+        profiler::end_frame();
+        frame_stats::record_frame_time(tm.delta_time() * 1000.f);
+        frame_stats::end_frame();
     }
+    // write out a capture that was still running when the window closed
+    profiler::finish_capture();
+    frame_stats::end_csv();
     dev->graphics_qu.waitIdle();
     dev->present_qu.waitIdle();
     std::cout << "quit\n";
 }
 
+void frame_limiter::wait() {
+    using clock = std::chrono::steady_clock;
+    auto now    = clock::now();
+    if(max_fps <= 0.f) {
+        next_frame = now;
+        return;
+    }
+    next_frame += std::chrono::duration_cast<clock::duration>(
+        std::chrono::duration<double>(1.0 / (double)max_fps)
+    );
+    // a frame that ran late doesn't make the next ones hurry to catch up
+    if(next_frame <= now) {
+        next_frame = now;
+        return;
+    }
+    const auto spin_time = std::chrono::milliseconds(2);
+    if(next_frame - now > spin_time) std::this_thread::sleep_for(next_frame - now - spin_time);
+    while(clock::now() < next_frame)
+        std::this_thread::yield();
+}
+
 app::~app() {
     dev->graphics_qu.waitIdle();
     dev->present_qu.waitIdle();
     dev->clear_tmps();
+    frame_fence.reset();
     swapchain.reset();
     dev.reset();
-    vkDestroySurfaceKHR((VkInstance)instance, (VkSurfaceKHR)surface, nullptr);
+    if(!headless) vkDestroySurfaceKHR((VkInstance)instance, (VkSurfaceKHR)surface, nullptr);
 #ifdef DEBUG
     DestroyDebugReportCallbackEXT((VkInstance)instance, report_callback, nullptr);
 #endif
     instance.destroy();
+    if(headless) return;
     glfwDestroyWindow(wnd);
     glfwTerminate();
 }
@@ -171,7 +171,7 @@ void bundle::build_gui(frame_state& fs) {
         }
         ImGui::Separator();
         if(selected_material != nullptr)
-            materials_changed = selected_material->build_gui(fs) || materials_changed;
+            selected_material->build_gui(fs);
         ImGui::End();
     }
 }
@@ -231,5 +231,6 @@ bool material::build_gui(frame_state& fs) {
         ImGui::EndCombo();
     }
 
+    _dirty = _dirty || changed;
     return changed;
 }
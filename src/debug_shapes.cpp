@@ -1,4 +1,5 @@
 #include "debug_shapes.h"
+#include "frame_stats.h"
 #include "imgui.h"
 
 std::vector<vec3> generate_box_frame_and_axis_vertices() {
@@ -156,7 +157,7 @@ void debug_shape_render_node_prototype::generate_pipelines(
         &multisample_state,
         &depth_stencil_state,
         &color_blending_state,
-        nullptr,
+        &viewport_dynamic_state,
         this->pipeline_layout.get(),
         render_pass,
         subpass
@@ -181,6 +182,9 @@ void debug_shape_render_node_prototype::generate_command_buffer_inline(
     );
     cb.bindVertexBuffers(0, {frame_axis_mesh.vertex_buffer->buf}, {0});
     cb.bindIndexBuffer(frame_axis_mesh.index_buffer->buf, 0, vk::IndexType::eUint16);
+    frame_stats::add(frame_counter::pipeline_binds);
+    frame_stats::add(frame_counter::descriptor_binds);
+    frame_stats::add(frame_counter::buffer_binds, 2);
     auto* cur_world = r->current_world();
     for(const auto& [_, sys] : *cur_world) {
         sys->generate_viewport_shapes(
@@ -197,10 +201,14 @@ void debug_shape_render_node_prototype::generate_command_buffer_inline(
                     sizeof(mat4),
                     {shape.color}
                 );
-                if(shape.type == viewport_shape_type::box)
+                // both are line lists, so count them as no triangles
+                if(shape.type == viewport_shape_type::box) {
                     cb.drawIndexed(24, 1, 0, 0, 0);
-                else if(shape.type == viewport_shape_type::axis)
+                    frame_stats::add_draw(0);
+                } else if(shape.type == viewport_shape_type::axis) {
                     cb.drawIndexed(6, 1, 24, 8, 0);
+                    frame_stats::add_draw(0);
+                }
             },
             fs
         );
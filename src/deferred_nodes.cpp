@@ -1,37 +1,75 @@
 #include "deferred_nodes.h"
+#include "frame_stats.h"
 #include "glm/gtx/component_wise.hpp"
+#include "occlusion.h"
 #include "scene_components.h"
 
 // --- geometery buffer
 
-gbuffer_geom_render_node_prototype::gbuffer_geom_render_node_prototype(device* dev, renderer* r) {
-    inputs  = {};
-    outputs = {
+gbuffer_geom_render_node_prototype::gbuffer_geom_render_node_prototype(
+    device* dev, renderer* r, gbuffer_layout layout
+)
+    : layout(layout) {
+    bool compact   = layout == gbuffer_layout::compact;
+    auto geo_format = compact ? vk::Format::eR32G32B32A32Uint : vk::Format::eR32G32B32A32Sfloat;
+    // the second occlusion phase draws on top of the first phase's buffers. its occlusion input
+    // isn't read, it only makes sure the node runs after the cull node
+    inputs = {
+        framebuffer_desc{
+                         "geometery",
+                         geo_format, framebuffer_type::color,
+                         framebuffer_mode::blend_input,
+                         compact ? 1u : 3u},
+        framebuffer_desc{
+                         "depth", vk::Format::eUndefined,
+                         framebuffer_type::depth,
+                         framebuffer_mode::blend_input},
         framebuffer_desc{
-                         "geometery", vk::Format::eR32G32B32A32Sfloat,
+                         "occlusion", vk::Format::eR32Sfloat,
                          framebuffer_type::color,
+                         framebuffer_mode::shader_input}
+    };
+    outputs = {
+        framebuffer_desc{
+                         "geometery",
+                         geo_format, framebuffer_type::color,
                          framebuffer_mode::output,
-                         3},
+                         compact ? 1u : 3u},
         framebuffer_desc{
                          "depth", vk::Format::eUndefined, framebuffer_type::depth, framebuffer_mode::output}
     };
 
-    desc_layout = dev->create_desc_set_layout({vk::DescriptorSetLayoutBinding(
-        0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex
-    )});
+    desc_layout = dev->create_desc_set_layout(
+        {vk::DescriptorSetLayoutBinding(
+             0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex
+         ),
+         vk::DescriptorSetLayoutBinding(
+             1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eFragment
+         ),
+         // the occlusion cull node's objects, for indirect draws
+         vk::DescriptorSetLayoutBinding(
+             2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eVertex
+         )}
+    );
 
     vk::PushConstantRange push_consts[] = {
         vk::PushConstantRange{vk::ShaderStageFlagBits::eVertex,   0,            sizeof(mat4)  },
         vk::PushConstantRange{vk::ShaderStageFlagBits::eFragment, sizeof(mat4), sizeof(uint32)}
     };
 
-    vk::DescriptorSetLayout desc_layouts[] = {desc_layout.get(), r->material_desc_set_layout.get()};
+    vk::DescriptorSetLayout desc_layouts[] = {desc_layout.get(), r->texture_desc_set_layout.get()};
 
     pipeline_layout = dev->dev->createPipelineLayoutUnique(vk::PipelineLayoutCreateInfo{
         {}, 2, desc_layouts, 2, push_consts});
 }
 
-void gbuffer_geom_render_node_prototype::build_gui(class renderer*, struct render_node* node) {}
+void gbuffer_geom_render_node_prototype::build_gui(class renderer*, struct render_node* node) {
+    auto phase = ((node_data*)node->data.get())->phase;
+    if(phase == occlusion_phase::first)
+        ImGui::Text("first occlusion phase");
+    else if(phase == occlusion_phase::second)
+        ImGui::Text("second occlusion phase");
+}
 
 void gbuffer_geom_render_node_prototype::collect_descriptor_layouts(
     render_node*                           node,
@@ -40,6 +78,7 @@ void gbuffer_geom_render_node_prototype::collect_descriptor_layouts(
     std::vector<vk::UniqueDescriptorSet*>& outputs
 ) {
     pool_sizes.emplace_back(vk::DescriptorType::eUniformBuffer, 1);
+    pool_sizes.emplace_back(vk::DescriptorType::eStorageBuffer, 2);
     layouts.push_back(desc_layout.get());
     outputs.push_back(&node->desc_set);
 }
@@ -62,19 +101,76 @@ void gbuffer_geom_render_node_prototype::update_descriptor_sets(
             r->global_buffers[GLOBAL_BUF_FRAME_UNIFORMS]->buf, 0, sizeof(frame_uniforms)
         ))
     );
+    if(r->global_buffers[GLOBAL_BUF_MATERIALS])
+        writes.emplace_back(
+            node->desc_set.get(),
+            1,
+            0,
+            1,
+            vk::DescriptorType::eStorageBuffer,
+            nullptr,
+            buf_infos.alloc(vk::DescriptorBufferInfo(
+                r->global_buffers[GLOBAL_BUF_MATERIALS]->buf,
+                0,
+                r->num_gpu_mats * sizeof(gpu_material)
+            ))
+        );
+    auto objects = r->global_buffers.find(GLOBAL_BUF_CULL_OBJECTS);
+    if(objects != r->global_buffers.end() && objects->second != nullptr)
+        writes.emplace_back(
+            node->desc_set.get(),
+            2,
+            0,
+            1,
+            vk::DescriptorType::eStorageBuffer,
+            nullptr,
+            buf_infos.alloc(vk::DescriptorBufferInfo(objects->second->buf, 0, VK_WHOLE_SIZE))
+        );
+}
+
+// the second phase is connected to the cull node's output, the first phase feeds its depth input
+static void find_occlusion_phase(renderer* r, render_node* node) {
+    auto* data   = (gbuffer_geom_render_node_prototype::node_data*)node->data.get();
+    data->phase  = occlusion_phase::none;
+    data->culler = nullptr;
+    auto occ     = node->input_node(2);
+    if(occ != nullptr && occ->prototype->id() == hiz_cull_prototype_id) {
+        data->phase  = occlusion_phase::second;
+        data->culler = (hiz_cull_render_node_prototype*)occ->prototype.get();
+        return;
+    }
+    for(const auto& n : r->compiled.subpass_order) {
+        if(n->prototype->id() == hiz_cull_prototype_id && n->input_node(0).get() == node) {
+            data->phase  = occlusion_phase::first;
+            data->culler = (hiz_cull_render_node_prototype*)n->prototype.get();
+            return;
+        }
+    }
 }
 
 void gbuffer_geom_render_node_prototype::generate_pipelines(
     renderer* r, render_node* node, vk::RenderPass render_pass, uint32_t subpass
 ) {
+    find_occlusion_phase(r, node);
+    // occlusion culled phases draw indirectly, and find each object's transform and material in
+    // the cull node's object buffer
+    bool        indirect = ((node_data*)node->data.get())->phase != occlusion_phase::none;
+    const char* frag_shader
+        = layout == gbuffer_layout::compact
+              ? (indirect ? "gbuffer-compact-objects.frag.spv" : "gbuffer-compact.frag.spv")
+              : (indirect ? "gbuffer-objects.frag.spv" : "gbuffer.frag.spv");
+    const char* vert_shader = indirect ? "full-objects.vert.spv" : "full.vert.spv";
     vk::PipelineShaderStageCreateInfo shader_stages[] = {
         vk::PipelineShaderStageCreateInfo{
-                                          {}, vk::ShaderStageFlagBits::eVertex, r->dev->load_shader("full.vert.spv"), "main"},
+                                          {},
+                                          vk::ShaderStageFlagBits::eVertex,
+                                          r->dev->load_shader(vert_shader),
+                                          "main"},
         vk::PipelineShaderStageCreateInfo{
                                           {},
                                           vk::ShaderStageFlagBits::eFragment,
-                                          r->dev->load_shader("gbuffer.frag.spv"),
-                                          "main"                                                                            }
+                                          r->dev->load_shader(frag_shader),
+                                          "main"}
     };
 
     auto vertex_binding
@@ -111,12 +207,13 @@ void gbuffer_geom_render_node_prototype::generate_pipelines(
         vk::PipelineColorBlendAttachmentState{},
         vk::PipelineColorBlendAttachmentState{},
     };
-    for(int i = 0; i < 3; ++i)
+    uint32_t num_color_att = layout == gbuffer_layout::compact ? 1 : 3;
+    for(uint32_t i = 0; i < num_color_att; ++i)
         color_blend_att[i].colorWriteMask
             = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG
               | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA;
-    auto color_blending_state
-        = vk::PipelineColorBlendStateCreateInfo{{}, false, vk::LogicOp::eCopy, 3, color_blend_att};
+    auto color_blending_state = vk::PipelineColorBlendStateCreateInfo{
+        {}, false, vk::LogicOp::eCopy, num_color_att, color_blend_att};
 
     auto cfo = vk::GraphicsPipelineCreateInfo(
         {},
@@ -130,7 +227,7 @@ void gbuffer_geom_render_node_prototype::generate_pipelines(
         &multisample_state,
         &depth_stencil_state,
         &color_blending_state,
-        nullptr,
+        &viewport_dynamic_state,
         this->pipeline_layout.get(),
         render_pass,
         subpass
@@ -147,21 +244,42 @@ void gbuffer_geom_render_node_prototype::generate_command_buffer_inline(
     const frame_state&  fs
 ) {
     cb.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline(node));
+    frame_stats::add(frame_counter::pipeline_binds);
+    frame_stats::add(frame_counter::descriptor_binds);
     cb.bindDescriptorSets(
-        vk::PipelineBindPoint::eGraphics, this->pipeline_layout.get(), 0, {node->desc_set.get()}, {}
+        vk::PipelineBindPoint::eGraphics,
+        this->pipeline_layout.get(),
+        0,
+        {node->desc_set.get(), r->texture_desc_set},
+        {}
     );
 
+    const buffer* bound = nullptr;
+    auto*         data  = (node_data*)node->data.get();
+    if(data->phase != occlusion_phase::none) {
+        // draws are counted by the cull node, since only it knows how many there are
+        if(data->phase == occlusion_phase::first) data->culler->prepare(r);
+        bool second   = data->phase == occlusion_phase::second;
+        auto commands = r->global_buffers[GLOBAL_BUF_CULL_COMMANDS]->buf;
+        auto counts   = r->global_buffers[GLOBAL_BUF_CULL_COUNTS]->buf;
+        for(size_t b = 0; b < data->culler->batches.size(); ++b) {
+            const auto& batch = data->culler->batches[b];
+            batch.m->bind(cb, &bound);
+            cb.drawIndexedIndirectCount(
+                commands,
+                data->culler->command_offset(b, second),
+                counts,
+                data->culler->count_offset(b, second),
+                batch.count,
+                sizeof(vk::DrawIndexedIndirectCommand)
+            );
+        }
+        return;
+    }
+
     r->for_each_renderable([&](auto entity_id, auto mesh, auto transform) {
-        cb.bindDescriptorSets(
-            vk::PipelineBindPoint::eGraphics,
-            this->pipeline_layout.get(),
-            1,
-            {mesh.mat->desc_set},
-            {}
-        );
         auto m = mesh.m;
-        cb.bindVertexBuffers(0, {m->vertex_buffer->buf}, {0});
-        cb.bindIndexBuffer(m->index_buffer->buf, 0, vk::IndexType::eUint16);
+        m->bind(cb, &bound);
         cb.pushConstants<mat4>(
             this->pipeline_layout.get(), vk::ShaderStageFlagBits::eVertex, 0, {transform.world}
         );
@@ -171,12 +289,66 @@ void gbuffer_geom_render_node_prototype::generate_command_buffer_inline(
             sizeof(mat4),
             {mesh.mat ? mesh.mat->_render_index : 0}
         );
-        cb.drawIndexed(m->index_count, 1, 0, 0, 0);
+        m->draw(cb);
     });
 }
 
+// --- light pass helpers
+
+// true if the geometry input of a light node comes from a compact geometry buffer
+bool uses_compact_gbuffer(render_node* node) {
+    auto geo = node->input_node(1);
+    return geo != nullptr && geo->prototype->id() == gbuffer_compact_prototype_id;
+}
+
+// write the geometry buffer layers to bindings 0.. and the depth buffer to `depth_binding`
+void write_gbuffer_descriptors(
+    renderer*                            r,
+    render_node*                         node,
+    size_t                               depth_input,
+    uint32_t                             depth_binding,
+    std::vector<vk::WriteDescriptorSet>& writes,
+    arena<vk::DescriptorImageInfo>&      img_infos
+) {
+    auto geo = node->input_framebuffer(1);
+    if(geo.has_value() && geo.value() != 0) {
+        const auto& fb = r->buffers[geo.value()];
+        for(uint32_t i = 0; i < fb.num_layers(); ++i) {
+            writes.emplace_back(
+                node->desc_set.get(),
+                i,
+                0,
+                1,
+                vk::DescriptorType::eInputAttachment,
+                img_infos.alloc(vk::DescriptorImageInfo(
+                    nullptr,
+                    fb.is_array() ? fb.image_views[1 + i].get() : fb.image_views[0].get(),
+                    vk::ImageLayout::eShaderReadOnlyOptimal
+                ))
+            );
+        }
+    }
+
+    auto depth = node->input_framebuffer(depth_input);
+    if(depth.has_value() && depth.value() != 0) {
+        writes.emplace_back(
+            node->desc_set.get(),
+            depth_binding,
+            0,
+            1,
+            vk::DescriptorType::eInputAttachment,
+            img_infos.alloc(vk::DescriptorImageInfo(
+                nullptr,
+                r->buffers[depth.value()].image_views[0].get(),
+                vk::ImageLayout::eShaderReadOnlyOptimal
+            ))
+        );
+    }
+}
+
 // --- directional light pass
-directional_light_render_node_prototype::directional_light_render_node_prototype(device* dev) {
+directional_light_render_node_prototype::directional_light_render_node_prototype(device* dev)
+    : mapped_lights(nullptr), light_capacity(0) {
     inputs = {
         framebuffer_desc{
                          "input_color", vk::Format::eR32G32B32A32Sfloat,
@@ -191,6 +363,10 @@ directional_light_render_node_prototype::directional_light_render_node_prototype
                          "shadowmap", vk::Format::eUndefined,
                          framebuffer_type::depth,
                          framebuffer_mode::shader_input},
+        framebuffer_desc{
+                         "depth", vk::Format::eUndefined,
+                         framebuffer_type::depth,
+                         framebuffer_mode::input_attachment},
     };
     outputs = {
         framebuffer_desc{
@@ -217,12 +393,17 @@ directional_light_render_node_prototype::directional_light_render_node_prototype
          ),
          vk::DescriptorSetLayoutBinding(
              5, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment
+         ),
+         vk::DescriptorSetLayoutBinding(
+             6, vk::DescriptorType::eInputAttachment, 1, vk::ShaderStageFlagBits::eFragment
+         ),
+         vk::DescriptorSetLayoutBinding(
+             7, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eFragment
          )}
     );
 
     vk::PushConstantRange push_consts[] = {
-        vk::PushConstantRange{
-                              vk::ShaderStageFlagBits::eFragment, 0, sizeof(vec4) * 2 + sizeof(mat4)}
+        vk::PushConstantRange{vk::ShaderStageFlagBits::eFragment, 0, sizeof(uint32_t)}
     };
 
     pipeline_layout = dev->dev->createPipelineLayoutUnique(vk::PipelineLayoutCreateInfo{
@@ -232,15 +413,39 @@ directional_light_render_node_prototype::directional_light_render_node_prototype
 void directional_light_render_node_prototype::build_gui(class renderer*, struct render_node* node) {
 }
 
+size_t directional_light_render_node_prototype::subpass_repeat_count(
+    renderer* r, render_node* node
+) {
+    auto*  cur_world  = r->current_world();
+    auto   lights     = cur_world->system<light_system>();
+    size_t num_lights = 0;
+    for(auto lighti = lights->begin_components(); lighti != lights->end_components(); ++lighti) {
+        auto& [id, light] = *lighti;
+        if(light.type == light_type::directional) num_lights++;
+    }
+
+    light_capacity = std::max(light_capacity, std::max<size_t>(8, num_lights * 2));
+    r->global_buffers[GLOBAL_BUF_DIRECTIONAL_LIGHTS] = std::make_unique<buffer>(
+        r->dev,
+        sizeof(gpu_directional_light) * light_capacity,
+        vk::BufferUsageFlagBits::eStorageBuffer,
+        vk::MemoryPropertyFlagBits::eHostCoherent,
+        (void**)&mapped_lights,
+        memory_category::uniform
+    );
+
+    return 1;
+}
+
 void directional_light_render_node_prototype::collect_descriptor_layouts(
     render_node*                           node,
     std::vector<vk::DescriptorPoolSize>&   pool_sizes,
     std::vector<vk::DescriptorSetLayout>&  layouts,
     std::vector<vk::UniqueDescriptorSet*>& outputs
 ) {
-    pool_sizes.emplace_back(vk::DescriptorType::eInputAttachment, 3);
+    pool_sizes.emplace_back(vk::DescriptorType::eInputAttachment, 4);
     pool_sizes.emplace_back(vk::DescriptorType::eUniformBuffer, 1);
-    pool_sizes.emplace_back(vk::DescriptorType::eStorageBuffer, 1);
+    pool_sizes.emplace_back(vk::DescriptorType::eStorageBuffer, 2);
     pool_sizes.emplace_back(vk::DescriptorType::eCombinedImageSampler, 1);
     layouts.push_back(desc_layout.get());
     outputs.push_back(&node->desc_set);
@@ -253,20 +458,7 @@ void directional_light_render_node_prototype::update_descriptor_sets(
     arena<vk::DescriptorBufferInfo>&     buf_infos,
     arena<vk::DescriptorImageInfo>&      img_infos
 ) {
-    for(int i = 0; i < 3; ++i) {
-        writes.emplace_back(
-            node->desc_set.get(),
-            i,
-            0,
-            1,
-            vk::DescriptorType::eInputAttachment,
-            img_infos.alloc(vk::DescriptorImageInfo(
-                nullptr,
-                r->buffers[node->input_framebuffer(1).value()].image_views[1 + i].get(),
-                vk::ImageLayout::eShaderReadOnlyOptimal
-            ))
-        );
-    }
+    write_gbuffer_descriptors(r, node, 3, 6, writes, img_infos);
 
     if(node->input_framebuffer(2).has_value() && node->input_framebuffer(2).value() != 0) {
         writes.emplace_back(
@@ -308,6 +500,20 @@ void directional_light_render_node_prototype::update_descriptor_sets(
                 r->num_gpu_mats * sizeof(gpu_material)
             ))
         );
+    if(r->global_buffers[GLOBAL_BUF_DIRECTIONAL_LIGHTS])
+        writes.emplace_back(
+            node->desc_set.get(),
+            7,
+            0,
+            1,
+            vk::DescriptorType::eStorageBuffer,
+            nullptr,
+            buf_infos.alloc(vk::DescriptorBufferInfo(
+                r->global_buffers[GLOBAL_BUF_DIRECTIONAL_LIGHTS]->buf,
+                0,
+                light_capacity * sizeof(gpu_directional_light)
+            ))
+        );
 }
 
 void directional_light_render_node_prototype::generate_pipelines(
@@ -322,7 +528,11 @@ void directional_light_render_node_prototype::generate_pipelines(
         vk::PipelineShaderStageCreateInfo{
                                           {},
                                           vk::ShaderStageFlagBits::eFragment,
-                                          r->dev->load_shader("directional-light.frag.spv"),
+                                          r->dev->load_shader(
+                                              uses_compact_gbuffer(node)
+                                                  ? "directional-light-compact.frag.spv"
+                                                  : "directional-light.frag.spv"
+                                          ),
                                           "main"}
     };
 
@@ -379,7 +589,7 @@ void directional_light_render_node_prototype::generate_pipelines(
         &multisample_state,
         &depth_stencil_state,
         &color_blending_state,
-        nullptr,
+        &viewport_dynamic_state,
         this->pipeline_layout.get(),
         render_pass,
         subpass
@@ -419,10 +629,6 @@ void directional_light_render_node_prototype::generate_command_buffer_inline(
         });
     }*/
 
-    cb.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline(node));
-    cb.bindDescriptorSets(
-        vk::PipelineBindPoint::eGraphics, this->pipeline_layout.get(), 0, {node->desc_set.get()}, {}
-    );
     bool has_shadowmap = false;
     mat4 light_proj, inverse_view;
     if(shadowmap_node_proto != nullptr) {
@@ -462,36 +668,39 @@ void directional_light_render_node_prototype::generate_command_buffer_inline(
     auto* cur_world = r->current_world();
     auto  lights    = cur_world->system<light_system>();
 
+    // collect every light into the light buffer so they can all be shaded in one pass
+    uint32_t num_lights = 0;
     for(auto lighti = lights->begin_components(); lighti != lights->end_components(); ++lighti) {
         const auto& [id, light] = *lighti;
         if(light.type != light_type::directional) continue;
-        int light_index = -1;
-        if(has_shadowmap) light_index = light._render_index;
-        cb.pushConstants<vec4>(
-            this->pipeline_layout.get(),
-            vk::ShaderStageFlagBits::eFragment,
-            0,
-            {r->mapped_frame_uniforms->view * vec4(light.param, 0.f), vec4(light.color, 0.f)}
-        );
-        cb.pushConstants<int>(
-            this->pipeline_layout.get(),
-            vk::ShaderStageFlagBits::eFragment,
-            sizeof(vec4) + sizeof(vec3),
-            {light_index}
-        );
+        if(num_lights == light_capacity) {
+            // grow the buffer at the next recompile
+            r->should_recompile = true;
+            break;
+        }
+        auto& gl        = mapped_lights[num_lights++];
+        gl.direction    = r->mapped_frame_uniforms->view * vec4(light.param, 0.f);
+        gl.color        = light.color;
+        gl.shadow_index = has_shadowmap ? (int32_t)light._render_index : -1;
         if(has_shadowmap) {
-            mat4 light_viewproj = light_proj
-                                  * glm::lookAt(-light.param, vec3(0.f), vec3(0.f, -1.f, 0.f))
-                                  * inverse_view;
-            cb.pushConstants<mat4>(
-                this->pipeline_layout.get(),
-                vk::ShaderStageFlagBits::eFragment,
-                sizeof(vec4) * 2,
-                {light_viewproj}
-            );
+            gl.shadow_viewproj = light_proj
+                                 * glm::lookAt(-light.param, vec3(0.f), vec3(0.f, -1.f, 0.f))
+                                 * inverse_view;
         }
-        cb.draw(3, 1, 0, 0);
     }
+    if(num_lights == 0) return;
+
+    cb.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline(node));
+    frame_stats::add(frame_counter::pipeline_binds);
+    frame_stats::add(frame_counter::descriptor_binds);
+    cb.bindDescriptorSets(
+        vk::PipelineBindPoint::eGraphics, this->pipeline_layout.get(), 0, {node->desc_set.get()}, {}
+    );
+    cb.pushConstants<uint32_t>(
+        this->pipeline_layout.get(), vk::ShaderStageFlagBits::eFragment, 0, {num_lights}
+    );
+    cb.draw(3, 1, 0, 0);
+    frame_stats::add_draw(1);
 }
 
 directional_light_shadowmap_render_node_prototype::
@@ -571,7 +780,8 @@ size_t directional_light_shadowmap_render_node_prototype::subpass_repeat_count(
         sizeof(mat4) * num_lights,
         vk::BufferUsageFlagBits::eStorageBuffer,
         vk::MemoryPropertyFlagBits::eHostCoherent,
-        (void**)&mapped_light_viewprojs
+        (void**)&mapped_light_viewprojs,
+        memory_category::uniform
     );
 
     return num_lights;
@@ -687,7 +897,7 @@ void directional_light_shadowmap_render_node_prototype::generate_pipelines(
         &multisample_state,
         &depth_stencil_state,
         &color_blending_state,
-        nullptr,
+        &viewport_dynamic_state,
         this->pipeline_layout.get(),
         render_pass
     );
@@ -727,6 +937,8 @@ void directional_light_shadowmap_render_node_prototype::generate_command_buffer_
 
     auto* data = (dir_light_shadowmap_node_data*)node->data.get();
     cb.bindPipeline(vk::PipelineBindPoint::eGraphics, data->pipelines[subpass_index].get());
+    frame_stats::add(frame_counter::pipeline_binds);
+    frame_stats::add(frame_counter::descriptor_binds);
     cb.bindDescriptorSets(
         vk::PipelineBindPoint::eGraphics, this->pipeline_layout.get(), 0, {node->desc_set.get()}, {}
     );
@@ -736,21 +948,22 @@ void directional_light_shadowmap_render_node_prototype::generate_command_buffer_
         sizeof(mat4),
         {(uint32)subpass_index}
     );
+    const buffer* bound = nullptr;
     r->for_each_renderable([&](auto entity_id, auto mesh, auto transform) {
         auto m = mesh.m;
-        cb.bindVertexBuffers(0, {m->vertex_buffer->buf}, {0});
-        cb.bindIndexBuffer(m->index_buffer->buf, 0, vk::IndexType::eUint16);
+        m->bind(cb, &bound);
         cb.pushConstants<mat4>(
             this->pipeline_layout.get(), vk::ShaderStageFlagBits::eVertex, 0, {transform.world}
         );
-        cb.drawIndexed(m->index_count, 1, 0, 0, 0);
+        m->draw(cb);
     });
 }
 
 // --- point light pass
 #include "mesh_gen.h"
 
-point_light_render_node_prototype::point_light_render_node_prototype(device* dev) {
+point_light_render_node_prototype::point_light_render_node_prototype(device* dev)
+    : mapped_volumes(nullptr), volume_capacity(0), num_visible_lights(0) {
     inputs = {
         framebuffer_desc{
                          "input_color", vk::Format::eR32G32B32A32Sfloat,
@@ -761,6 +974,10 @@ point_light_render_node_prototype::point_light_render_node_prototype(device* dev
                          framebuffer_type::color,
                          framebuffer_mode::input_attachment,
                          3},
+        framebuffer_desc{
+                         "depth", vk::Format::eUndefined,
+                         framebuffer_type::depth,
+                         framebuffer_mode::input_attachment},
     };
     outputs = {
         framebuffer_desc{
@@ -787,21 +1004,50 @@ point_light_render_node_prototype::point_light_render_node_prototype(device* dev
          ),
          vk::DescriptorSetLayoutBinding(
              4, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eFragment
+         ),
+         vk::DescriptorSetLayoutBinding(
+             5, vk::DescriptorType::eInputAttachment, 1, vk::ShaderStageFlagBits::eFragment
+         ),
+         vk::DescriptorSetLayoutBinding(
+             6,
+             vk::DescriptorType::eStorageBuffer,
+             1,
+             vk::ShaderStageFlagBits::eFragment | vk::ShaderStageFlagBits::eVertex
          )}
     );
 
-    vk::PushConstantRange push_consts[] = {
-        vk::PushConstantRange{vk::ShaderStageFlagBits::eVertex,   0,            sizeof(mat4)    },
-        vk::PushConstantRange{vk::ShaderStageFlagBits::eFragment, sizeof(mat4), sizeof(vec4) * 3}
-    };
-
     pipeline_layout = dev->dev->createPipelineLayoutUnique(vk::PipelineLayoutCreateInfo{
-        {}, 1, &desc_layout.get(), 2, push_consts});
+        {}, 1, &desc_layout.get(), 0, nullptr});
 
     sphere_mesh = std::make_unique<mesh>(mesh_gen::generate_sphere(dev, 16, 16));
 }
 
-void point_light_render_node_prototype::build_gui(class renderer*, struct render_node* node) {}
+void point_light_render_node_prototype::build_gui(class renderer*, struct render_node* node) {
+    ImGui::Text("%zu visible lights", num_visible_lights);
+}
+
+size_t point_light_render_node_prototype::subpass_repeat_count(renderer* r, render_node* node) {
+    auto*  cur_world  = r->current_world();
+    auto   lights     = cur_world->system<light_system>();
+    size_t num_lights = 0;
+    for(auto lighti = lights->begin_components(); lighti != lights->end_components(); ++lighti) {
+        auto& [id, light] = *lighti;
+        if(light.type == light_type::point) num_lights++;
+    }
+
+    // leave room to grow so that adding a few lights doesn't cause a recompile every time
+    volume_capacity = std::max(volume_capacity, std::max<size_t>(64, num_lights * 2));
+    r->global_buffers[GLOBAL_BUF_POINT_LIGHT_VOLUMES] = std::make_unique<buffer>(
+        r->dev,
+        sizeof(gpu_point_light_volume) * volume_capacity,
+        vk::BufferUsageFlagBits::eStorageBuffer,
+        vk::MemoryPropertyFlagBits::eHostCoherent,
+        (void**)&mapped_volumes,
+        memory_category::uniform
+    );
+
+    return 1;
+}
 
 void point_light_render_node_prototype::collect_descriptor_layouts(
     render_node*                           node,
@@ -809,9 +1055,9 @@ void point_light_render_node_prototype::collect_descriptor_layouts(
     std::vector<vk::DescriptorSetLayout>&  layouts,
     std::vector<vk::UniqueDescriptorSet*>& outputs
 ) {
-    pool_sizes.emplace_back(vk::DescriptorType::eInputAttachment, 3);
+    pool_sizes.emplace_back(vk::DescriptorType::eInputAttachment, 4);
     pool_sizes.emplace_back(vk::DescriptorType::eUniformBuffer, 1);
-    pool_sizes.emplace_back(vk::DescriptorType::eStorageBuffer, 1);
+    pool_sizes.emplace_back(vk::DescriptorType::eStorageBuffer, 2);
     layouts.push_back(desc_layout.get());
     outputs.push_back(&node->desc_set);
 }
@@ -823,20 +1069,7 @@ void point_light_render_node_prototype::update_descriptor_sets(
     arena<vk::DescriptorBufferInfo>&     buf_infos,
     arena<vk::DescriptorImageInfo>&      img_infos
 ) {
-    for(int i = 0; i < 3; ++i) {
-        writes.emplace_back(
-            node->desc_set.get(),
-            i,
-            0,
-            1,
-            vk::DescriptorType::eInputAttachment,
-            img_infos.alloc(vk::DescriptorImageInfo(
-                nullptr,
-                r->buffers[node->input_framebuffer(1).value()].image_views[i + 1].get(),
-                vk::ImageLayout::eShaderReadOnlyOptimal
-            ))
-        );
-    }
+    write_gbuffer_descriptors(r, node, 2, 5, writes, img_infos);
 
     writes.emplace_back(
         node->desc_set.get(),
@@ -863,6 +1096,20 @@ void point_light_render_node_prototype::update_descriptor_sets(
                 r->num_gpu_mats * sizeof(gpu_material)
             ))
         );
+    if(r->global_buffers[GLOBAL_BUF_POINT_LIGHT_VOLUMES])
+        writes.emplace_back(
+            node->desc_set.get(),
+            6,
+            0,
+            1,
+            vk::DescriptorType::eStorageBuffer,
+            nullptr,
+            buf_infos.alloc(vk::DescriptorBufferInfo(
+                r->global_buffers[GLOBAL_BUF_POINT_LIGHT_VOLUMES]->buf,
+                0,
+                volume_capacity * sizeof(gpu_point_light_volume)
+            ))
+        );
 }
 
 void point_light_render_node_prototype::generate_pipelines(
@@ -877,7 +1124,11 @@ void point_light_render_node_prototype::generate_pipelines(
         vk::PipelineShaderStageCreateInfo{
                                           {},
                                           vk::ShaderStageFlagBits::eFragment,
-                                          r->dev->load_shader("point-light.frag.spv"),
+                                          r->dev->load_shader(
+                                              uses_compact_gbuffer(node)
+                                                  ? "point-light-compact.frag.spv"
+                                                  : "point-light.frag.spv"
+                                          ),
                                           "main"}
     };
 
@@ -937,7 +1188,7 @@ void point_light_render_node_prototype::generate_pipelines(
         &multisample_state,
         &depth_stencil_state,
         &color_blending_state,
-        nullptr,
+        &viewport_dynamic_state,
         this->pipeline_layout.get(),
         render_pass,
         subpass
@@ -951,6 +1202,16 @@ float light_radius(const light& light) {
     return sqrt(-5.f + 256.f * i) / sqrt(5.f * light.param.x);
 }
 
+bool sphere_in_frustum(const mat4& proj, vec3 view_pos, float radius) {
+    // frustum planes in view space, taken from the rows of the projection matrix
+    mat4 P = transpose(proj);
+    vec4 planes[] = {P[3] + P[0], P[3] - P[0], P[3] + P[1], P[3] - P[1], P[2], P[3] - P[2]};
+    for(const auto& plane : planes) {
+        if(dot(vec3(plane), view_pos) + plane.w < -radius * length(vec3(plane))) return false;
+    }
+    return true;
+}
+
 void point_light_render_node_prototype::generate_command_buffer_inline(
     renderer*           r,
     struct render_node* node,
@@ -958,34 +1219,425 @@ void point_light_render_node_prototype::generate_command_buffer_inline(
     size_t              subpass_index,
     const frame_state&  fs
 ) {
+    auto* cur_world  = r->current_world();
+    auto  lights     = cur_world->system<light_system>();
+    auto  transforms = cur_world->system<transform_system>();
+
+    // cull and pack every point light into the volume buffer, then draw them all at once
+    uint32_t num_volumes = 0;
+    num_visible_lights   = 0;
+    for(auto lighti = lights->begin_components(); lighti != lights->end_components(); ++lighti) {
+        auto& [id, light] = *lighti;
+        if(light.type != light_type::point) continue;
+        const auto& T              = transforms->get_data_for_entity(id).world;
+        vec4        light_view_pos = r->mapped_frame_uniforms->view * T * vec4(0.f, 0.f, 0.f, 1.f);
+        float       radius         = light_radius(light);
+        if(!sphere_in_frustum(r->mapped_frame_uniforms->proj, light_view_pos.xyz(), radius)) {
+            frame_stats::add(frame_counter::culled_objects);
+            continue;
+        }
+        num_visible_lights++;
+        if(num_volumes == volume_capacity) {
+            // grow the buffer at the next recompile
+            r->should_recompile = true;
+            continue;
+        }
+        mapped_volumes[num_volumes++] = gpu_point_light_volume{
+            scale(T, vec3(radius)),
+            vec4(light.param.x, radius, 0.f, 0.f),
+            vec4(light.color, 0.f),
+            light_view_pos};
+    }
+    if(num_volumes == 0) return;
+
     cb.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline(node));
+    frame_stats::add(frame_counter::pipeline_binds);
+    frame_stats::add(frame_counter::descriptor_binds);
     cb.bindDescriptorSets(
         vk::PipelineBindPoint::eGraphics, this->pipeline_layout.get(), 0, {node->desc_set.get()}, {}
     );
     cb.bindVertexBuffers(0, {sphere_mesh->vertex_buffer->buf}, {0});
     cb.bindIndexBuffer(sphere_mesh->index_buffer->buf, 0, vk::IndexType::eUint16);
+    frame_stats::add(frame_counter::buffer_binds, 2);
+    cb.drawIndexed(sphere_mesh->index_count, num_volumes, 0, 0, 0);
+    frame_stats::add_draw(sphere_mesh->index_count / 3, num_volumes);
+}
+
+// --- clustered point lights
+clustered_point_light_render_node_prototype::clustered_point_light_render_node_prototype(
+    device* dev
+)
+    : mapped_lights(nullptr), mapped_clusters(nullptr), mapped_light_indices(nullptr),
+      light_capacity(0), index_capacity(0), grid_size(16, 9, 24), num_visible_lights(0),
+      num_light_indices(0), overflowed(false) {
+    inputs = {
+        framebuffer_desc{
+                         "input_color", vk::Format::eR32G32B32A32Sfloat,
+                         framebuffer_type::color,
+                         framebuffer_mode::blend_input},
+        framebuffer_desc{
+                         "geometry", vk::Format::eR32G32B32A32Sfloat,
+                         framebuffer_type::color,
+                         framebuffer_mode::input_attachment,
+                         3},
+        framebuffer_desc{
+                         "depth", vk::Format::eUndefined,
+                         framebuffer_type::depth,
+                         framebuffer_mode::input_attachment},
+    };
+    outputs = {
+        framebuffer_desc{
+                         "color", vk::Format::eR32G32B32A32Sfloat,
+                         framebuffer_type::color,
+                         framebuffer_mode::output},
+    };
+
+    std::vector<vk::DescriptorSetLayoutBinding> bindings;
+    for(uint32_t i = 0; i < 3; ++i)
+        bindings.emplace_back(
+            i, vk::DescriptorType::eInputAttachment, 1, vk::ShaderStageFlagBits::eFragment
+        );
+    bindings.emplace_back(
+        3, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eFragment
+    );
+    // materials, lights, clusters, light indices
+    for(uint32_t i = 4; i < 8; ++i)
+        bindings.emplace_back(
+            i, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eFragment
+        );
+    bindings.emplace_back(
+        8, vk::DescriptorType::eInputAttachment, 1, vk::ShaderStageFlagBits::eFragment
+    );
+    desc_layout = dev->create_desc_set_layout(bindings);
+
+    vk::PushConstantRange push_consts[] = {
+        vk::PushConstantRange{vk::ShaderStageFlagBits::eFragment, 0, sizeof(uvec4) + sizeof(vec4)}
+    };
+
+    pipeline_layout = dev->dev->createPipelineLayoutUnique(vk::PipelineLayoutCreateInfo{
+        {}, 1, &desc_layout.get(), 1, push_consts});
+}
+
+void clustered_point_light_render_node_prototype::build_gui(
+    class renderer* r, struct render_node* node
+) {
+    ImGui::Text("%zu visible lights, %zu light indices", num_visible_lights, num_light_indices);
+    if(overflowed) ImGui::Text("light buffers are full, growing at next recompile");
+}
+
+size_t clustered_point_light_render_node_prototype::subpass_repeat_count(
+    renderer* r, render_node* node
+) {
+    auto*  cur_world  = r->current_world();
+    auto   lights     = cur_world->system<light_system>();
+    size_t num_lights = 0;
+    for(auto lighti = lights->begin_components(); lighti != lights->end_components(); ++lighti) {
+        auto& [id, light] = *lighti;
+        if(light.type == light_type::point) num_lights++;
+    }
+
+    // leave room to grow so that adding a few lights doesn't cause a recompile every time
+    size_t num_clusters = grid_size.x * grid_size.y * grid_size.z;
+    light_capacity      = std::max(light_capacity, std::max<size_t>(64, num_lights * 2));
+    index_capacity      = std::max(index_capacity, std::max(num_clusters * 4, light_capacity * 8));
+    if(overflowed) {
+        light_capacity = std::max(light_capacity, num_visible_lights * 2);
+        index_capacity = std::max(index_capacity, num_light_indices * 2);
+        overflowed     = false;
+    }
+
+    r->global_buffers[GLOBAL_BUF_POINT_LIGHTS] = std::make_unique<buffer>(
+        r->dev,
+        sizeof(gpu_point_light) * light_capacity,
+        vk::BufferUsageFlagBits::eStorageBuffer,
+        vk::MemoryPropertyFlagBits::eHostCoherent,
+        (void**)&mapped_lights,
+        memory_category::uniform
+    );
+    r->global_buffers[GLOBAL_BUF_LIGHT_CLUSTERS] = std::make_unique<buffer>(
+        r->dev,
+        sizeof(uvec2) * num_clusters,
+        vk::BufferUsageFlagBits::eStorageBuffer,
+        vk::MemoryPropertyFlagBits::eHostCoherent,
+        (void**)&mapped_clusters,
+        memory_category::uniform
+    );
+    r->global_buffers[GLOBAL_BUF_LIGHT_INDICES] = std::make_unique<buffer>(
+        r->dev,
+        sizeof(uint32_t) * index_capacity,
+        vk::BufferUsageFlagBits::eStorageBuffer,
+        vk::MemoryPropertyFlagBits::eHostCoherent,
+        (void**)&mapped_light_indices,
+        memory_category::uniform
+    );
+
+    return 1;
+}
+
+void clustered_point_light_render_node_prototype::collect_descriptor_layouts(
+    render_node*                           node,
+    std::vector<vk::DescriptorPoolSize>&   pool_sizes,
+    std::vector<vk::DescriptorSetLayout>&  layouts,
+    std::vector<vk::UniqueDescriptorSet*>& outputs
+) {
+    pool_sizes.emplace_back(vk::DescriptorType::eInputAttachment, 4);
+    pool_sizes.emplace_back(vk::DescriptorType::eUniformBuffer, 1);
+    pool_sizes.emplace_back(vk::DescriptorType::eStorageBuffer, 4);
+    layouts.push_back(desc_layout.get());
+    outputs.push_back(&node->desc_set);
+}
+
+void clustered_point_light_render_node_prototype::update_descriptor_sets(
+    class renderer*                      r,
+    struct render_node*                  node,
+    std::vector<vk::WriteDescriptorSet>& writes,
+    arena<vk::DescriptorBufferInfo>&     buf_infos,
+    arena<vk::DescriptorImageInfo>&      img_infos
+) {
+    write_gbuffer_descriptors(r, node, 2, 8, writes, img_infos);
+
+    writes.emplace_back(
+        node->desc_set.get(),
+        3,
+        0,
+        1,
+        vk::DescriptorType::eUniformBuffer,
+        nullptr,
+        buf_infos.alloc(vk::DescriptorBufferInfo(
+            r->global_buffers[GLOBAL_BUF_FRAME_UNIFORMS]->buf, 0, sizeof(frame_uniforms)
+        ))
+    );
+
+    std::pair<size_t, vk::DeviceSize> storage_buffers[] = {
+        {GLOBAL_BUF_MATERIALS, r->num_gpu_mats * sizeof(gpu_material)},
+        {GLOBAL_BUF_POINT_LIGHTS, light_capacity * sizeof(gpu_point_light)},
+        {GLOBAL_BUF_LIGHT_CLUSTERS, grid_size.x * grid_size.y * grid_size.z * sizeof(uvec2)},
+        {GLOBAL_BUF_LIGHT_INDICES, index_capacity * sizeof(uint32_t)},
+    };
+    for(uint32_t i = 0; i < 4; ++i) {
+        const auto& [buf_id, size] = storage_buffers[i];
+        if(!r->global_buffers[buf_id]) continue;
+        writes.emplace_back(
+            node->desc_set.get(),
+            4 + i,
+            0,
+            1,
+            vk::DescriptorType::eStorageBuffer,
+            nullptr,
+            buf_infos.alloc(vk::DescriptorBufferInfo(r->global_buffers[buf_id]->buf, 0, size))
+        );
+    }
+}
+
+void clustered_point_light_render_node_prototype::generate_pipelines(
+    renderer* r, render_node* node, vk::RenderPass render_pass, uint32_t subpass
+) {
+    vk::PipelineShaderStageCreateInfo shader_stages[] = {
+        vk::PipelineShaderStageCreateInfo{
+                                          {},
+                                          vk::ShaderStageFlagBits::eVertex,
+                                          r->dev->load_shader("entire-screen.vert.spv"),
+                                          "main"},
+        vk::PipelineShaderStageCreateInfo{
+                                          {},
+                                          vk::ShaderStageFlagBits::eFragment,
+                                          r->dev->load_shader(
+                                              uses_compact_gbuffer(node)
+                                                  ? "clustered-light-compact.frag.spv"
+                                                  : "clustered-light.frag.spv"
+                                          ),
+                                          "main"}
+    };
+
+    auto vertex_input_info = vk::PipelineVertexInputStateCreateInfo{};
+
+    auto input_assembly
+        = vk::PipelineInputAssemblyStateCreateInfo{{}, vk::PrimitiveTopology::eTriangleList};
+
+    auto viewport_state
+        = vk::PipelineViewportStateCreateInfo{{}, 1, &r->full_viewport, 1, &r->full_scissor};
+
+    auto rasterizer_state = vk::PipelineRasterizationStateCreateInfo{
+        {},
+        false,
+        false,
+        vk::PolygonMode::eFill,
+        vk::CullModeFlagBits::eNone,
+        vk::FrontFace::eCounterClockwise,
+        false,
+        0.f,
+        0.f,
+        0.f,
+        1.f};
+
+    auto multisample_state = vk::PipelineMultisampleStateCreateInfo{};
+
+    auto depth_stencil_state = vk::PipelineDepthStencilStateCreateInfo{
+        {}, false, false, vk::CompareOp::eLess, false, false};
+
+    vk::PipelineColorBlendAttachmentState color_blend_att[]
+        = {vk::PipelineColorBlendAttachmentState(
+            true,
+            vk::BlendFactor::eSrcAlpha,
+            vk::BlendFactor::eSrcAlpha,
+            vk::BlendOp::eAdd,
+            vk::BlendFactor::eOne,
+            vk::BlendFactor::eOne,
+            vk::BlendOp::eAdd,
+            vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG
+                | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA
+        )};
+    auto color_blending_state
+        = vk::PipelineColorBlendStateCreateInfo{{}, false, vk::LogicOp::eCopy, 1, color_blend_att};
+
+    auto cfo = vk::GraphicsPipelineCreateInfo(
+        {},
+        2,
+        shader_stages,
+        &vertex_input_info,
+        &input_assembly,
+        nullptr,
+        &viewport_state,
+        &rasterizer_state,
+        &multisample_state,
+        &depth_stencil_state,
+        &color_blending_state,
+        &viewport_dynamic_state,
+        this->pipeline_layout.get(),
+        render_pass,
+        subpass
+    );
+
+    this->create_pipeline(r, node, cfo);
+}
+
+vec4 clustered_point_light_render_node_prototype::bin_lights(renderer* r) {
+    const auto& view = r->mapped_frame_uniforms->view;
+    const auto& proj = r->mapped_frame_uniforms->proj;
+    size_t      num_clusters = grid_size.x * grid_size.y * grid_size.z;
+    std::fill(mapped_clusters, mapped_clusters + num_clusters, uvec2(0));
+    light_cluster_ranges.clear();
+    num_visible_lights = 0;
+    num_light_indices  = 0;
+    if(proj[3][2] == 0.f) return vec4(0.f);  // no camera yet
+
+    // recover the clip planes from the projection matrix, assuming a zero to one depth range
+    float z_near = proj[3][2] / proj[2][2], z_far = proj[3][2] / (proj[2][2] + 1.f);
+    float slice_scale = (float)grid_size.z / log(z_far / z_near);
+    float slice_bias  = -log(z_near) * slice_scale;
+    auto  slice       = [&](float z) {
+        return (uint32_t)clamp(
+            floor(log(z) * slice_scale + slice_bias), 0.f, (float)grid_size.z - 1.f
+        );
+    };
+    auto tile = [&](vec2 ndc) {
+        return uvec2(clamp(
+            floor((ndc * 0.5f + 0.5f) * vec2(grid_size.xy())), vec2(0.f), vec2(grid_size.xy()) - 1.f
+        ));
+    };
 
     auto* cur_world  = r->current_world();
     auto  lights     = cur_world->system<light_system>();
     auto  transforms = cur_world->system<transform_system>();
 
+    // first find the visible lights and count how many lights land in each cluster
+    size_t used_indices = 0;
     for(auto lighti = lights->begin_components(); lighti != lights->end_components(); ++lighti) {
         auto& [id, light] = *lighti;
         if(light.type != light_type::point) continue;
-        const auto& T              = transforms->get_data_for_entity(id).world;
-        vec4        light_view_pos = r->mapped_frame_uniforms->view * T * vec4(0.f, 0.f, 0.f, 1.f);
-        cb.pushConstants<mat4>(
-            this->pipeline_layout.get(),
-            vk::ShaderStageFlagBits::eVertex,
-            0,
-            {scale(T, vec3(light_radius(light)))}
-        );
-        cb.pushConstants<vec4>(
-            this->pipeline_layout.get(),
-            vk::ShaderStageFlagBits::eFragment,
-            sizeof(mat4),
-            {vec4(light.param, 0.f), vec4(light.color, 0.f), light_view_pos}
-        );
-        cb.drawIndexed(sphere_mesh->index_count, 1, 0, 0, 0);
+        vec3  p = view * transforms->get_data_for_entity(id).world * vec4(0.f, 0.f, 0.f, 1.f);
+        float radius = light_radius(light);
+        // the camera looks down -z
+        float zmin = -p.z - radius, zmax = -p.z + radius;
+        if(zmax < z_near || zmin > z_far) {
+            frame_stats::add(frame_counter::culled_objects);
+            continue;
+        }
+
+        vec2 lo(-1.f), hi(1.f);
+        if(zmin > z_near) {
+            // screen space bounds of the light's view space bounding box
+            lo = vec2(std::numeric_limits<float>::max());
+            hi = -lo;
+            for(int c = 0; c < 8; ++c) {
+                vec3 corner
+                    = p + radius * vec3(c & 1 ? 1.f : -1.f, c & 2 ? 1.f : -1.f, c & 4 ? 1.f : -1.f);
+                vec4 clip = proj * vec4(corner, 1.f);
+                lo          = min(lo, clip.xy() / clip.w);
+                hi          = max(hi, clip.xy() / clip.w);
+            }
+            if(any(greaterThan(lo, vec2(1.f))) || any(lessThan(hi, vec2(-1.f)))) continue;
+        }
+
+        uvec3 cmin(tile(lo), slice(std::max(zmin, z_near)));
+        uvec3 cmax(tile(hi), slice(std::min(zmax, z_far)));
+        uint32_t count = (cmax.x - cmin.x + 1) * (cmax.y - cmin.y + 1) * (cmax.z - cmin.z + 1);
+        num_visible_lights++;
+        num_light_indices += count;
+        if(light_cluster_ranges.size() == light_capacity || used_indices + count > index_capacity) {
+            // drop the light for this frame and grow the buffers at the next recompile
+            overflowed          = true;
+            r->should_recompile = true;
+            continue;
+        }
+        used_indices += count;
+
+        mapped_lights[light_cluster_ranges.size()]
+            = gpu_point_light{vec4(p, radius), vec4(light.color, light.param.x)};
+        light_cluster_ranges.emplace_back(cmin, cmax);
+        for(uint32_t z = cmin.z; z <= cmax.z; ++z)
+            for(uint32_t y = cmin.y; y <= cmax.y; ++y)
+                for(uint32_t x = cmin.x; x <= cmax.x; ++x)
+                    mapped_clusters[x + grid_size.x * (y + grid_size.y * z)].y++;
+    }
+
+    // then hand out ranges of the light index buffer and fill them in
+    uint32_t offset = 0;
+    for(size_t i = 0; i < num_clusters; ++i) {
+        mapped_clusters[i].x = offset;
+        offset += mapped_clusters[i].y;
+        mapped_clusters[i].y = 0;
     }
+    for(uint32_t li = 0; li < light_cluster_ranges.size(); ++li) {
+        const auto& [cmin, cmax] = light_cluster_ranges[li];
+        for(uint32_t z = cmin.z; z <= cmax.z; ++z)
+            for(uint32_t y = cmin.y; y <= cmax.y; ++y)
+                for(uint32_t x = cmin.x; x <= cmax.x; ++x) {
+                    auto& cluster = mapped_clusters[x + grid_size.x * (y + grid_size.y * z)];
+                    mapped_light_indices[cluster.x + cluster.y++] = li;
+                }
+    }
+
+    return vec4(slice_scale, slice_bias, z_near, z_far);
+}
+
+void clustered_point_light_render_node_prototype::generate_command_buffer_inline(
+    renderer*           r,
+    struct render_node* node,
+    vk::CommandBuffer&  cb,
+    size_t              subpass_index,
+    const frame_state&  fs
+) {
+    vec4 slice_params = bin_lights(r);
+
+    cb.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline(node));
+    frame_stats::add(frame_counter::pipeline_binds);
+    frame_stats::add(frame_counter::descriptor_binds);
+    cb.bindDescriptorSets(
+        vk::PipelineBindPoint::eGraphics, this->pipeline_layout.get(), 0, {node->desc_set.get()}, {}
+    );
+    cb.pushConstants<uvec4>(
+        this->pipeline_layout.get(),
+        vk::ShaderStageFlagBits::eFragment,
+        0,
+        {uvec4(grid_size, 0)}
+    );
+    cb.pushConstants<vec4>(
+        this->pipeline_layout.get(),
+        vk::ShaderStageFlagBits::eFragment,
+        sizeof(uvec4),
+        {slice_params}
+    );
+    cb.draw(3, 1, 0, 0);
+    frame_stats::add_draw(1);
 }
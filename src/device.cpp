@@ -1,5 +1,7 @@
 #include "device.h"
+#include "frame_stats.h"
 #include "app.h"
+#include "upload_service.h"
 #include <set>
 
 #define VMA_IMPLEMENTATION
@@ -11,12 +13,26 @@ device::device(app* app) {
     pdevice            = devices[0];
     auto pdevice_props = pdevice.getProperties();
     std::cout << "Physical Device: " << pdevice_props.deviceName << std::endl;
+    // discrete GPUs can also have a small mappable device local heap, so only count devices that
+    // actually share memory with the host
+    unified_memory = false;
+    if(pdevice_props.deviceType == vk::PhysicalDeviceType::eIntegratedGpu
+       || pdevice_props.deviceType == vk::PhysicalDeviceType::eCpu) {
+        auto mem_props = pdevice.getMemoryProperties();
+        auto uma_flags = vk::MemoryPropertyFlagBits::eDeviceLocal
+                         | vk::MemoryPropertyFlagBits::eHostVisible
+                         | vk::MemoryPropertyFlagBits::eHostCoherent;
+        for(uint32_t i = 0; i < mem_props.memoryTypeCount; ++i)
+            if((mem_props.memoryTypes[i].propertyFlags & uma_flags) == uma_flags)
+                unified_memory = true;
+    }
+    if(unified_memory) std::cout << "using unified memory\n";
     qu_fam = queue_families(pdevice, app);
     assert(qu_fam.complete());
 
     vk::DeviceCreateInfo                   dcfo;
     std::vector<vk::DeviceQueueCreateInfo> qu_cfo;
-    auto  unique_qufam = std::set<int>{qu_fam.graphics, qu_fam.present};
+    auto  unique_qufam = std::set<int>{qu_fam.graphics, qu_fam.present, qu_fam.transfer};
     float fp           = 1.f;
     for(int qf : unique_qufam) {
         qu_cfo.push_back(vk::DeviceQueueCreateInfo{
@@ -31,7 +47,22 @@ device::device(app* app) {
     devfeat.tessellationShader                     = VK_TRUE;
     devfeat.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
     devfeat.depthBiasClamp                         = VK_TRUE;
+    // GPU driven draws for occlusion culling, which index their objects with firstInstance
+    devfeat.multiDrawIndirect                      = VK_TRUE;
+    devfeat.drawIndirectFirstInstance              = VK_TRUE;
+    devfeat.shaderStorageImageArrayDynamicIndexing = VK_TRUE;
     dcfo.pEnabledFeatures                          = &devfeat;
+    // descriptor indexing for the bindless texture array
+    vk::PhysicalDeviceVulkan12Features devfeat12;
+    devfeat12.descriptorIndexing                           = VK_TRUE;
+    devfeat12.runtimeDescriptorArray                       = VK_TRUE;
+    devfeat12.shaderSampledImageArrayNonUniformIndexing    = VK_TRUE;
+    devfeat12.descriptorBindingPartiallyBound              = VK_TRUE;
+    devfeat12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    // upload completion is tracked with a timeline semaphore
+    devfeat12.timelineSemaphore                            = VK_TRUE;
+    devfeat12.drawIndirectCount                            = VK_TRUE;
+    dcfo.pNext                                             = &devfeat12;
     std::vector<const char*> layer_names{
 #ifdef _DEBUG
         "VK_LAYER_LUNARG_standard_validation",
@@ -42,6 +73,12 @@ device::device(app* app) {
     std::vector<const char*> ext = {
         VK_KHR_SWAPCHAIN_EXTENSION_NAME,
     };
+    // lets VMA report real heap budgets instead of estimating them
+    memory_budget_supported = false;
+    for(const auto& e : pdevice.enumerateDeviceExtensionProperties())
+        if(strcmp(e.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0)
+            memory_budget_supported = true;
+    if(memory_budget_supported) ext.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
     dcfo.enabledExtensionCount   = (uint32_t)ext.size();
     dcfo.ppEnabledExtensionNames = ext.data();
     try {
@@ -56,6 +93,7 @@ device::device(app* app) {
 
     graphics_qu = dev->getQueue(qu_fam.graphics, 0);
     present_qu  = dev->getQueue(qu_fam.present, 0);
+    transfer_qu = dev->getQueue(qu_fam.transfer, 0);
 
     cmdpool = dev->createCommandPoolUnique(vk::CommandPoolCreateInfo{
         vk::CommandPoolCreateFlagBits::eResetCommandBuffer, (uint32_t)qu_fam.graphics});
@@ -64,7 +102,14 @@ device::device(app* app) {
     cfo.instance               = (VkInstance)app->instance;
     cfo.physicalDevice         = (VkPhysicalDevice)pdevice;
     cfo.device                 = (VkDevice)dev.get();
+    cfo.vulkanApiVersion       = VK_API_VERSION_1_2;
+    if(memory_budget_supported) cfo.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
     vmaCreateAllocator(&cfo, &allocator);
+    category_bytes.fill(0);
+    category_allocations.fill(0);
+
+    staging = std::make_unique<staging_ring>(this, staging_ring_size);
+    uploads = std::make_unique<upload_service>(this);
 }
 
 std::vector<vk::UniqueCommandBuffer> device::alloc_cmd_buffers(
@@ -86,7 +131,45 @@ vk::CommandBuffer device::alloc_tmp_cmd_buffer(vk::CommandBufferLevel lvl) {
 
 void device::clear_tmps() {
     if(!tmp_cmd_buffers.empty()) tmp_cmd_buffers.clear();
-    if(!tmp_upload_buffers.empty()) tmp_upload_buffers.clear();
+}
+
+void device::track_allocation(memory_category c, vk::DeviceSize size, bool freed) {
+    if(freed) {
+        category_bytes[(size_t)c] -= size;
+        category_allocations[(size_t)c]--;
+    } else {
+        category_bytes[(size_t)c] += size;
+        category_allocations[(size_t)c]++;
+        frame_stats::add(frame_counter::allocations);
+    }
+}
+
+std::vector<memory_heap_stats> device::heap_stats() const {
+    auto mem_props = pdevice.getMemoryProperties();
+    std::vector<VmaBudget> budgets(mem_props.memoryHeapCount);
+    vmaGetHeapBudgets(allocator, budgets.data());
+    std::vector<memory_heap_stats> stats;
+    for(uint32_t i = 0; i < mem_props.memoryHeapCount; ++i) {
+        stats.push_back(memory_heap_stats{
+            (bool)(mem_props.memoryHeaps[i].flags & vk::MemoryHeapFlagBits::eDeviceLocal),
+            budgets[i].usage,
+            budgets[i].budget,
+            budgets[i].statistics.blockBytes,
+            budgets[i].statistics.allocationBytes});
+    }
+    return stats;
+}
+
+const char* memory_category_name(memory_category c) {
+    switch(c) {
+        case memory_category::framebuffer: return "framebuffer";
+        case memory_category::mesh: return "mesh";
+        case memory_category::texture: return "texture";
+        case memory_category::uniform: return "uniform";
+        case memory_category::staging: return "staging";
+        case memory_category::other: return "other";
+    }
+    return "?";
 }
 
 vk::UniqueDescriptorSetLayout device::create_desc_set_layout(
@@ -122,9 +205,18 @@ vk::UniquePipeline device::create_graphics_pipeline(const vk::GraphicsPipelineCr
     return std::move(res.value);
 }
 
+vk::UniquePipeline device::create_compute_pipeline(const vk::ComputePipelineCreateInfo& cfo) {
+    auto res = dev->createComputePipelineUnique(nullptr, cfo);
+    if(res.result != vk::Result::eSuccess) throw res;
+    return std::move(res.value);
+}
+
 device::~device() {
+    uploads.reset();
+    staging.reset();
     graphics_qu.waitIdle();
     present_qu.waitIdle();
+    transfer_qu.waitIdle();
     for(auto& s : shader_module_cache)
         s.second.reset();
     vmaDestroyAllocator(allocator);
@@ -134,11 +226,19 @@ device::~device() {
 
 device::queue_families::queue_families(vk::PhysicalDevice pd, app* app) {
     auto qufams = pd.getQueueFamilyProperties();
-    for(uint32_t i = 0; i < qufams.size() && !complete(); ++i) {
+    for(uint32_t i = 0; i < qufams.size(); ++i) {
         if(qufams[i].queueCount <= 0) continue;
-        if(qufams[i].queueFlags & vk::QueueFlagBits::eGraphics) graphics = i;
-        if(pd.getSurfaceSupportKHR(i, app->surface)) present = i;
+        auto flags = qufams[i].queueFlags;
+        if(graphics < 0 && flags & vk::QueueFlagBits::eGraphics) graphics = i;
+        if(present < 0 && !app->headless && pd.getSurfaceSupportKHR(i, app->surface)) present = i;
+        // transfer only families are usually backed by a DMA engine that runs alongside graphics
+        if(transfer < 0 && flags & vk::QueueFlagBits::eTransfer
+           && !(flags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute)))
+            transfer = i;
     }
+    if(transfer < 0) transfer = graphics;
+    // nothing is presented without a surface, the present queue is only ever waited on
+    if(app->headless) present = graphics;
 }
 
 static uint64 counter = 1;
@@ -148,9 +248,10 @@ buffer::buffer(
     vk::DeviceSize          size,
     vk::BufferUsageFlags    bufuse,
     vk::MemoryPropertyFlags memuse,
-    void**                  persistent_map
+    void**                  persistent_map,
+    memory_category         category
 )
-    : dev(dev) {
+    : dev(dev), category(category) {
     VmaAllocationCreateInfo mreq = {};
     mreq.flags                   = persistent_map ? VMA_ALLOCATION_CREATE_MAPPED_BIT : 0;
     mreq.requiredFlags           = (VkMemoryPropertyFlags)memuse;
@@ -164,7 +265,9 @@ buffer::buffer(
         std::cerr << "failed to create buffer " << res << "\n";
         assert(res == VK_SUCCESS);
     }
-    id = counter++;
+    id         = counter++;
+    this->size = alli.size;
+    dev->track_allocation(category, this->size, false);
 #ifdef BUFFER_ALLOC_RELEASE_DEBUG
     std::cout << "buffer #" << id << "!" << size << "\n";
 #endif
@@ -182,6 +285,7 @@ void buffer::unmap() { vmaUnmapMemory(dev->allocator, alloc); }
 /*buffer& buffer::operator=(const buffer&& b) {
     if (buf != VK_NULL_HANDLE) {
         vmaDestroyBuffer(dev->allocator, buf, alloc);
+    dev->track_allocation(category, size, true);
     }
     dev = b.dev;
     buf = b.buf;
@@ -192,12 +296,60 @@ void buffer::unmap() { vmaUnmapMemory(dev->allocator, alloc); }
 buffer::~buffer() {
     if(buf == VK_NULL_HANDLE) return;
     vmaDestroyBuffer(dev->allocator, buf, alloc);
+    dev->track_allocation(category, size, true);
 #ifdef BUFFER_ALLOC_RELEASE_DEBUG
     std::cout << "~buffer #" << this->id << "\n";
 #endif
     buf = VK_NULL_HANDLE;
 }
 
+staging_ring::staging_ring(device* dev, vk::DeviceSize capacity)
+    : capacity(capacity), head(0), tail(0), used(0), pending(0) {
+    buf = std::make_unique<buffer>(
+        dev,
+        capacity,
+        vk::BufferUsageFlagBits::eTransferSrc,
+        vk::MemoryPropertyFlagBits::eHostCoherent,
+        (void**)&mapped,
+        memory_category::staging
+    );
+}
+
+std::optional<vk::DeviceSize> staging_ring::allocate(
+    vk::DeviceSize size, vk::DeviceSize alignment
+) {
+    auto offset = (head + alignment - 1) / alignment * alignment;
+    auto waste  = offset - head;
+    // allocations never straddle the end of the ring, skip to the start instead
+    if(offset + size > capacity) {
+        offset = 0;
+        waste  = capacity - head;
+    }
+    // `used` counts everything from the tail around to the head, so this also keeps a wrapped
+    // allocation from running into the tail
+    if(used + waste + size > capacity) return {};
+    head = offset + size;
+    used += waste + size;
+    pending += waste + size;
+    return offset;
+}
+
+void staging_ring::retire(uint64_t value) {
+    if(pending == 0) return;
+    regions.push_back(region{head, pending, value});
+    pending = 0;
+}
+
+void staging_ring::reclaim(uint64_t completed_value) {
+    while(!regions.empty() && regions.front().value <= completed_value) {
+        tail = regions.front().end;
+        used -= regions.front().bytes;
+        regions.pop_front();
+    }
+    // start over at the beginning when idle so that big allocations don't have to wrap
+    if(used == 0) head = tail = 0;
+}
+
 image::image(
     device*                             dev,
     vk::ImageCreateFlags                flg,
@@ -211,9 +363,10 @@ image::image(
     uint32_t                            array_layers,
     std::optional<vk::UniqueImageView*> iv,
     vk::ImageViewType                   iv_type,
-    vk::ImageSubresourceRange           iv_sr
+    vk::ImageSubresourceRange           iv_sr,
+    memory_category                     category
 )
-    : dev(dev) {
+    : dev(dev), category(category) {
     VmaAllocationCreateInfo mreq = {};
     mreq.requiredFlags           = (VkMemoryPropertyFlags)memuse;
     VmaAllocationInfo alli;
@@ -222,6 +375,8 @@ image::image(
     info     = ico;
     auto res = vmaCreateImage(dev->allocator, (VkImageCreateInfo*)&ico, &mreq, &img, &alloc, &alli);
     assert(res == VK_SUCCESS);
+    this->size = alli.size;
+    dev->track_allocation(category, this->size, false);
     if(iv) {
         **iv = dev->dev->createImageViewUnique(vk::ImageViewCreateInfo(
             vk::ImageViewCreateFlags(), vk::Image(img), iv_type, fmt, vk::ComponentMapping(), iv_sr
@@ -234,7 +389,8 @@ void image::generate_mipmaps(
 ) {
     auto subresrange
         = vk::ImageSubresourceRange{vk::ImageAspectFlagBits::eColor, 0, 1, 0, layer_count};
-    // transition the biggest mipmap (the loaded src image) so that it can be copied from
+    // transition the biggest mipmap (the loaded src image) so that it can be copied from. it must
+    // have just been written by a copy, so keep its contents
     cb.pipelineBarrier(
         vk::PipelineStageFlagBits::eTransfer,
         vk::PipelineStageFlagBits::eTransfer,
@@ -243,9 +399,9 @@ void image::generate_mipmaps(
     },
         {},
         {vk::ImageMemoryBarrier{
-            vk::AccessFlags(),
+            vk::AccessFlagBits::eTransferWrite,
             vk::AccessFlagBits::eTransferRead,
-            vk::ImageLayout::eUndefined,
+            vk::ImageLayout::eTransferDstOptimal,
             vk::ImageLayout::eTransferSrcOptimal,
             VK_QUEUE_FAMILY_IGNORED,
             VK_QUEUE_FAMILY_IGNORED,
@@ -364,4 +520,7 @@ void image::generate_mipmaps(
     }
 }
 
-image::~image() { vmaDestroyImage(dev->allocator, img, alloc); }
+image::~image() {
+    vmaDestroyImage(dev->allocator, img, alloc);
+    dev->track_allocation(category, size, true);
+}
@@ -1,6 +1,7 @@
 #include "ecs.h"
 #include "imgui.h"
 #include "imgui_stdlib.h"
+#include "profiler.h"
 
 world::world()
     : next_id(root_id + 1), root_entity(std::make_shared<world::node>(nullptr, root_id, "Root")) {
@@ -21,6 +22,7 @@ entity world::get(entity_id id) { return entity{this, nodes[id]}; }
 entity world::root() { return entity{this, root_entity}; }
 
 void world::update(const frame_state& fs) {
+    PROFILE_ZONE("world update");
     // remove any dead entities
     while(!dead_entities.empty()) {
         auto ent  = dead_entities.extract(dead_entities.begin()).value();
@@ -39,8 +41,10 @@ void world::update(const frame_state& fs) {
     }
 
     // update all systems
-    for(const auto& [_, sys] : systems)
+    for(const auto& [_, sys] : systems) {
+        PROFILE_ZONE(sys->name());
         sys->update(fs);
+    }
 }
 
 void world::build_scene_tree_gui(frame_state& fs, entity& e) {
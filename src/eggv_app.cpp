@@ -1,5 +1,6 @@
 #include "eggv_app.h"
 #include "deferred_nodes.h"
+#include "frame_stats.h"
 #include "geometry_set.h"
 #include "glm/gtx/quaternion.hpp"
 #include "imgui.h"
@@ -7,7 +8,10 @@
 #include "imgui_impl_vulkan.h"
 #include "imnodes.h"
 #include "mesh_gen.h"
+#include "occlusion.h"
+#include "profiler.h"
 #include "scene_components.h"
+#include "stb_image_write.h"
 #include "uuid.h"
 #include "vk_mem_alloc.h"
 
@@ -28,6 +32,9 @@ struct script_repl_window_t {
                     if(ImGui::MenuItem("Collect Garbage")) {
                         emlisp::heap_info ifo;
                         rt->collect_garbage(&ifo);
+                        frame_stats::add(
+                            frame_counter::script_gc_bytes, ifo.old_size - ifo.new_size
+                        );
                         std::ostringstream oss;
                         oss << "garbage collected " << (ifo.old_size - ifo.new_size) << " bytes";
                         lines.emplace_back(oss.str());
@@ -55,6 +62,7 @@ struct script_repl_window_t {
             if(ImGui::InputText("##input", input, 256, ImGuiInputTextFlags_EnterReturnsTrue)) {
                 std::ostringstream oss;
                 try {
+                    PROFILE_ZONE("script eval");
                     auto inp = rt->read(input);
                     auto res = rt->eval(inp);
                     rt->write(oss, inp) << "\n\t= ";
@@ -80,15 +88,61 @@ struct script_repl_window_t {
     }
 };
 
-eggv_cmdline_args::eggv_cmdline_args(int argc, const char* argv[]) : resolution(1920, 1080) {
+eggv_cmdline_args::eggv_cmdline_args(int argc, const char* argv[])
+    : resolution(1920, 1080), profile_frames(0), headless(false), headless_frames(100),
+      timings_path("eggv-timings.json"), target_gpu_ms(0.f), max_fps(0.f) {
     for(int i = 1; i < argc; ++i) {
-        if(argv[i][0] == '-') {
+        if(argv[i][0] == '-' && argv[i][1] == '-') {
+            std::string_view opt = argv[i] + 2;
+            if(opt == "headless") {
+                headless = true;
+            } else if(opt == "frames") {
+                headless_frames = std::atoi(argv[++i]);
+            } else if(opt == "size") {
+                uint32_t w, h;
+                if(sscanf(argv[++i], "%ux%u", &w, &h) != 2)
+                    throw std::runtime_error(std::string("expected WxH: ") + argv[i]);
+                this->resolution = vec2(w, h);
+            } else if(opt == "timings") {
+                timings_path = argv[++i];
+            } else if(opt == "png") {
+                screenshot_path = argv[++i];
+            } else if(opt == "dynamic-resolution") {
+                target_gpu_ms = std::atof(argv[++i]);
+            } else if(opt == "stats-csv") {
+                stats_csv_path = argv[++i];
+            } else if(opt == "stress-scene") {
+                stress_scene = stress_scene_desc::parse(argv[++i]);
+            } else if(opt == "present-mode") {
+                std::string_view mode = argv[++i];
+                if(mode == "fifo")
+                    present.mode = vk::PresentModeKHR::eFifo;
+                else if(mode == "fifo-relaxed")
+                    present.mode = vk::PresentModeKHR::eFifoRelaxed;
+                else if(mode == "mailbox")
+                    present.mode = vk::PresentModeKHR::eMailbox;
+                else if(mode == "immediate")
+                    present.mode = vk::PresentModeKHR::eImmediate;
+                else
+                    throw std::runtime_error(std::string("unknown present mode: ") + argv[i]);
+            } else if(opt == "swap-images") {
+                present.image_count = std::atoi(argv[++i]);
+            } else if(opt == "max-fps") {
+                max_fps = std::atof(argv[++i]);
+            } else {
+                throw std::runtime_error(std::string("unknown option: ") + argv[i]);
+            }
+        } else if(argv[i][0] == '-') {
             switch(argv[i][1]) {
                 case 'r': {
                     float w          = std::atof(argv[++i]);
                     float h          = std::atof(argv[++i]);
                     this->resolution = vec2(w, h);
                 } break;
+                case 'p': {
+                    this->profile_frames = std::atoi(argv[++i]);
+                    this->profile_path   = argv[++i];
+                } break;
                 default: throw std::runtime_error(std::string("unknown option: ") + argv[i]);
             }
         } else {
@@ -100,12 +154,20 @@ eggv_cmdline_args::eggv_cmdline_args(int argc, const char* argv[]) : resolution(
 }
 
 eggv_app::eggv_app(const eggv_cmdline_args& args)
-    : app("erg", args.resolution), w(std::make_shared<world>()), gui_visible(true),
-      cam_mouse_enabled(false), ui_key_cooldown(0.f), physics_sim_time(0),
+    : app("erg", args.resolution, args.headless, args.present), w(std::make_shared<world>()),
+      gui_visible(!args.headless), cam_mouse_enabled(false), ui_key_cooldown(0.f),
+      physics_sim_time(0), recreate_swap_chain(false),
       script_repl_window(std::make_unique<script_repl_window_t>()),
+      headless_frames(args.headless_frames), frame_cpu_ms(0.f), last_image_index(0),
+      timings_path(args.timings_path), screenshot_path(args.screenshot_path),
       script_runtime(std::make_shared<emlisp::runtime>()) {
-    r = std::make_shared<renderer>(w);
+    limiter.max_fps = args.max_fps;
+    r               = std::make_shared<renderer>(w);
     r->init(dev.get());
+    if(args.target_gpu_ms > 0.f) {
+        r->resolution.enabled           = true;
+        r->resolution.target_frame_time = args.target_gpu_ms;
+    }
 
     std::vector<vk::DescriptorPoolSize> pool_sizes = {
         vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, 256)  // for ImGUI
@@ -118,19 +180,26 @@ eggv_app::eggv_app(const eggv_cmdline_args& args)
         pool_sizes.data()});
 
     this->init_swapchain_depd();
-    this->init_gui();
+    if(!headless) this->init_gui();
 
     phys_world = phys_cmmn.createPhysicsWorld();
 
     r->prototypes.emplace_back(
         std::make_shared<gbuffer_geom_render_node_prototype>(dev.get(), r.get())
     );
+    r->prototypes.emplace_back(std::make_shared<gbuffer_geom_render_node_prototype>(
+        dev.get(), r.get(), gbuffer_layout::compact
+    ));
     r->prototypes.emplace_back(std::make_shared<directional_light_render_node_prototype>(dev.get())
     );
     r->prototypes.emplace_back(
         std::make_shared<directional_light_shadowmap_render_node_prototype>(dev.get())
     );
     r->prototypes.emplace_back(std::make_shared<point_light_render_node_prototype>(dev.get()));
+    r->prototypes.emplace_back(
+        std::make_shared<clustered_point_light_render_node_prototype>(dev.get())
+    );
+    r->prototypes.emplace_back(std::make_shared<hiz_cull_render_node_prototype>(dev.get()));
     r->prototypes.emplace_back(
         std::make_shared<physics_debug_shape_render_node_prototype>(dev.get(), phys_world)
     );
@@ -142,6 +211,7 @@ eggv_app::eggv_app(const eggv_cmdline_args& args)
     w->add_system(std::make_shared<camera_system>(w));
     w->add_system(std::make_shared<light_system>(w));
     w->add_system(r);
+    w->add_system(std::make_shared<stress_motion_system>(w));
 
     // auto thing = w->create_entity("Thing");
     // thing.add_child("thing 1");
@@ -159,23 +229,33 @@ eggv_app::eggv_app(const eggv_cmdline_args& args)
 
     init_script_runtime();
 
-    auto upload_cb = std::move(dev->alloc_cmd_buffers(1)[0]);
-    upload_cb->begin(vk::CommandBufferBeginInfo{vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
-    ImGui_ImplVulkan_CreateFontsTexture(upload_cb.get());
-    upload_cb->end();
-    dev->graphics_qu.submit(
-        {
-            vk::SubmitInfo{0, nullptr, nullptr, 1, &upload_cb.get()}
-    },
-        nullptr
-    );
+    if(args.stress_scene.has_value())
+        generate_stress_scene(w, bndl, dev.get(), args.stress_scene.value());
+
+    vk::UniqueCommandBuffer upload_cb;
+    if(!headless) {
+        upload_cb = std::move(dev->alloc_cmd_buffers(1)[0]);
+        upload_cb->begin(
+            vk::CommandBufferBeginInfo{vk::CommandBufferUsageFlagBits::eOneTimeSubmit}
+        );
+        ImGui_ImplVulkan_CreateFontsTexture(upload_cb.get());
+        upload_cb->end();
+        dev->graphics_qu.submit(
+            {
+                vk::SubmitInfo{0, nullptr, nullptr, 1, &upload_cb.get()}
+        },
+            nullptr
+        );
+    }
 
     fs.gui_open_windows["World"]           = true;
     fs.gui_open_windows["Selected Entity"] = true;
     fs.gui_open_windows["Script Console"]  = true;
 
+    // node prototypes create meshes that are drawn without checking if they are ready
+    dev->uploads->wait(dev->uploads->submit());
     dev->graphics_qu.waitIdle();
-    ImGui_ImplVulkan_DestroyFontUploadObjects();
+    if(!headless) ImGui_ImplVulkan_DestroyFontUploadObjects();
     dev->clear_tmps();
 }
 
@@ -281,11 +361,18 @@ void eggv_app::init_gui() {
 }
 
 void eggv_app::resize() {
+    PROFILE_ZONE("resize");
     dev->present_qu.waitIdle();
-    command_buffers.clear();
     framebuffers.clear();
+    // waits for the device to be idle
     swapchain->recreate((app*)this);
-    this->init_swapchain_depd();
+    // the GUI render pass only depends on the swap chain's format, which doesn't change
+    framebuffers = swapchain->create_framebuffers(
+        gui_render_pass.get(), [&](size_t index, std::vector<vk::ImageView>& att) {}, false
+    );
+    r->resize_swapchain_dependencies(swapchain.get());
+    if(command_buffers.size() != swapchain->images.size())
+        command_buffers = dev->alloc_cmd_buffers(swapchain->images.size());
     ImGui_ImplVulkan_SetMinImageCount(swapchain->images.size());
 }
 
@@ -297,6 +384,8 @@ void eggv_app::build_gui() {
             ImGui::EndMenu();
         }
         if(ImGui::MenuItem("Save bundle")) bndl->save();
+        if(ImGui::MenuItem("Capture CPU profile", nullptr, false, !profiler::is_capturing()))
+            profiler::begin_capture("eggv-profile.json", 120);
         ImGui::EndPopup();
     }
     if(fs.gui_open_windows["ImGui Demo"])
@@ -306,19 +395,95 @@ void eggv_app::build_gui() {
     w->build_gui(fs);
     bndl->build_gui(fs);
     script_repl_window->build_gui(script_runtime.get(), &fs.gui_open_windows["Script Console"]);
+    build_frame_pacing_gui();
+}
+
+void eggv_app::build_frame_pacing_gui() {
+    if(!fs.gui_open_windows["Frame Pacing"]) return;
+    if(!ImGui::Begin("Frame Pacing", &fs.gui_open_windows.at("Frame Pacing"))) {
+        ImGui::End();
+        return;
+    }
+
+    // changes take effect by recreating the swap chain, which keeps the compiled render graph. that
+    // can't happen while this frame is being recorded, so it waits for the next update
+    if(ImGui::BeginCombo("Present mode", vk::to_string(swapchain->options.mode).c_str())) {
+        for(auto mode : swapchain->supported_present_modes) {
+            if(ImGui::Selectable(vk::to_string(mode).c_str(), mode == swapchain->options.mode)) {
+                swapchain->options.mode = mode;
+                recreate_swap_chain     = true;
+            }
+        }
+        ImGui::EndCombo();
+    }
+    int image_count = (int)swapchain->options.image_count;
+    if(ImGui::InputInt("Swap chain images (0 for default)", &image_count)) {
+        swapchain->options.image_count = (uint32_t)std::max(image_count, 0);
+        recreate_swap_chain            = true;
+    }
+    ImGui::Text(
+        "presenting with %s, %zu images",
+        vk::to_string(swapchain->present_mode).c_str(),
+        swapchain->images.size()
+    );
+
+    ImGui::Separator();
+    ImGui::DragFloat("Frame limit (0 for none)", &limiter.max_fps, 1.f, 0.f, 1000.f, "%.0f fps");
+
+    ImGui::Separator();
+    ImGui::Text(
+        "frame time: median %.2fms, 99th percentile %.2fms, max %.2fms",
+        frame_stats::frame_time_percentile(0.5f),
+        frame_stats::frame_time_percentile(0.99f),
+        frame_stats::frame_time_percentile(1.f)
+    );
+    ImGui::PlotHistogram(
+        "##frame_times",
+        frame_stats::frame_time_histogram().data(),
+        (int)frame_stats::frame_time_buckets,
+        0,
+        nullptr,
+        0.f,
+        FLT_MAX,
+        ImVec2(ImGui::GetContentRegionAvail().x, 80.f)
+    );
+    ImGui::Text("0ms");
+    ImGui::SameLine(ImGui::GetContentRegionAvail().x - 40.f);
+    ImGui::Text("%.0fms+", frame_stats::frame_time_max_ms);
+    if(ImGui::Button("Reset")) frame_stats::reset_frame_times();
+    ImGui::End();
+}
+
+static float ms_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start)
+        .count();
 }
 
 void eggv_app::update(float t, float dt) {
+    PROFILE_ZONE("update");
+    auto cpu_start = std::chrono::steady_clock::now();
+    if(recreate_swap_chain) {
+        recreate_swap_chain = false;
+        resize();
+    }
     fs.set_time(t, dt);
     w->update(fs);
     r->update(fs);
 
     physics_sim_time += dt;
     while(physics_sim_time > physics_fixed_time_step) {
+        PROFILE_ZONE("physics step");
         phys_world->update(physics_fixed_time_step);
+        frame_stats::add(frame_counter::physics_bodies, phys_world->getNbRigidBodies());
         physics_sim_time -= physics_fixed_time_step;
     }
 
+    // there is no input without a window
+    if(headless) {
+        frame_cpu_ms += ms_since(cpu_start);
+        return;
+    }
+
     if(ui_key_cooldown <= 0.f) {
         if(glfwGetKey(this->wnd, GLFW_KEY_F2) == GLFW_PRESS) {
             gui_visible     = !gui_visible;
@@ -383,7 +548,8 @@ void eggv_app::update(float t, float dt) {
 }
 
 vk::CommandBuffer eggv_app::render(float t, float dt, uint32_t image_index) {
-    auto& cb = command_buffers[image_index];
+    auto  cpu_start = std::chrono::steady_clock::now();
+    auto& cb        = command_buffers[image_index];
     cb->begin(vk::CommandBufferBeginInfo{vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
 
     fs.set_time(t, dt);
@@ -411,10 +577,150 @@ vk::CommandBuffer eggv_app::render(float t, float dt, uint32_t image_index) {
 
     cb->end();
 
+    frame_cpu_ms += ms_since(cpu_start);
     return cb.get();
 }
 
+void eggv_app::post_submit(uint32_t image_index) {
+    if(!headless) return;
+    last_image_index = image_index;
+    // the renderer read back the previous frame's timestamps when it started recording this one
+    if(!frame_timings.empty()) frame_timings.back().gpu_ms = r->frame_gpu_ms;
+    frame_timings.push_back(frame_timing{
+        tm.delta_time() * 1000.f,
+        frame_cpu_ms,
+        0.f,
+        r->render_viewport.width / r->full_viewport.width});
+    frame_cpu_ms = 0.f;
+}
+
+bool eggv_app::should_close() {
+    if(headless) return frame_timings.size() >= headless_frames;
+    return app::should_close();
+}
+
+void eggv_app::write_headless_results() {
+    dev->graphics_qu.waitIdle();
+    r->read_timestamps();
+    if(!frame_timings.empty()) frame_timings.back().gpu_ms = r->frame_gpu_ms;
+
+    json  frames         = json::array();
+    float total_frame_ms = 0.f, total_cpu_ms = 0.f, total_gpu_ms = 0.f;
+    for(const auto& ft : frame_timings) {
+        frames.push_back(json{
+            {"frame_ms", ft.frame_ms},
+            {"cpu_ms", ft.cpu_ms},
+            {"gpu_ms", ft.gpu_ms},
+            {"render_scale", ft.render_scale}});
+        total_frame_ms += ft.frame_ms;
+        total_cpu_ms += ft.cpu_ms;
+        total_gpu_ms += ft.gpu_ms;
+    }
+    json nodes = json::array();
+    for(const auto& node : r->render_graph) {
+        auto t = r->node_timings.find(node->id);
+        if(t == r->node_timings.end()) continue;
+        nodes.push_back(json{
+            {"id", node->id}, {"name", node->prototype->name()}, {"avg_ms", t->second.avg_ms}});
+    }
+    // average work per frame over the last `history_length` frames, a slower run is often just
+    // doing more
+    json counters = json::object();
+    for(size_t i = 0; i < frame_counter_count; ++i)
+        counters[frame_counter_name((frame_counter)i)] = frame_stats::average((frame_counter)i);
+    float n = (float)glm::max(frame_timings.size(), (size_t)1);
+    json  report{
+        {"device", (const char*)dev->pdevice.getProperties().deviceName},
+        {"width", swapchain->extent.width},
+        {"height", swapchain->extent.height},
+        {"mean_frame_ms", total_frame_ms / n},
+        {"mean_cpu_ms", total_cpu_ms / n},
+        {"mean_gpu_ms", total_gpu_ms / n},
+        {"nodes", nodes},
+        {"counters", counters},
+        {"frames", frames}};
+    std::ofstream out(timings_path);
+    out << report.dump(4);
+    std::cout << "wrote timings for " << frame_timings.size() << " frames to " << timings_path
+              << "\n";
+
+    if(!screenshot_path.empty() && !frame_timings.empty()) write_screenshot(screenshot_path);
+}
+
+void eggv_app::write_screenshot(const std::filesystem::path& path) {
+    auto  w = swapchain->extent.width, h = swapchain->extent.height;
+    void* mapped;
+    buffer readback(
+        dev.get(),
+        (vk::DeviceSize)w * h * 4,
+        vk::BufferUsageFlagBits::eTransferDst,
+        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+        &mapped,
+        memory_category::staging
+    );
+
+    auto cb = std::move(dev->alloc_cmd_buffers(1)[0]);
+    cb->begin(vk::CommandBufferBeginInfo{vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+    auto subres = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+    // the last pass leaves the output image ready to present
+    cb->pipelineBarrier(
+        vk::PipelineStageFlagBits::eColorAttachmentOutput,
+        vk::PipelineStageFlagBits::eTransfer,
+        {},
+        {},
+        {},
+        {vk::ImageMemoryBarrier(
+            vk::AccessFlagBits::eColorAttachmentWrite,
+            vk::AccessFlagBits::eTransferRead,
+            vk::ImageLayout::ePresentSrcKHR,
+            vk::ImageLayout::eTransferSrcOptimal,
+            VK_QUEUE_FAMILY_IGNORED,
+            VK_QUEUE_FAMILY_IGNORED,
+            swapchain->images[last_image_index],
+            subres
+        )}
+    );
+    cb->copyImageToBuffer(
+        swapchain->images[last_image_index],
+        vk::ImageLayout::eTransferSrcOptimal,
+        readback.buf,
+        {vk::BufferImageCopy{
+            0,
+            0,
+            0,
+            vk::ImageSubresourceLayers{vk::ImageAspectFlagBits::eColor, 0, 0, 1},
+            {0, 0, 0},
+            {w, h, 1}}}
+    );
+    cb->pipelineBarrier(
+        vk::PipelineStageFlagBits::eTransfer,
+        vk::PipelineStageFlagBits::eHost,
+        {},
+        {vk::MemoryBarrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eHostRead)},
+        {},
+        {}
+    );
+    cb->end();
+    dev->graphics_qu.submit({vk::SubmitInfo{0, nullptr, nullptr, 1, &cb.get()}}, nullptr);
+    dev->graphics_qu.waitIdle();
+
+    // offscreen images are BGRA
+    std::vector<uint8_t> pixels((size_t)w * h * 4);
+    auto*                src = (const uint8_t*)mapped;
+    for(size_t i = 0; i < pixels.size(); i += 4) {
+        pixels[i + 0] = src[i + 2];
+        pixels[i + 1] = src[i + 1];
+        pixels[i + 2] = src[i + 0];
+        pixels[i + 3] = 255;
+    }
+    if(stbi_write_png(path.string().c_str(), (int)w, (int)h, 4, pixels.data(), (int)w * 4) == 0)
+        std::cout << "failed to write " << path << "\n";
+    else
+        std::cout << "wrote last frame to " << path << "\n";
+}
+
 eggv_app::~eggv_app() {
+    if(headless) return;
     ImGui_ImplVulkan_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImNodes::DestroyContext();
@@ -0,0 +1,115 @@
+#include "frame_stats.h"
+
+const char* frame_counter_name(frame_counter c) {
+    switch(c) {
+        case frame_counter::draw_calls: return "draw_calls";
+        case frame_counter::instances: return "instances";
+        case frame_counter::triangles: return "triangles";
+        case frame_counter::pipeline_binds: return "pipeline_binds";
+        case frame_counter::descriptor_binds: return "descriptor_binds";
+        case frame_counter::buffer_binds: return "buffer_binds";
+        case frame_counter::culled_objects: return "culled_objects";
+        case frame_counter::uploaded_bytes: return "uploaded_bytes";
+        case frame_counter::allocations: return "allocations";
+        case frame_counter::entities_updated: return "entities_updated";
+        case frame_counter::physics_bodies: return "physics_bodies";
+        case frame_counter::script_gc_bytes: return "script_gc_bytes";
+    }
+    return "?";
+}
+
+namespace frame_stats {
+std::array<std::atomic<uint64_t>, frame_counter_count> current{};
+
+namespace {
+std::array<uint64_t, frame_counter_count>                          last_totals{};
+std::array<std::array<float, history_length>, frame_counter_count> histories{};
+size_t                                                             next_history = 0;
+size_t                                                             frames_seen  = 0;
+
+std::ofstream csv;
+uint64_t      csv_frame = 0;
+
+std::array<float, frame_time_buckets> frame_time_counts{};
+std::array<float, history_length>     frame_times{};
+size_t                                next_frame_time  = 0;
+size_t                                frame_times_seen = 0;
+}  // namespace
+
+void end_frame() {
+    for(size_t i = 0; i < frame_counter_count; ++i) {
+        last_totals[i]             = current[i].exchange(0, std::memory_order_relaxed);
+        histories[i][next_history] = (float)last_totals[i];
+    }
+    next_history = (next_history + 1) % history_length;
+    frames_seen++;
+
+    if(csv.is_open()) {
+        csv << csv_frame++;
+        for(auto t : last_totals)
+            csv << ',' << t;
+        csv << '\n';
+    }
+}
+
+uint64_t last(frame_counter c) { return last_totals[(size_t)c]; }
+
+float average(frame_counter c) {
+    size_t n = std::min(frames_seen, history_length);
+    if(n == 0) return 0.f;
+    float sum = 0.f;
+    for(size_t i = 0; i < n; ++i)
+        sum += histories[(size_t)c][i];
+    return sum / (float)n;
+}
+
+const std::array<float, history_length>& history(frame_counter c) {
+    return histories[(size_t)c];
+}
+
+size_t history_offset() { return next_history; }
+
+void record_frame_time(float ms) {
+    auto bucket = (size_t)(std::max(ms, 0.f) / frame_time_max_ms * (float)frame_time_buckets);
+    frame_time_counts[std::min(bucket, frame_time_buckets - 1)] += 1.f;
+    frame_times[next_frame_time] = ms;
+    next_frame_time              = (next_frame_time + 1) % history_length;
+    frame_times_seen++;
+}
+
+const std::array<float, frame_time_buckets>& frame_time_histogram() { return frame_time_counts; }
+
+float frame_time_percentile(float p) {
+    size_t n = std::min(frame_times_seen, history_length);
+    if(n == 0) return 0.f;
+    std::array<float, history_length> sorted = frame_times;
+    auto k = std::min((size_t)(glm::clamp(p, 0.f, 1.f) * (float)n), n - 1);
+    std::nth_element(sorted.begin(), sorted.begin() + k, sorted.begin() + n);
+    return sorted[k];
+}
+
+void reset_frame_times() {
+    frame_time_counts.fill(0.f);
+    frame_times.fill(0.f);
+    next_frame_time  = 0;
+    frame_times_seen = 0;
+}
+
+bool begin_csv(const std::filesystem::path& path) {
+    end_csv();
+    csv.open(path);
+    if(!csv) return false;
+    csv_frame = 0;
+    csv << "frame";
+    for(size_t i = 0; i < frame_counter_count; ++i)
+        csv << ',' << frame_counter_name((frame_counter)i);
+    csv << '\n';
+    return true;
+}
+
+void end_csv() {
+    if(csv.is_open()) csv.close();
+}
+
+bool recording_csv() { return csv.is_open(); }
+}  // namespace frame_stats
@@ -1,19 +1,83 @@
 #include "geometry_set.h"
+#include "frame_stats.h"
 #include "imgui.h"
 #include <utility>
 
 geometry_set::geometry_set(device* dev, const std::filesystem::path& path)
-    : data(path.c_str()), dev(dev), name(path.filename()) {}
+    : data(path.c_str()), dev(dev), name(path.filename()) {
+    size_t total_vertices = 0, total_indices = 0;
+    for(int32 i = 0; i < num_meshes(); ++i) {
+        const auto& h = header(i);
+        first_vertices.push_back((int32_t)total_vertices);
+        first_indices.push_back((uint32_t)total_indices);
+        total_vertices += h.num_vertices;
+        total_indices += h.num_indices;
+    }
+    // meshes are only copied in when they are loaded, but the space for all of them is reserved
+    // up front. with unified memory the buffers are mapped and written without any staging
+    vk::MemoryPropertyFlags memuse = vk::MemoryPropertyFlagBits::eDeviceLocal;
+    if(dev->unified_memory)
+        memuse |= vk::MemoryPropertyFlagBits::eHostVisible
+                  | vk::MemoryPropertyFlagBits::eHostCoherent;
+    mapped_vertices = mapped_indices = nullptr;
+    vertex_buffer                    = std::make_shared<buffer>(
+        dev,
+        sizeof(vertex) * glm::max(total_vertices, (size_t)1),
+        vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer,
+        memuse,
+        dev->unified_memory ? (void**)&mapped_vertices : nullptr,
+        memory_category::mesh
+    );
+    index_buffer = std::make_shared<buffer>(
+        dev,
+        sizeof(uint16) * glm::max(total_indices, (size_t)1),
+        vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer,
+        memuse,
+        dev->unified_memory ? (void**)&mapped_indices : nullptr,
+        memory_category::mesh
+    );
+}
 
 std::shared_ptr<mesh> geometry_set::load_mesh(size_t index) {
     auto cv = this->mesh_cache.find(index);
     if(cv != this->mesh_cache.end()) return cv->second;
-    const auto& h   = this->header(index);
-    auto        msh = std::make_shared<mesh>(
+    const auto& h = this->header(index);
+    if(mapped_vertices != nullptr) {
+        // the only copy is from the file mapping into memory the GPU reads directly
+        memcpy(
+            mapped_vertices + sizeof(vertex) * first_vertices[index],
+            data.data() + h.vertex_ptr,
+            sizeof(vertex) * h.num_vertices
+        );
+        memcpy(
+            mapped_indices + sizeof(uint16) * first_indices[index],
+            data.data() + h.index_ptr,
+            sizeof(uint16) * h.num_indices
+        );
+        frame_stats::add(
+            frame_counter::uploaded_bytes,
+            sizeof(vertex) * h.num_vertices + sizeof(uint16) * h.num_indices
+        );
+        auto msh = std::make_shared<mesh>(
+            vertex_buffer,
+            index_buffer,
+            first_vertices[index],
+            first_indices[index],
+            (uint32_t)h.num_vertices,
+            (uint32_t)h.num_indices
+        );
+        this->mesh_cache[index] = msh;
+        return msh;
+    }
+    auto msh = std::make_shared<mesh>(
         dev,
-        (size_t)h.num_vertices,
+        vertex_buffer,
+        index_buffer,
+        first_vertices[index],
+        first_indices[index],
+        (uint32_t)h.num_vertices,
         sizeof(vertex),
-        (size_t)h.num_indices,
+        (uint32_t)h.num_indices,
         [&](void* stg_buf) {
             memcpy(stg_buf, data.data() + h.vertex_ptr, sizeof(vertex) * h.num_vertices);
             memcpy(
@@ -27,6 +91,12 @@ std::shared_ptr<mesh> geometry_set::load_mesh(size_t index) {
     return msh;
 }
 
+void geometry_set::load_all_meshes() {
+    mesh_upload_batch batch{dev};
+    for(int32 i = 0; i < num_meshes(); ++i)
+        load_mesh(i);
+}
+
 std::optional<reactphysics3d::PolygonVertexArray*> geometry_set::load_convex_hull(size_t index) {
     auto cv = this->convex_hull_cache.find(index);
     if(cv != this->convex_hull_cache.end()) return &cv->second.pva;
@@ -6,11 +6,20 @@
 #include "ndcommon.h"
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <functional>
+#include <future>
 #include <glm/glm.hpp>
 #include <iostream>
+#include <mutex>
 #include <optional>
+#include <stdexcept>
+#include <thread>
 #include <vector>
 
 geom_file::vertex vertex_in_mesh(aiMesh* mesh, size_t i) {
@@ -21,126 +30,386 @@ geom_file::vertex vertex_in_mesh(aiMesh* mesh, size_t i) {
                                   : vec2(0.f)};
 }
 
+// run `f(i)` for every i in [0, count) on `num_threads` threads
+void parallel_for(size_t count, size_t num_threads, const std::function<void(size_t)>& f) {
+    std::atomic<size_t>      next{0};
+    std::vector<std::thread> threads;
+    for(size_t t = 0; t < std::min(num_threads, count); ++t) {
+        threads.emplace_back([&] {
+            for(size_t i = next++; i < count; i = next++)
+                f(i);
+        });
+    }
+    for(auto& t : threads)
+        t.join();
+}
+
+// a mesh laid out the way it is stored in the geometry file: the name, vertices, indices and hull
+// back to back in `data`. the header's pointers are relative to the start of `data` until the mesh
+// is written
+struct converted_mesh {
+    geom_file::mesh_header header;
+    std::vector<char>      data;
+};
+
+template<typename T>
+void append(std::vector<char>& data, const T* src, size_t count) {
+    auto at = data.size();
+    data.resize(at + sizeof(T) * count);
+    std::memcpy(data.data() + at, src, sizeof(T) * count);
+}
+
+converted_mesh convert_mesh(aiMesh* mesh, bool gen_hulls) {
+    converted_mesh cm;
+    auto&          data = cm.data;
+
+    size_t name_ptr = data.size();
+    append(data, mesh->mName.C_Str(), mesh->mName.length + 1);
+
+    size_t                         vert_ptr = data.size();
+    std::vector<geom_file::vertex> vertices(mesh->mNumVertices);
+    for(size_t i = 0; i < mesh->mNumVertices; ++i)
+        vertices[i] = vertex_in_mesh(mesh, i);
+    append(data, vertices.data(), vertices.size());
+
+    size_t              idx_ptr = data.size();
+    std::vector<uint16> indices;
+    indices.reserve(mesh->mNumFaces * 3);
+    for(size_t i = 0; i < mesh->mNumFaces; ++i)
+        for(size_t j = 0; j < mesh->mFaces[i].mNumIndices; ++j)
+            indices.push_back((uint16)mesh->mFaces[i].mIndices[j]);
+    append(data, indices.data(), indices.size());
+
+    size_t hull_ptr = 0;
+    if(gen_hulls) {
+        // QuickHull keeps its working memory between calls, so each thread reuses its own
+        thread_local quickhull::QuickHull<float> hullgen;
+        hull_ptr  = data.size();
+        auto hull = hullgen.getConvexHull(
+            (float*)mesh->mVertices, mesh->mNumVertices, false, true, 0.01f
+        );
+        const auto&           hull_indices = hull.getIndexBuffer();
+        std::vector<uint16_t> hull_data(hull_indices.begin(), hull_indices.end());
+        uint16_t              size = hull_data.size();
+        append(data, &size, 1);
+        append(data, hull_data.data(), hull_data.size());
+    }
+
+    cm.header = geom_file::mesh_header(
+        vert_ptr,
+        idx_ptr,
+        name_ptr,
+        hull_ptr,
+        mesh->mNumVertices,
+        indices.size(),
+        mesh->mName.length + 1,
+        mesh->mMaterialIndex,
+        vec3(mesh->mAABB.mMin.x, mesh->mAABB.mMin.y, mesh->mAABB.mMin.z),
+        vec3(mesh->mAABB.mMax.x, mesh->mAABB.mMax.y, mesh->mAABB.mMax.z)
+    );
+    return cm;
+}
+
+// meshes are appended in one write each through a large buffer, and the header table is kept in
+// memory and written once at the end into the space reserved for it
 class geo_file {
-    std::ofstream               output;
-    bool                        gen_hulls;
-    quickhull::QuickHull<float> hullgen;
-    size_t                      mesh_count{}, max_mesh_count;
+    std::vector<char>                   buffer;
+    std::ofstream                       output;
+    std::vector<geom_file::mesh_header> headers;
+    size_t                              max_mesh_count, next_ptr;
 
   public:
-    geo_file(const std::filesystem::path& path, size_t max_mesh_count, bool gen_hulls)
-        : output(path, std::ios::binary), gen_hulls(gen_hulls), max_mesh_count(max_mesh_count) {
-        output.write((char*)&max_mesh_count, sizeof(int32_t));
-        output.seekp(sizeof(geom_file::mesh_header) * max_mesh_count, std::ios::cur);
+    geo_file(const std::filesystem::path& path, size_t max_mesh_count)
+        : buffer(16 * 1024 * 1024), max_mesh_count(max_mesh_count) {
+        // the buffer has to be set before the file is opened to take effect everywhere
+        output.rdbuf()->pubsetbuf(buffer.data(), (std::streamsize)buffer.size());
+        output.open(path, std::ios::binary);
+        int32_t count = (int32_t)max_mesh_count;
+        output.write((char*)&count, sizeof(int32_t));
+        next_ptr = sizeof(int32_t) + sizeof(geom_file::mesh_header) * max_mesh_count;
+        output.seekp((std::streamoff)next_ptr, std::ios::beg);
+        headers.reserve(max_mesh_count);
     }
 
-    void write_mesh(aiMesh* mesh) {
-        assert(mesh_count < max_mesh_count);
-        auto mesh_index = mesh_count;
-        mesh_count++;
+    void write_mesh(const converted_mesh& mesh) {
+        assert(headers.size() < max_mesh_count);
+        auto header       = mesh.header;
+        header.vertex_ptr += next_ptr;
+        header.index_ptr  += next_ptr;
+        header.name_ptr   += next_ptr;
+        if(header.hull_ptr != 0) header.hull_ptr += next_ptr;
+        headers.push_back(header);
+        output.write(mesh.data.data(), (std::streamsize)mesh.data.size());
+        next_ptr += mesh.data.size();
+    }
 
-        auto name_fptr = output.tellp();
-        output.write(mesh->mName.C_Str(), mesh->mName.length + 1);
+    void finish() {
+        output.seekp(sizeof(int32_t), std::ios::beg);
+        auto size = sizeof(geom_file::mesh_header) * headers.size();
+        output.write((char*)headers.data(), (std::streamsize)size);
+        output.close();
+    }
+};
 
-        auto vert_fptr = output.tellp();
-        for(size_t i = 0; i < mesh->mNumVertices; ++i) {
-            auto v = vertex_in_mesh(mesh, i);
-            output.write((char*)&v, sizeof(geom_file::vertex));
-        }
+// 64 bit FNV-1a, plenty to tell inputs apart
+struct fnv1a {
+    uint64_t value = 0xcbf29ce484222325ull;
 
-        auto idx_fptr = output.tellp();
-        auto num_idx  = 0;
-        for(size_t i = 0; i < mesh->mNumFaces; ++i) {
-            for(size_t j = 0; j < mesh->mFaces[i].mNumIndices; ++j) {
-                uint16 x = mesh->mFaces[i].mIndices[j];
-                output.write((char*)&x, sizeof(uint16));
-                num_idx++;
-            }
+    void add(const void* data, size_t size) {
+        auto* bytes = (const uint8_t*)data;
+        for(size_t i = 0; i < size; ++i) {
+            value ^= bytes[i];
+            value *= 0x100000001b3ull;
         }
+    }
+};
 
-        auto hull_fptr = 0;
-        if(gen_hulls) {
-            hull_fptr = output.tellp();
-            auto hull = hullgen.getConvexHull(
-                (float*)mesh->mVertices, mesh->mNumVertices, false, true, 0.01f
-            );
-            auto     indices = hull.getIndexBuffer();
-            uint16_t size    = indices.size();
-            output.write((char*)&size, sizeof(uint16_t));
-            for(size_t i = 0; i < indices.size(); ++i)
-                output.write((char*)(indices.data() + i), sizeof(uint16_t));
-        }
+const unsigned import_flags
+    = aiProcess_GenBoundingBoxes | aiProcessPreset_TargetRealtime_MaxQuality | aiProcess_FlipUVs;
 
-        auto resume_fptr = output.tellp();
-        output.seekp(sizeof(int32) + mesh_index * sizeof(geom_file::mesh_header), std::ios::beg);
-        auto header = geom_file::mesh_header(
-            vert_fptr,
-            idx_fptr,
-            name_fptr,
-            hull_fptr,
-            mesh->mNumVertices,
-            num_idx,
-            mesh->mName.length + 1,
-            mesh->mMaterialIndex,
-            vec3(mesh->mAABB.mMin.x, mesh->mAABB.mMin.y, mesh->mAABB.mMin.z),
-            vec3(mesh->mAABB.mMax.x, mesh->mAABB.mMax.y, mesh->mAABB.mMax.z)
-        );
-        output.write((char*)&header, sizeof(geom_file::mesh_header));
-        output.seekp(resume_fptr);
+// bump whenever the conversion changes, so that old cache entries stop matching
+const uint32_t cache_version = 1;
+
+// an input's cache key covers its contents and every option that changes how it is converted
+uint64_t input_key(const std::filesystem::path& path, bool gen_hulls) {
+    fnv1a h;
+    h.add(&cache_version, sizeof(cache_version));
+    h.add(&import_flags, sizeof(import_flags));
+    h.add(&gen_hulls, sizeof(gen_hulls));
+    std::ifstream     in(path, std::ios::binary);
+    std::vector<char> chunk(1024 * 1024);
+    while(in) {
+        in.read(chunk.data(), (std::streamsize)chunk.size());
+        h.add(chunk.data(), (size_t)in.gcount());
     }
+    return h.value;
+}
+
+std::filesystem::path cache_entry_path(const std::filesystem::path& cache_dir, uint64_t key) {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.meshes", (unsigned long long)key);
+    return cache_dir / name;
+}
+
+// where one mesh's data is in a cache entry, so it can be read once the mesh is needed
+struct cached_mesh {
+    geom_file::mesh_header header;
+    std::streamoff         offset;
+    uint64_t               size;
+};
+
+// a cache entry is every converted mesh of one input in order: a count, then each mesh's header,
+// data size and data. only the headers are read, the data is skipped over. returns nothing if
+// there is no entry or it is incomplete
+std::optional<std::vector<cached_mesh>> read_cache_index(const std::filesystem::path& path) {
+    std::error_code ec;
+    auto            file_size = std::filesystem::file_size(path, ec);
+    if(ec) return {};
+    std::ifstream in(path, std::ios::binary);
+    if(!in) return {};
+    uint32_t count = 0;
+    in.read((char*)&count, sizeof(uint32_t));
+    if(!in) return {};
+    std::vector<cached_mesh> meshes(count);
+    for(auto& mesh : meshes) {
+        in.read((char*)&mesh.header, sizeof(geom_file::mesh_header));
+        in.read((char*)&mesh.size, sizeof(uint64_t));
+        if(!in) return {};
+        mesh.offset = in.tellg();
+        if((uint64_t)mesh.offset + mesh.size > file_size) return {};
+        in.seekg((std::streamoff)mesh.size, std::ios::cur);
+    }
+    return meshes;
+}
+
+converted_mesh read_cached_mesh(const std::filesystem::path& path, const cached_mesh& mesh) {
+    converted_mesh cm{mesh.header, std::vector<char>(mesh.size)};
+    std::ifstream  in(path, std::ios::binary);
+    in.seekg(mesh.offset);
+    in.read(cm.data.data(), (std::streamsize)mesh.size);
+    if(!in) throw std::runtime_error("failed to read cached mesh from " + path.string());
+    return cm;
+}
+
+// writes an entry under a temporary name and only renames it once it is complete, so an
+// interrupted import never leaves a partial entry behind
+class cache_writer {
+    std::filesystem::path path, tmp_path;
+    std::ofstream         output;
+
+  public:
+    cache_writer(const std::filesystem::path& path, uint32_t count)
+        : path(path), tmp_path(path.string() + ".tmp"), output(tmp_path, std::ios::binary) {
+        output.write((char*)&count, sizeof(uint32_t));
+    }
+
+    void write_mesh(const converted_mesh& mesh) {
+        uint64_t size = mesh.data.size();
+        output.write((char*)&mesh.header, sizeof(geom_file::mesh_header));
+        output.write((char*)&size, sizeof(uint64_t));
+        output.write(mesh.data.data(), (std::streamsize)size);
+    }
+
+    void finish() {
+        output.close();
+        std::error_code ec;
+        if(output) std::filesystem::rename(tmp_path, path, ec);
+        if(!output || ec) {
+            std::cout << "\tfailed to write cache entry " << path << "\n";
+            std::filesystem::remove(tmp_path, ec);
+        }
+    }
+};
+
+// one input scene, either loaded from the cache or with Assimp
+struct input_file {
+    std::filesystem::path             path;
+    uint64_t                          key;
+    std::unique_ptr<Assimp::Importer> importer;
+    const aiScene*                    scene;
+    std::vector<cached_mesh>          cached_meshes;
+    bool                              cached;
+
+    input_file(std::filesystem::path path)
+        : path(std::move(path)), key(0), scene(nullptr), cached(false) {}
+
+    size_t mesh_count() const { return cached ? cached_meshes.size() : scene->mNumMeshes; }
 };
 
 int main(int argc, char* argv[]) {
     std::optional<std::filesystem::path> output_path = {};
-    std::vector<std::filesystem::path>   input_paths;
+    std::optional<std::filesystem::path> cache_dir   = {};
+    std::vector<input_file>              inputs;
 
-    bool gen_hulls = false;
+    bool   gen_hulls   = false;
+    bool   use_cache   = true;
+    size_t num_threads = std::max(1u, std::thread::hardware_concurrency());
 
     for(int i = 1; i < argc; ++i)
         if(strcmp(argv[i], "-o") == 0)
             output_path = argv[++i];
         else if(strcmp(argv[i], "--gen-hull") == 0)
             gen_hulls = true;
+        else if(strcmp(argv[i], "-j") == 0)
+            num_threads = std::max(1, std::atoi(argv[++i]));
+        else if(strcmp(argv[i], "--cache") == 0)
+            cache_dir = argv[++i];
+        else if(strcmp(argv[i], "--no-cache") == 0)
+            use_cache = false;
         else
-            input_paths.emplace_back(argv[i]);
+            inputs.emplace_back(argv[i]);
 
-    if(input_paths.empty() || !output_path.has_value()) {
+    if(inputs.empty() || !output_path.has_value()) {
         std::cout << "usage: eggv_import [options] [input scene paths...] -o [output mesh data "
                      "path]\n";
         std::cout << "\t--gen-hull:\tcompute convex hull of each mesh\n";
+        std::cout << "\t-j [threads]:\tnumber of threads to import with, defaults to one per "
+                     "core\n";
+        std::cout << "\t--cache [dir]:\treuse the converted meshes of unchanged inputs from dir, "
+                     "defaults to the output path + .cache\n";
+        std::cout << "\t--no-cache:\tconvert every input again and don't update the cache\n";
         return 1;
     }
+    if(!cache_dir.has_value()) cache_dir = output_path.value().string() + ".cache";
+    if(use_cache) std::filesystem::create_directories(cache_dir.value());
 
-    std::vector<const aiScene*> inputs;
-    size_t                      total_mesh_count = 0;
-
-    std::cout << "loading meshes from " << input_paths.size() << " files\n";
-    Assimp::Importer imp;
-    for(const auto& input_path : input_paths) {
-        std::cout << "\tloading " << input_path << "\n";
-        imp.ReadFile(
-            input_path,
-            aiProcess_GenBoundingBoxes | aiProcessPreset_TargetRealtime_MaxQuality
-                | aiProcess_FlipUVs
-        );
-        // TODO: this just leaks the scenes, which is fine for now since we're just going to write
-        // them out into a file and exit, but is messy if you let the Importer own the scenes, it
-        // will free them when you call ReadFile() again
-        const auto* scene = imp.GetOrphanedScene();
-        total_mesh_count += scene->mNumMeshes;
-        inputs.push_back(scene);
+    std::cout << "loading meshes from " << inputs.size() << " files with " << num_threads
+              << " threads\n";
+    // an importer owns the scene it loaded, and isn't safe to share between threads
+    std::mutex log_mutex;
+    parallel_for(inputs.size(), num_threads, [&](size_t i) {
+        auto& input = inputs[i];
+        if(use_cache) {
+            input.key    = input_key(input.path, gen_hulls);
+            auto entry   = read_cache_index(cache_entry_path(cache_dir.value(), input.key));
+            input.cached = entry.has_value();
+            if(input.cached) {
+                input.cached_meshes = std::move(entry.value());
+                std::lock_guard<std::mutex> lock(log_mutex);
+                std::cout << "\tloaded " << input.path << " from the cache\n";
+                return;
+            }
+        }
+        input.importer = std::make_unique<Assimp::Importer>();
+        input.scene    = input.importer->ReadFile(input.path.string(), import_flags);
+        std::lock_guard<std::mutex> lock(log_mutex);
+        if(input.scene == nullptr)
+            std::cout << "\tfailed to load " << input.path << ": "
+                      << input.importer->GetErrorString() << "\n";
+        else
+            std::cout << "\tloaded " << input.path << "\n";
+    });
+
+    // every mesh as (input, mesh in that input)
+    std::vector<std::pair<size_t, size_t>> meshes;
+    for(size_t i = 0; i < inputs.size(); ++i) {
+        if(!inputs[i].cached && inputs[i].scene == nullptr) return 1;
+        for(size_t j = 0; j < inputs[i].mesh_count(); ++j)
+            meshes.emplace_back(i, j);
     }
-    std::cout << "finished loading meshes, got " << total_mesh_count << " meshes total\n";
+    std::cout << "finished loading meshes, got " << meshes.size() << " meshes total\n";
 
+    // meshes are converted in parallel and written out in order as they become ready. converters
+    // wait until their mesh is within `window` meshes of the writer, so at most that many
+    // converted meshes are held in memory. cached meshes are read from their entry the same way
     std::cout << "writing geometry set to " << output_path.value() << "\n";
-    geo_file output(output_path.value(), total_mesh_count, gen_hulls);
-    for(const auto* input : inputs) {
-        std::cout << "\twriting meshes from \"" << input->mName.C_Str() << "\"\n";
-        for(size_t i = 0; i < input->mNumMeshes; ++i) {
-            std::cout << "\t\twriting mesh " << input->mMeshes[i]->mName.C_Str() << "\n";
-            output.write_mesh(input->mMeshes[i]);
+    std::vector<std::promise<converted_mesh>> converted(meshes.size());
+    const size_t                              window  = 2 * num_threads;
+    size_t                                    written = 0;
+    std::mutex                                written_mutex;
+    std::condition_variable                   written_cv;
+
+    std::thread converter([&] {
+        parallel_for(meshes.size(), num_threads, [&](size_t i) {
+            {
+                // indices are handed out in order, so the mesh the writer is waiting on has
+                // always been claimed by a thread that isn't waiting here
+                std::unique_lock<std::mutex> lock(written_mutex);
+                written_cv.wait(lock, [&] { return i < written + window; });
+            }
+            auto& input = inputs[meshes[i].first];
+            if(input.cached)
+                converted[i].set_value(read_cached_mesh(
+                    cache_entry_path(cache_dir.value(), input.key),
+                    input.cached_meshes[meshes[i].second]
+                ));
+            else
+                converted[i].set_value(
+                    convert_mesh(input.scene->mMeshes[meshes[i].second], gen_hulls)
+                );
+        });
+    });
+    // inputs without any meshes never start an entry in the loop below
+    for(const auto& input : inputs)
+        if(use_cache && !input.cached && input.mesh_count() == 0)
+            cache_writer(cache_entry_path(cache_dir.value(), input.key), 0).finish();
+    geo_file                    output(output_path.value(), meshes.size());
+    std::optional<cache_writer> cache;
+    for(size_t i = 0; i < meshes.size(); ++i) {
+        const auto& input = inputs[meshes[i].first];
+        if(use_cache && !input.cached && meshes[i].second == 0) {
+            cache.emplace(
+                cache_entry_path(cache_dir.value(), input.key), (uint32_t)input.mesh_count()
+            );
+        }
+        auto mesh = converted[i].get_future().get();
+        std::cout << "\twrote mesh " << mesh.data.data() + mesh.header.name_ptr << "\n";
+        output.write_mesh(mesh);
+        if(cache.has_value()) {
+            cache->write_mesh(mesh);
+            if(meshes[i].second + 1 == input.mesh_count()) {
+                cache->finish();
+                cache.reset();
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(written_mutex);
+            written = i + 1;
         }
+        written_cv.notify_all();
     }
+    converter.join();
+    output.finish();
 
     std::cout << "finished!\n";
 
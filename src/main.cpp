@@ -1,7 +1,14 @@
 #include "eggv_app.h"
+#include "frame_stats.h"
+#include "profiler.h"
 
 int main(int argc, const char* argv[]) {
-    eggv_app app(eggv_cmdline_args(argc, argv));
+    eggv_cmdline_args args(argc, argv);
+    if(args.profile_frames > 0) profiler::begin_capture(args.profile_path, args.profile_frames);
+    if(!args.stats_csv_path.empty() && !frame_stats::begin_csv(args.stats_csv_path))
+        throw std::runtime_error("failed to open " + args.stats_csv_path.string());
+    eggv_app app(args);
     app.run();
+    if(args.headless) app.write_headless_results();
     return 0;
 }
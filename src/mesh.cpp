@@ -1,58 +1,85 @@
 #include "mesh.h"
 #include "geometry_set.h"
 #include "renderer.h"
+#include "upload_service.h"
 
 mesh::mesh(
     device*                           dev,
     uint32_t                          vcount,
-    size_t                            _vsize,
+    size_t                            vsize,
     uint32_t                          icount,
     const std::function<void(void*)>& write_buffer
 )
-    : vertex_count(vcount), index_count(icount) {
-    auto vsize = _vsize * vcount, isize = sizeof(uint16) * icount;
-    auto staging_buffer = std::make_unique<buffer>(
+    : vertex_count(vcount), index_count(icount), vertex_offset(0), first_index(0) {
+    vertex_buffer = std::make_shared<buffer>(
         dev,
-        vsize + isize,
-        vk::BufferUsageFlagBits::eTransferSrc,
-        vk::MemoryPropertyFlagBits::eHostVisible
-    );
-    auto* staging_map = staging_buffer->map();
-    write_buffer(staging_map);
-    staging_buffer->unmap();
-
-    vertex_buffer = std::make_unique<buffer>(
-        dev,
-        vsize,
+        vsize * vcount,
         vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer,
-        vk::MemoryPropertyFlagBits::eDeviceLocal
+        vk::MemoryPropertyFlagBits::eDeviceLocal,
+        nullptr,
+        memory_category::mesh
     );
-    index_buffer = std::make_unique<buffer>(
+    index_buffer = std::make_shared<buffer>(
         dev,
-        isize,
+        sizeof(uint16) * icount,
         vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer,
-        vk::MemoryPropertyFlagBits::eDeviceLocal
+        vk::MemoryPropertyFlagBits::eDeviceLocal,
+        nullptr,
+        memory_category::mesh
     );
+    upload(dev, vsize, write_buffer);
+}
 
-    auto upload_commands = dev->alloc_tmp_cmd_buffer();
-    upload_commands.begin(vk::CommandBufferBeginInfo{vk::CommandBufferUsageFlagBits::eOneTimeSubmit}
-    );
-    // could definitly collect all the staging information + copy commands and then do this all at
-    // once
-    upload_commands.copyBuffer(
-        staging_buffer->buf, vertex_buffer->buf, {vk::BufferCopy(0, 0, vsize)}
-    );
-    upload_commands.copyBuffer(
-        staging_buffer->buf, index_buffer->buf, {vk::BufferCopy(vsize, 0, isize)}
+mesh::mesh(
+    device*                           dev,
+    std::shared_ptr<buffer>           vertex_buffer,
+    std::shared_ptr<buffer>           index_buffer,
+    int32_t                           vertex_offset,
+    uint32_t                          first_index,
+    uint32_t                          vcount,
+    size_t                            vsize,
+    uint32_t                          icount,
+    const std::function<void(void*)>& write_buffer
+)
+    : vertex_buffer(std::move(vertex_buffer)), index_buffer(std::move(index_buffer)),
+      vertex_count(vcount), index_count(icount), vertex_offset(vertex_offset),
+      first_index(first_index) {
+    upload(dev, vsize, write_buffer);
+}
+
+void mesh::upload(device* dev, size_t _vsize, const std::function<void(void*)>& write_buffer) {
+    auto vsize = _vsize * vertex_count, isize = sizeof(uint16) * index_count;
+    auto staging = dev->uploads->stage(vsize + isize);
+    write_buffer(staging.mapped);
+
+    dev->uploads->copy_to_buffer(
+        staging,
+        0,
+        vertex_buffer->buf,
+        _vsize * vertex_offset,
+        vsize,
+        vk::PipelineStageFlagBits::eVertexInput,
+        vk::AccessFlagBits::eVertexAttributeRead
     );
-    upload_commands.end();
-    dev->graphics_qu.submit(
-        {
-            vk::SubmitInfo{0, nullptr, nullptr, 1, &upload_commands}
-    },
-        nullptr
+    dev->uploads->copy_to_buffer(
+        staging,
+        vsize,
+        index_buffer->buf,
+        sizeof(uint16) * first_index,
+        isize,
+        vk::PipelineStageFlagBits::eVertexInput,
+        vk::AccessFlagBits::eIndexRead
     );
-    dev->tmp_upload_buffers.emplace_back(std::move(staging_buffer));
+    ready_value = dev->uploads->pending_value();
+}
+
+uint64_t mesh_upload_batch::finish() {
+    finished = true;
+    return dev->uploads->submit();
+}
+
+mesh_upload_batch::~mesh_upload_batch() {
+    if(!finished) finish();
 }
 
 renderable::renderable(
@@ -0,0 +1,469 @@
+#include "occlusion.h"
+#include "frame_stats.h"
+#include "imgui.h"
+#include <set>
+
+namespace {
+struct hiz_push_constants {
+    // the level being built
+    uint32_t level;
+    uint32_t level_count;
+    uint32_t object_count;
+};
+
+inline uint32_t group_count(uint32_t n, uint32_t group_size) {
+    return (n + group_size - 1) / group_size;
+}
+
+// make a dispatch's writes visible to the next dispatch
+inline void compute_barrier(vk::CommandBuffer& cb) {
+    cb.pipelineBarrier(
+        vk::PipelineStageFlagBits::eComputeShader,
+        vk::PipelineStageFlagBits::eComputeShader,
+        {},
+        {vk::MemoryBarrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead)},
+        {},
+        {}
+    );
+}
+}  // namespace
+
+hiz_cull_render_node_prototype::hiz_cull_render_node_prototype(device* dev)
+    : level_count(0), mapped_objects(nullptr), mapped_visibility(nullptr),
+      mapped_commands(nullptr), mapped_counts(nullptr), object_capacity(0), batch_capacity(0),
+      prepared(false), num_objects(0), num_visible(0) {
+    inputs = {
+        framebuffer_desc{
+                         "depth", vk::Format::eUndefined,
+                         framebuffer_type::depth,
+                         framebuffer_mode::shader_input},
+    };
+    outputs = {
+        framebuffer_desc{
+                         "hiz", vk::Format::eR32Sfloat,
+                         framebuffer_type::color,
+                         framebuffer_mode::storage},
+    };
+
+    desc_layout = dev->create_desc_set_layout(
+        {vk::DescriptorSetLayoutBinding(
+             0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute
+         ),
+         vk::DescriptorSetLayoutBinding(
+             1, vk::DescriptorType::eStorageImage, max_hiz_levels, vk::ShaderStageFlagBits::eCompute
+         ),
+         vk::DescriptorSetLayoutBinding(
+             2, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute
+         ),
+         vk::DescriptorSetLayoutBinding(
+             3, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eCompute
+         ),
+         vk::DescriptorSetLayoutBinding(
+             4, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute
+         ),
+         vk::DescriptorSetLayoutBinding(
+             5, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute
+         ),
+         vk::DescriptorSetLayoutBinding(
+             6, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute
+         ),
+         vk::DescriptorSetLayoutBinding(
+             7, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute
+         )}
+    );
+
+    vk::PushConstantRange push_consts[] = {
+        vk::PushConstantRange{vk::ShaderStageFlagBits::eCompute, 0, sizeof(hiz_push_constants)}
+    };
+
+    pipeline_layout = dev->dev->createPipelineLayoutUnique(vk::PipelineLayoutCreateInfo{
+        {}, 1, &desc_layout.get(), 1, push_consts});
+
+    // the shaders only use texelFetch, which ignores everything but the image
+    sampler = dev->dev->createSamplerUnique(vk::SamplerCreateInfo{
+        {},
+        vk::Filter::eNearest,
+        vk::Filter::eNearest,
+        vk::SamplerMipmapMode::eNearest,
+        vk::SamplerAddressMode::eClampToEdge,
+        vk::SamplerAddressMode::eClampToEdge,
+        vk::SamplerAddressMode::eClampToEdge});
+}
+
+void hiz_cull_render_node_prototype::build_gui(renderer* r, render_node* node) {
+    ImGui::Text("%zu objects, %zu visible last frame", num_objects, num_visible);
+    ImGui::Text("%zu batches, %u pyramid levels", batches.size(), level_count);
+}
+
+bool hiz_cull_render_node_prototype::active(renderer* r) const {
+    for(const auto& node : r->compiled.subpass_order)
+        if(node->prototype.get() == this) return true;
+    return false;
+}
+
+size_t hiz_cull_render_node_prototype::subpass_repeat_count(renderer* r, render_node* node) {
+    size_t                  num_renderables = 0;
+    std::set<const buffer*> vertex_buffers;
+    for(auto rdi = r->begin_components(); rdi != r->end_components(); ++rdi) {
+        const auto& [id, rd] = *rdi;
+        if(rd.m == nullptr) continue;
+        num_renderables++;
+        vertex_buffers.insert(rd.m->vertex_buffer.get());
+    }
+
+    // leave room to grow so that adding a few objects doesn't cause a recompile every time
+    object_capacity = std::max(object_capacity, std::max<size_t>(256, num_renderables * 2));
+    batch_capacity  = std::max(batch_capacity, std::max<size_t>(16, vertex_buffers.size() * 2));
+    r->global_buffers[GLOBAL_BUF_CULL_OBJECTS] = std::make_unique<buffer>(
+        r->dev,
+        sizeof(gpu_cull_object) * object_capacity,
+        vk::BufferUsageFlagBits::eStorageBuffer,
+        vk::MemoryPropertyFlagBits::eHostCoherent,
+        (void**)&mapped_objects,
+        memory_category::uniform
+    );
+    r->global_buffers[GLOBAL_BUF_CULL_VISIBILITY] = std::make_unique<buffer>(
+        r->dev,
+        sizeof(uint32_t) * object_capacity,
+        vk::BufferUsageFlagBits::eStorageBuffer,
+        vk::MemoryPropertyFlagBits::eHostCoherent,
+        (void**)&mapped_visibility,
+        memory_category::uniform
+    );
+    // the first phase's commands, then room for every object again in the second phase
+    r->global_buffers[GLOBAL_BUF_CULL_COMMANDS] = std::make_unique<buffer>(
+        r->dev,
+        sizeof(vk::DrawIndexedIndirectCommand) * object_capacity * 2,
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer,
+        vk::MemoryPropertyFlagBits::eHostCoherent,
+        (void**)&mapped_commands,
+        memory_category::uniform
+    );
+    r->global_buffers[GLOBAL_BUF_CULL_COUNTS] = std::make_unique<buffer>(
+        r->dev,
+        sizeof(uint32_t) * batch_capacity * 2,
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer,
+        vk::MemoryPropertyFlagBits::eHostCoherent,
+        (void**)&mapped_counts,
+        memory_category::uniform
+    );
+    // the new buffers don't have last frame's visibility, so everything goes through the second
+    // phase once
+    last_objects.clear();
+    batches.clear();
+    num_objects = 0;
+
+    create_pyramid(r);
+
+    return 1;
+}
+
+void hiz_cull_render_node_prototype::create_pyramid(renderer* r) {
+    // levels 1.. cover the whole framebuffer, since the render resolution can change every frame
+    auto w    = std::max(1u, r->swpc->extent.width / 2);
+    auto h    = std::max(1u, r->swpc->extent.height / 2);
+    auto mips = std::min(1 + (uint32_t)std::floor(std::log2(std::max(w, h))), max_hiz_levels - 1);
+    if(pyramid == nullptr || pyramid->info.extent.width != w || pyramid->info.extent.height != h) {
+        pyramid_level_views.clear();
+        pyramid_view.reset();
+        pyramid = std::make_unique<image>(
+            r->dev,
+            vk::ImageCreateFlags(),
+            vk::ImageType::e2D,
+            vk::Extent3D{w, h, 1},
+            vk::Format::eR32Sfloat,
+            vk::ImageTiling::eOptimal,
+            vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled,
+            vk::MemoryPropertyFlagBits::eDeviceLocal,
+            mips,
+            1,
+            &pyramid_view,
+            vk::ImageViewType::e2D,
+            vk::ImageSubresourceRange{vk::ImageAspectFlagBits::eColor, 0, mips, 0, 1},
+            memory_category::framebuffer
+        );
+        for(uint32_t i = 0; i < mips; ++i) {
+            pyramid_level_views.emplace_back(r->dev->dev->createImageViewUnique(
+                vk::ImageViewCreateInfo{
+                    vk::ImageViewCreateFlags(),
+                    pyramid->img,
+                    vk::ImageViewType::e2D,
+                    vk::Format::eR32Sfloat,
+                    vk::ComponentMapping(),
+                    vk::ImageSubresourceRange{vk::ImageAspectFlagBits::eColor, i, 1, 0, 1}}
+            ));
+        }
+    }
+    level_count = mips + 1;
+}
+
+void hiz_cull_render_node_prototype::resize(renderer* r, render_node* node) { create_pyramid(r); }
+
+void hiz_cull_render_node_prototype::collect_descriptor_layouts(
+    render_node*                           node,
+    std::vector<vk::DescriptorPoolSize>&   pool_sizes,
+    std::vector<vk::DescriptorSetLayout>&  layouts,
+    std::vector<vk::UniqueDescriptorSet*>& outputs
+) {
+    pool_sizes.emplace_back(vk::DescriptorType::eCombinedImageSampler, 2);
+    pool_sizes.emplace_back(vk::DescriptorType::eStorageImage, max_hiz_levels);
+    pool_sizes.emplace_back(vk::DescriptorType::eUniformBuffer, 1);
+    pool_sizes.emplace_back(vk::DescriptorType::eStorageBuffer, 4);
+    layouts.push_back(desc_layout.get());
+    outputs.push_back(&node->desc_set);
+}
+
+void hiz_cull_render_node_prototype::update_descriptor_sets(
+    renderer*                            r,
+    render_node*                         node,
+    std::vector<vk::WriteDescriptorSet>& writes,
+    arena<vk::DescriptorBufferInfo>&     buf_infos,
+    arena<vk::DescriptorImageInfo>&      img_infos
+) {
+    auto depth = node->input_framebuffer(0);
+    if(depth.has_value() && depth.value() != 0) {
+        writes.emplace_back(
+            node->desc_set.get(),
+            0,
+            0,
+            1,
+            vk::DescriptorType::eCombinedImageSampler,
+            img_infos.alloc(vk::DescriptorImageInfo(
+                sampler.get(),
+                r->buffers[depth.value()].image_views[0].get(),
+                vk::ImageLayout::eShaderReadOnlyOptimal
+            ))
+        );
+    }
+
+    // every element of the array has to be valid, so levels past the top repeat the top level
+    auto* levels = img_infos.alloc_array(max_hiz_levels);
+    for(uint32_t i = 0; i < max_hiz_levels; ++i) {
+        auto level = std::min(i, level_count - 1);
+        levels[i]  = vk::DescriptorImageInfo(
+            nullptr,
+            level == 0 ? r->buffers[node->outputs[0]].image_views[0].get()
+                        : pyramid_level_views[level - 1].get(),
+            vk::ImageLayout::eGeneral
+        );
+    }
+    writes.emplace_back(
+        node->desc_set.get(), 1, 0, max_hiz_levels, vk::DescriptorType::eStorageImage, levels
+    );
+
+    writes.emplace_back(
+        node->desc_set.get(),
+        2,
+        0,
+        1,
+        vk::DescriptorType::eCombinedImageSampler,
+        img_infos.alloc(
+            vk::DescriptorImageInfo(sampler.get(), pyramid_view.get(), vk::ImageLayout::eGeneral)
+        )
+    );
+
+    writes.emplace_back(
+        node->desc_set.get(),
+        3,
+        0,
+        1,
+        vk::DescriptorType::eUniformBuffer,
+        nullptr,
+        buf_infos.alloc(vk::DescriptorBufferInfo(
+            r->global_buffers[GLOBAL_BUF_FRAME_UNIFORMS]->buf, 0, sizeof(frame_uniforms)
+        ))
+    );
+
+    size_t storage_buffers[]
+        = {GLOBAL_BUF_CULL_OBJECTS,
+           GLOBAL_BUF_CULL_VISIBILITY,
+           GLOBAL_BUF_CULL_COMMANDS,
+           GLOBAL_BUF_CULL_COUNTS};
+    for(uint32_t i = 0; i < 4; ++i) {
+        writes.emplace_back(
+            node->desc_set.get(),
+            4 + i,
+            0,
+            1,
+            vk::DescriptorType::eStorageBuffer,
+            nullptr,
+            buf_infos.alloc(vk::DescriptorBufferInfo(
+                r->global_buffers[storage_buffers[i]]->buf, 0, VK_WHOLE_SIZE
+            ))
+        );
+    }
+}
+
+void hiz_cull_render_node_prototype::generate_pipelines(
+    renderer* r, render_node* node, vk::RenderPass render_pass, uint32_t subpass
+) {
+    auto create = [&](const char* shader) {
+        return r->dev->create_compute_pipeline(vk::ComputePipelineCreateInfo{
+            {},
+            vk::PipelineShaderStageCreateInfo{
+                {}, vk::ShaderStageFlagBits::eCompute, r->dev->load_shader(shader), "main"},
+            pipeline_layout.get()});
+    };
+    auto* data             = (node_data*)node->data.get();
+    data->build_from_depth = create("hiz-build-depth.comp.spv");
+    data->build            = create("hiz-build.comp.spv");
+    data->cull             = create("hiz-cull.comp.spv");
+}
+
+void hiz_cull_render_node_prototype::prepare(renderer* r) {
+    if(prepared) return;
+    prepared = true;
+
+    // the frame fence has been waited on, so last frame's results are complete. the second phase
+    // is drawn entirely on the GPU, so its draws are only counted here, a frame late
+    last_visible.clear();
+    num_visible = 0;
+    for(size_t i = 0; i < last_objects.size(); ++i) {
+        bool visible                  = mapped_visibility[i] != 0;
+        last_visible[last_objects[i]] = visible;
+        if(!visible) {
+            frame_stats::add(frame_counter::culled_objects);
+            continue;
+        }
+        num_visible++;
+        if(mapped_objects[i].drawn == 0) frame_stats::add_draw(mapped_objects[i].index_count / 3);
+    }
+
+    std::vector<std::tuple<entity_id, const renderable*, const transform*>> objects;
+    r->for_each_renderable([&](auto id, const renderable& rd, const transform& trf) {
+        objects.emplace_back(id, &rd, &trf);
+    });
+    // objects that share buffers are drawn by the same indirect draw
+    std::stable_sort(objects.begin(), objects.end(), [](const auto& a, const auto& b) {
+        return std::less<const buffer*>()(
+            std::get<1>(a)->m->vertex_buffer.get(), std::get<1>(b)->m->vertex_buffer.get()
+        );
+    });
+    if(objects.size() > object_capacity) {
+        // grow the buffers at the next recompile
+        r->should_recompile = true;
+        objects.resize(object_capacity);
+    }
+
+    batches.clear();
+    last_objects.clear();
+    for(uint32_t i = 0; i < objects.size(); ++i) {
+        auto [id, rd, trf] = objects[i];
+        const auto* m      = rd->m.get();
+        if(batches.empty() || batches.back().m->vertex_buffer != m->vertex_buffer) {
+            if(batches.size() == batch_capacity) {
+                r->should_recompile = true;
+                break;
+            }
+            mapped_counts[batches.size()]                  = 0;
+            mapped_counts[batch_capacity + batches.size()] = 0;
+            batches.push_back(cull_batch{m, i, 0});
+        }
+        auto  b     = (uint32_t)batches.size() - 1;
+        auto& batch = batches.back();
+        batch.count++;
+
+        auto seen         = last_visible.find(id);
+        bool drawn        = seen != last_visible.end() && seen->second;
+        mapped_objects[i] = gpu_cull_object{
+            trf->world,
+            vec4(rd->bounds._min, 1.f),
+            vec4(rd->bounds._max, 1.f),
+            m->index_count,
+            m->first_index,
+            m->vertex_offset,
+            rd->mat->_render_index,
+            (uint32_t)batch_capacity + b,
+            (uint32_t)object_capacity + batch.first,
+            drawn ? 1u : 0u,
+            0};
+        if(drawn) {
+            mapped_commands[batch.first + mapped_counts[b]++] = vk::DrawIndexedIndirectCommand{
+                m->index_count, 1, m->first_index, m->vertex_offset, i};
+            frame_stats::add_draw(m->index_count / 3);
+        }
+        last_objects.push_back(id);
+    }
+    num_objects = last_objects.size();
+}
+
+void hiz_cull_render_node_prototype::generate_command_buffer_inline(
+    renderer*          r,
+    render_node*       node,
+    vk::CommandBuffer& cb,
+    size_t             subpass_index,
+    const frame_state& fs
+) {
+    // in case there's no first phase, then get ready for the next frame
+    prepare(r);
+    prepared = false;
+
+    auto depth = node->input_framebuffer(0);
+    if(!depth.has_value() || depth.value() == 0 || num_objects == 0) return;
+
+    auto* data = (node_data*)node->data.get();
+    frame_stats::add(frame_counter::descriptor_binds);
+    cb.bindDescriptorSets(
+        vk::PipelineBindPoint::eCompute, this->pipeline_layout.get(), 0, {node->desc_set.get()}, {}
+    );
+
+    // the pyramid is rebuilt from scratch every frame
+    cb.pipelineBarrier(
+        vk::PipelineStageFlagBits::eComputeShader,
+        vk::PipelineStageFlagBits::eComputeShader,
+        {},
+        {},
+        {},
+        {vk::ImageMemoryBarrier(
+            vk::AccessFlags(),
+            vk::AccessFlagBits::eShaderWrite,
+            vk::ImageLayout::eUndefined,
+            vk::ImageLayout::eGeneral,
+            VK_QUEUE_FAMILY_IGNORED,
+            VK_QUEUE_FAMILY_IGNORED,
+            pyramid->img,
+            vk::ImageSubresourceRange{
+                vk::ImageAspectFlagBits::eColor,
+                0,
+                VK_REMAINING_MIP_LEVELS,
+                0,
+                VK_REMAINING_ARRAY_LAYERS}
+        )}
+    );
+
+    hiz_push_constants pc{0, level_count, (uint32_t)num_objects};
+    uint32_t           w = r->swpc->extent.width, h = r->swpc->extent.height;
+    cb.bindPipeline(vk::PipelineBindPoint::eCompute, data->build_from_depth.get());
+    cb.pushConstants<hiz_push_constants>(
+        this->pipeline_layout.get(), vk::ShaderStageFlagBits::eCompute, 0, {pc}
+    );
+    cb.dispatch(group_count(w, 8), group_count(h, 8), 1);
+
+    // each level reads the one before it
+    cb.bindPipeline(vk::PipelineBindPoint::eCompute, data->build.get());
+    for(pc.level = 1; pc.level < level_count; ++pc.level) {
+        w = std::max(1u, w / 2);
+        h = std::max(1u, h / 2);
+        compute_barrier(cb);
+        cb.pushConstants<hiz_push_constants>(
+            this->pipeline_layout.get(), vk::ShaderStageFlagBits::eCompute, 0, {pc}
+        );
+        cb.dispatch(group_count(w, 8), group_count(h, 8), 1);
+    }
+    compute_barrier(cb);
+
+    cb.bindPipeline(vk::PipelineBindPoint::eCompute, data->cull.get());
+    frame_stats::add(frame_counter::pipeline_binds, 3);
+    cb.dispatch(group_count((uint32_t)num_objects, 64), 1, 1);
+
+    // visibility is read back on the CPU next frame. the second phase's indirect draws are
+    // covered by the memory barrier before the next graphics pass
+    cb.pipelineBarrier(
+        vk::PipelineStageFlagBits::eComputeShader,
+        vk::PipelineStageFlagBits::eHost,
+        {},
+        {vk::MemoryBarrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eHostRead)},
+        {},
+        {}
+    );
+}
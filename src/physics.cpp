@@ -1,4 +1,5 @@
 #include "physics.h"
+#include "frame_stats.h"
 #include "geometry_set.h"
 #include "imgui.h"
 #include "reactphysics3d/mathematics/Vector3.h"
@@ -428,7 +429,8 @@ physics_debug_shape_render_node_prototype::physics_debug_shape_render_node_proto
             + NUM_DEBUG_TRIS * sizeof(DebugRenderer::DebugTriangle),
         vk::BufferUsageFlagBits::eVertexBuffer,
         vk::MemoryPropertyFlagBits::eHostCoherent,
-        (void**)&geo_bufmap
+        (void**)&geo_bufmap,
+        memory_category::mesh
     );
 
     world->setIsDebugRenderingEnabled(true);
@@ -561,7 +563,7 @@ void physics_debug_shape_render_node_prototype::generate_pipelines(
         &multisample_state,
         &depth_stencil_state,
         &color_blending_state,
-        nullptr,
+        &viewport_dynamic_state,
         this->pipeline_layout.get(),
         render_pass,
         subpass
@@ -622,6 +624,10 @@ void physics_debug_shape_render_node_prototype::generate_command_buffer_inline(
             {vec4(1.f, 0.f, 1.f, 1.f)}
         );
         cb.draw(2 * dr.getNbLines(), 1, 0, 0);
+        frame_stats::add(frame_counter::pipeline_binds);
+        frame_stats::add(frame_counter::descriptor_binds);
+        frame_stats::add(frame_counter::buffer_binds);
+        frame_stats::add_draw(0);
     }
 
     if(dr.getNbTriangles() > 0) {
@@ -644,5 +650,9 @@ void physics_debug_shape_render_node_prototype::generate_command_buffer_inline(
             {vec4(0.f, 1.f, 1.f, 1.f)}
         );
         cb.draw(3 * dr.getNbTriangles(), 1, 0, 0);
+        frame_stats::add(frame_counter::pipeline_binds);
+        frame_stats::add(frame_counter::descriptor_binds);
+        frame_stats::add(frame_counter::buffer_binds);
+        frame_stats::add_draw(dr.getNbTriangles());
     }
 }
@@ -0,0 +1,116 @@
+#include "profiler.h"
+#include <mutex>
+
+namespace profiler {
+std::atomic<bool> capturing{false};
+
+namespace {
+struct thread_ring {
+    uint32_t                tid;
+    // only taken while capturing, so that the main thread can read the ring when writing a trace
+    std::mutex              lock;
+    std::vector<zone_event> events;
+    // total number of events recorded in this capture, the ring holds the last `ring_capacity`
+    size_t                  count;
+
+    thread_ring(uint32_t tid) : tid(tid), count(0) {}
+};
+
+// rings are kept after their thread exits so that its events still end up in the trace
+std::mutex                                rings_lock;
+std::vector<std::shared_ptr<thread_ring>> rings;
+
+std::filesystem::path capture_path;
+uint32_t              frames_left = 0;
+uint64_t              capture_start_ns;
+
+thread_ring& local_ring() {
+    thread_local std::shared_ptr<thread_ring> ring = [] {
+        std::lock_guard<std::mutex> lk(rings_lock);
+        auto r = std::make_shared<thread_ring>((uint32_t)rings.size() + 1);
+        rings.push_back(r);
+        return r;
+    }();
+    return *ring;
+}
+}  // namespace
+
+uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()
+    )
+        .count();
+}
+
+void record(std::string_view name, uint64_t start_ns, uint64_t end_ns) {
+    // the capture may have ended while the zone was open
+    if(!is_capturing()) return;
+    auto&                       ring = local_ring();
+    std::lock_guard<std::mutex> lk(ring.lock);
+    // rings only take up memory once a thread has recorded something
+    if(ring.events.empty()) ring.events.resize(ring_capacity);
+    ring.events[ring.count % ring_capacity] = zone_event{name, start_ns, end_ns};
+    ring.count++;
+}
+
+void begin_capture(std::filesystem::path path, uint32_t frames) {
+    if(is_capturing()) return;
+    {
+        std::lock_guard<std::mutex> lk(rings_lock);
+        for(const auto& r : rings) {
+            std::lock_guard<std::mutex> rlk(r->lock);
+            r->count = 0;
+        }
+    }
+    capture_path     = std::move(path);
+    frames_left      = std::max(frames, 1u);
+    capture_start_ns = now_ns();
+    capturing.store(true);
+    std::cout << "profiler: capturing " << frames_left << " frames\n";
+}
+
+void finish_capture() {
+    if(!is_capturing()) return;
+    capturing.store(false);
+    frames_left = 0;
+
+    // trace event format, timestamps are in microseconds
+    json   events = json::array();
+    size_t lost   = 0;
+    {
+        std::lock_guard<std::mutex> lk(rings_lock);
+        for(const auto& r : rings) {
+            std::lock_guard<std::mutex> rlk(r->lock);
+            size_t n = std::min(r->count, ring_capacity);
+            lost += r->count - n;
+            for(size_t i = r->count - n; i < r->count; ++i) {
+                const auto& e = r->events[i % ring_capacity];
+                if(e.start_ns < capture_start_ns) continue;
+                events.push_back(json{
+                    {"name", e.name},
+                    {"ph", "X"},
+                    {"ts", (double)(e.start_ns - capture_start_ns) / 1e3},
+                    {"dur", (double)(e.end_ns - e.start_ns) / 1e3},
+                    {"pid", 1},
+                    {"tid", r->tid}});
+            }
+            r->count = 0;
+        }
+    }
+
+    std::ofstream out(capture_path);
+    if(!out) {
+        std::cout << "profiler: failed to open " << capture_path << "\n";
+        return;
+    }
+    out << json{{"traceEvents", events}, {"displayTimeUnit", "ms"}};
+    std::cout << "profiler: wrote " << events.size() << " zones to " << capture_path;
+    if(lost > 0) std::cout << " (" << lost << " overwritten)";
+    std::cout << "\n";
+}
+
+void end_frame() {
+    if(!is_capturing()) return;
+    if(--frames_left == 0) finish_capture();
+}
+}  // namespace profiler
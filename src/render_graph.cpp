@@ -0,0 +1,810 @@
+#include "render_graph.h"
+#include <set>
+
+render_node::render_node(std::shared_ptr<render_node_prototype> prototype)
+    : visited(false), pass_index(0), subpass_index(-1), desc_set(nullptr), id(rand()),
+      prototype(prototype), inputs(prototype->inputs.size(), {{}, 0}), outputs(prototype->outputs.size(), 0),
+      data(prototype->initialize_node_data()) {}
+
+json render_node::serialize() const {
+    std::vector<json> ser_inputs;
+    for(const auto& [inp_node, inp_ix] : this->inputs) {
+        if(!inp_node.has_value()) {
+            ser_inputs.emplace_back(nullptr);
+        } else {
+            ser_inputs.push_back(json{
+                {"src_node", inp_node->lock()->id},
+                {"src_idx",  inp_ix              }
+            });
+        }
+    }
+    return {
+        {"prototype_id", this->prototype->id()                                          },
+        {"inputs",       ser_inputs                                                     },
+        {"data",         this->data != nullptr ? this->data->serialize() : json(nullptr)}
+    };
+}
+
+// is setting the perserveAttachment counts on the subpasses necessary?
+
+/*
+ * device independent compilation: graph -> compiled_graph
+ *
+ * assign_framebuffer/propagate_blended_framebuffers
+ * generate_attachment_descriptions
+ * generate_subpasses
+ *
+ */
+
+inline vk::Format default_format_for_type(
+    framebuffer_type ty, framebuffer_mode mode, vk::Format swap_chain_format
+) {
+    switch(ty) {
+        case framebuffer_type::color:
+            // the swap chain format usually can't be used for storage images
+            return mode == framebuffer_mode::storage ? vk::Format::eR16G16B16A16Sfloat
+                                                     : swap_chain_format;
+        case framebuffer_type::depth: return vk::Format::eD32Sfloat;
+        case framebuffer_type::depth_stencil: return vk::Format::eD24UnormS8Uint;
+        default: throw;
+    }
+}
+
+// how a node touches a framebuffer during a pass, for generating barriers
+struct framebuffer_access {
+    bool                   write;
+    vk::PipelineStageFlags stage;
+    vk::AccessFlags        access;
+    // the layout the framebuffer must be in, or eUndefined if a render pass transitions it
+    vk::ImageLayout        layout;
+};
+
+// what has happened to a framebuffer in the passes compiled so far
+struct framebuffer_state {
+    vk::ImageLayout        layout = vk::ImageLayout::eUndefined;
+    vk::PipelineStageFlags write_stage, read_stage, synced_stages;
+    vk::AccessFlags        write_access;
+    size_t                 last_pass = 0;
+};
+
+struct graph_compiler {
+    compiled_graph                              g;
+    const std::shared_ptr<render_node>&         output_node;
+    vk::Format                                  swap_chain_format;
+    bool                                        log;
+    std::map<framebuffer_ref, framebuffer_state> state;
+
+    graph_compiler(
+        const std::shared_ptr<render_node>& output_node,
+        vk::Format                          swap_chain_format,
+        framebuffer_ref                     first_ref,
+        bool                                log
+    )
+        : output_node(output_node), swap_chain_format(swap_chain_format), log(log) {
+        g.next_ref = first_ref;
+    }
+
+    framebuffer_ref assign_framebuffer(render_node* node, size_t output_index) {
+        if(node->subpass_count == 0) return 0;
+        const auto& desc   = node->prototype->outputs[output_index];
+        auto        format = desc.format == vk::Format::eUndefined
+                                 ? default_format_for_type(desc.type, desc.mode, swap_chain_format)
+                                 : desc.format;
+        auto        layers
+            = desc.count == framebuffer_count_is_subpass_count ? node->subpass_count : desc.count;
+        framebuffer_ref ref = g.next_ref++;
+        g.framebuffers.emplace_back(compiled_framebuffer{
+            ref,
+            format,
+            desc.type,
+            layers,
+            desc.count > 1,
+            desc.mode == framebuffer_mode::storage,
+            {{node->id, output_index}}
+        });
+        return ref;
+    }
+
+    compiled_framebuffer* find_framebuffer(framebuffer_ref ref) {
+        for(auto& fb : g.framebuffers)
+            if(fb.ref == ref) return &fb;
+        return nullptr;
+    }
+
+    void propagate_blended_framebuffers(const std::shared_ptr<render_node>& node) {
+        for(size_t i = 0; i < node->inputs.size(); ++i) {
+            if(node->input_node(i) != nullptr && node->input_node(i) != output_node)
+                propagate_blended_framebuffers(node->input_node(i));
+            if(node->prototype->inputs[i].mode == framebuffer_mode::blend_input) {
+                if(node->input_node(i) != nullptr) {
+                    node->outputs[i] = node->input_framebuffer(i).value();
+                    auto* fb         = find_framebuffer(node->outputs[i]);
+                    if(fb != nullptr) fb->users.emplace_back(node->id, i);
+                } else {
+                    node->outputs[i] = assign_framebuffer(node.get(), i);
+                }
+            }
+        }
+    }
+
+    // framebuffers that a compute node binds as storage images need the storage usage, even if
+    // they were produced by a graphics node
+    void mark_storage_framebuffers(const std::vector<std::shared_ptr<render_node>>& graph) {
+        for(const auto& node : graph) {
+            for(size_t i = 0; i < node->inputs.size(); ++i) {
+                if(node->prototype->inputs[i].mode != framebuffer_mode::storage) continue;
+                auto fb = node->input_framebuffer(i);
+                if(!fb.has_value()) continue;
+                auto* cfb = find_framebuffer(fb.value());
+                if(cfb != nullptr) cfb->storage = true;
+            }
+        }
+    }
+
+    void order_nodes(const std::shared_ptr<render_node>& node) {
+        if(node->visited) return;
+        node->visited = true;
+        for(const auto& [input_node, input_index] : node->inputs) {
+            if(!input_node.has_value()) continue;
+            order_nodes(input_node->lock());
+        }
+
+        if(node.get() == output_node.get()) {
+            if(log) std::cout << "\toutput node, skipped\n";
+            return;
+        }
+
+        if(node->subpass_count == 0) {
+            if(log)
+                std::cout << "\t" << node->id << ":" << node->prototype->name()
+                          << " subpass count is zero, skipped\n";
+            return;
+        }
+
+        g.subpass_order.push_back(node);
+    }
+
+    // split the node order into passes. a new pass starts whenever the node kind changes, and
+    // whenever a node needs to read a whole framebuffer that was written earlier in the same pass,
+    // which a render pass can only provide through input attachments at the same pixel
+    void split_passes() {
+        std::set<framebuffer_ref> written;
+        for(const auto& node : g.subpass_order) {
+            auto kind  = node->prototype->kind();
+            bool split = g.passes.empty() || g.passes.back().kind != kind;
+            for(size_t i = 0; i < node->inputs.size() && !split; ++i) {
+                auto fb = node->input_framebuffer(i);
+                if(!fb.has_value() || written.find(fb.value()) == written.end()) continue;
+                split = kind == node_kind::compute
+                        || node->prototype->inputs[i].mode == framebuffer_mode::shader_input;
+            }
+            if(split) {
+                compiled_pass pass;
+                pass.kind           = kind;
+                pass.memory_barrier
+                    = !g.passes.empty() && g.passes.back().kind == node_kind::compute;
+                g.passes.emplace_back(std::move(pass));
+                written.clear();
+            }
+            node->pass_index = (uint32_t)g.passes.size() - 1;
+            g.passes.back().nodes.push_back(node);
+            for(auto fb : node->outputs)
+                if(fb != 0) written.insert(fb);
+        }
+    }
+
+    uint32_t layer_count(framebuffer_ref ref) const {
+        const auto* fb = g.framebuffer(ref);
+        return fb == nullptr ? 1 : fb->layers;
+    }
+
+    framebuffer_type type_of(framebuffer_ref ref) const {
+        const auto* fb = g.framebuffer(ref);
+        return fb == nullptr ? framebuffer_type::color : fb->type;
+    }
+
+    // the layout a framebuffer should be left in after pass `pi`, so that the next pass that uses
+    // it doesn't need a transition
+    vk::ImageLayout next_layout(framebuffer_ref ref, size_t pi) const {
+        for(size_t p = pi + 1; p < g.passes.size(); ++p) {
+            for(const auto& node : g.passes[p].nodes) {
+                for(size_t i = 0; i < node->inputs.size(); ++i) {
+                    if(node->input_framebuffer(i) != ref) continue;
+                    return node->prototype->inputs[i].mode == framebuffer_mode::shader_input
+                               ? vk::ImageLayout::eShaderReadOnlyOptimal
+                               : vk::ImageLayout::eGeneral;
+                }
+                for(auto fb : node->outputs)
+                    if(fb == ref) return vk::ImageLayout::eGeneral;
+            }
+        }
+        return vk::ImageLayout::eGeneral;
+    }
+
+    void add_access(
+        std::map<framebuffer_ref, framebuffer_access>& accesses,
+        framebuffer_ref                                ref,
+        framebuffer_access                             a
+    ) {
+        auto ex = accesses.find(ref);
+        if(ex == accesses.end()) {
+            accesses.emplace(ref, a);
+            return;
+        }
+        ex->second.write  = ex->second.write || a.write;
+        ex->second.stage  |= a.stage;
+        ex->second.access |= a.access;
+        if(a.layout != vk::ImageLayout::eUndefined) ex->second.layout = a.layout;
+    }
+
+    std::map<framebuffer_ref, framebuffer_access> collect_accesses(const compiled_pass& pass) {
+        std::map<framebuffer_ref, framebuffer_access> accesses;
+        for(const auto& node : pass.nodes) {
+            for(size_t i = 0; i < node->inputs.size(); ++i) {
+                auto fb = node->input_framebuffer(i);
+                if(!fb.has_value() || fb.value() == 0) continue;
+                auto mode = node->prototype->inputs[i].mode;
+                if(pass.kind == node_kind::compute)
+                    add_access(
+                        accesses,
+                        fb.value(),
+                        {false,
+                         vk::PipelineStageFlagBits::eComputeShader,
+                         vk::AccessFlagBits::eShaderRead,
+                         mode == framebuffer_mode::storage
+                             ? vk::ImageLayout::eGeneral
+                             : vk::ImageLayout::eShaderReadOnlyOptimal}
+                    );
+                else if(mode == framebuffer_mode::shader_input)
+                    add_access(
+                        accesses,
+                        fb.value(),
+                        {false,
+                         vk::PipelineStageFlagBits::eFragmentShader,
+                         vk::AccessFlagBits::eShaderRead,
+                         vk::ImageLayout::eShaderReadOnlyOptimal}
+                    );
+                else if(mode == framebuffer_mode::input_attachment)
+                    add_access(
+                        accesses,
+                        fb.value(),
+                        {false,
+                         vk::PipelineStageFlagBits::eFragmentShader,
+                         vk::AccessFlagBits::eInputAttachmentRead,
+                         vk::ImageLayout::eUndefined}
+                    );
+            }
+            for(auto fb : node->outputs) {
+                if(fb == 0) continue;
+                if(pass.kind == node_kind::compute)
+                    add_access(
+                        accesses,
+                        fb,
+                        {true,
+                         vk::PipelineStageFlagBits::eComputeShader,
+                         vk::AccessFlagBits::eShaderWrite,
+                         vk::ImageLayout::eGeneral}
+                    );
+                else if(type_of(fb) == framebuffer_type::color)
+                    add_access(
+                        accesses,
+                        fb,
+                        {true,
+                         vk::PipelineStageFlagBits::eColorAttachmentOutput,
+                         vk::AccessFlagBits::eColorAttachmentRead
+                             | vk::AccessFlagBits::eColorAttachmentWrite,
+                         vk::ImageLayout::eUndefined}
+                    );
+                else
+                    add_access(
+                        accesses,
+                        fb,
+                        {true,
+                         vk::PipelineStageFlagBits::eEarlyFragmentTests
+                             | vk::PipelineStageFlagBits::eLateFragmentTests,
+                         vk::AccessFlagBits::eDepthStencilAttachmentRead
+                             | vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+                         vk::ImageLayout::eUndefined}
+                    );
+            }
+        }
+        return accesses;
+    }
+
+    // generate the barriers needed before pass `pi`, given everything that happened before it
+    void generate_barriers(size_t pi) {
+        auto& pass = g.passes[pi];
+        for(const auto& [ref, a] : collect_accesses(pass)) {
+            auto& st = state[ref];
+            // render passes do their own layout transitions for attachments
+            auto new_layout = a.layout == vk::ImageLayout::eUndefined ? st.layout : a.layout;
+            bool transition = new_layout != st.layout;
+            bool touched    = st.write_stage || st.read_stage;
+            bool needed = transition || (touched && (a.write || !(st.synced_stages & a.stage)));
+            if(needed) {
+                // write-after-read and layout transitions also have to wait for earlier reads
+                auto src_stage = st.write_stage;
+                if(a.write || transition) src_stage |= st.read_stage;
+                pass.barriers.emplace_back(compiled_barrier{
+                    ref,
+                    st.layout,
+                    new_layout,
+                    src_stage ? src_stage : vk::PipelineStageFlagBits::eTopOfPipe,
+                    a.stage,
+                    st.write_access,
+                    a.access});
+            }
+            if(a.write) {
+                st.write_stage   = a.stage;
+                st.write_access  = a.access;
+                st.read_stage    = vk::PipelineStageFlags();
+                st.synced_stages = vk::PipelineStageFlags();
+            } else {
+                st.read_stage    |= a.stage;
+                st.synced_stages |= a.stage;
+            }
+            st.layout = new_layout;
+        }
+    }
+
+    // every framebuffer that is bound as an attachment somewhere in a graphics pass
+    std::set<framebuffer_ref> attachment_framebuffers(const compiled_pass& pass) const {
+        std::set<framebuffer_ref> used;
+        for(const auto& node : pass.nodes) {
+            for(auto fb : node->outputs)
+                if(fb != 0) used.insert(fb);
+            for(size_t i = 0; i < node->inputs.size(); ++i) {
+                auto fb = node->input_framebuffer(i);
+                if(fb.has_value() && fb.value() != 0
+                   && node->prototype->inputs[i].mode == framebuffer_mode::input_attachment)
+                    used.insert(fb.value());
+            }
+        }
+        return used;
+    }
+
+    // if an earlier pass already rendered to the swap chain image, it can't be transitioned for
+    // presentation until the last pass that renders to it
+    void keep_swap_chain_image(size_t pi) {
+        auto& st = state[swap_chain_framebuffer];
+        if(st.layout == vk::ImageLayout::eUndefined) return;
+        if(attachment_framebuffers(g.passes[pi]).count(swap_chain_framebuffer) == 0) return;
+        auto& prev = g.passes[st.last_pass];
+        prev.attachments[prev.attachment_refs.at(swap_chain_framebuffer)].finalLayout
+            = vk::ImageLayout::eColorAttachmentOptimal;
+        st.layout = vk::ImageLayout::eColorAttachmentOptimal;
+    }
+
+    void generate_attachment_descriptions(size_t pi) {
+        auto& pass = g.passes[pi];
+        for(auto ref : attachment_framebuffers(pass)) {
+            auto& st           = state[ref];
+            bool  touched      = st.layout != vk::ImageLayout::eUndefined;
+            auto  final_layout = ref == swap_chain_framebuffer ? vk::ImageLayout::ePresentSrcKHR
+                                                              : next_layout(ref, pi);
+            pass.attachment_refs[ref] = (uint32_t)pass.attachments.size();
+            for(size_t i = 0; i < layer_count(ref); ++i) {
+                pass.attachments.emplace_back(
+                    vk::AttachmentDescriptionFlags(),
+                    ref == swap_chain_framebuffer ? swap_chain_format
+                                                  : g.framebuffer(ref)->format,
+                    vk::SampleCountFlagBits::e1,
+                    touched ? vk::AttachmentLoadOp::eLoad : vk::AttachmentLoadOp::eClear,
+                    vk::AttachmentStoreOp::eStore,
+                    vk::AttachmentLoadOp::eDontCare,
+                    vk::AttachmentStoreOp::eDontCare,
+                    st.layout,
+                    final_layout
+                );
+            }
+        }
+    }
+
+    void finish_pass(size_t pi) {
+        auto& pass = g.passes[pi];
+        if(pass.kind == node_kind::compute) {
+            for(const auto& [ref, a] : collect_accesses(pass))
+                state[ref].last_pass = pi;
+            return;
+        }
+        for(const auto& [ref, ai] : pass.attachment_refs) {
+            state[ref].layout    = pass.attachments[ai].finalLayout;
+            state[ref].last_pass = pi;
+        }
+    }
+
+    void make_attachment_ref(
+        const compiled_pass&                  pass,
+        std::vector<vk::AttachmentReference>& output,
+        framebuffer_ref                       fb,
+        const framebuffer_desc&               fb_desc,
+        uint32_t                              rep_index,
+        vk::ImageLayout                       layout
+    ) {
+        if(fb_desc.subpass_binding_order == framebuffer_subpass_binding_order::parallel) {
+            for(uint32_t ai = 0; ai < layer_count(fb); ++ai)
+                output.emplace_back(pass.attachment_refs.at(fb) + ai, layout);
+        } else if(fb_desc.subpass_binding_order == framebuffer_subpass_binding_order::sequential) {
+            output.emplace_back(pass.attachment_refs.at(fb) + rep_index, layout);
+        }
+    }
+
+    void make_node_subpass_input_attachments(
+        const compiled_pass& pass, compiled_subpass& subpass, render_node* node
+    ) {
+        for(size_t i = 0; i < node->inputs.size(); ++i) {
+            const auto& input = node->prototype->inputs[i];
+            // skip blend fbs since they only need output attachment
+            if(input.mode != framebuffer_mode::input_attachment) continue;
+            auto fb = node->input_framebuffer(i);
+            if(!fb.has_value() || fb.value() == 0) {
+                // keep the input attachment indices stable for the shader even if unconnected
+                auto count
+                    = input.subpass_binding_order == framebuffer_subpass_binding_order::parallel
+                          ? input.count
+                          : 1;
+                for(uint32_t ai = 0; ai < count; ++ai)
+                    subpass.input_attachments.emplace_back(VK_ATTACHMENT_UNUSED);
+                continue;
+            }
+            make_attachment_ref(
+                pass,
+                subpass.input_attachments,
+                fb.value(),
+                input,
+                subpass.rep_index,
+                vk::ImageLayout::eShaderReadOnlyOptimal
+            );
+        }
+    }
+
+    void make_node_subpass_color_attachments(
+        const compiled_pass& pass, compiled_subpass& subpass, render_node* node
+    ) {
+        for(size_t i = 0; i < node->prototype->outputs.size(); ++i) {
+            const auto& output = node->prototype->outputs[i];
+            if(output.type == framebuffer_type::color && node->outputs[i] != 0) {
+                make_attachment_ref(
+                    pass,
+                    subpass.color_attachments,
+                    node->outputs[i],
+                    output,
+                    subpass.rep_index,
+                    vk::ImageLayout::eColorAttachmentOptimal
+                );
+            }
+        }
+    }
+
+    void make_node_subpass_depth_attachment(
+        const compiled_pass& pass, compiled_subpass& subpass, render_node* node
+    ) {
+        for(size_t i = 0; i < node->prototype->outputs.size(); ++i) {
+            if((node->prototype->outputs[i].type == framebuffer_type::depth
+                || node->prototype->outputs[i].type == framebuffer_type::depth_stencil)
+               && node->outputs[i] != 0) {
+                uint32_t offset = 0;
+                if(layer_count(node->outputs[i]) > 1) {
+                    if(node->prototype->outputs[i].subpass_binding_order
+                       == framebuffer_subpass_binding_order::sequential)
+                        offset = subpass.rep_index;
+                    else
+                        // can't render to multiple depth buffers in parallel, at least for now
+                        throw;
+                }
+                subpass.depth_attachment = vk::AttachmentReference{
+                    pass.attachment_refs.at(node->outputs[i]) + offset,
+                    vk::ImageLayout::eDepthStencilAttachmentOptimal};
+                break;  // only one is possible
+            }
+        }
+    }
+
+    void emit_node_subpass_dependencies(
+        compiled_pass& pass, render_node* node, uint32_t rep_index
+    ) {
+        // see: https://developer.samsung.com/galaxy-gamedev/resources/articles/renderpasses.html
+        // assuming that we are always consuming inputs in fragment shaders
+        // TODO: create dependencies between repeated subpasses?
+        for(size_t i = 0; i < node->inputs.size(); ++i) {
+            auto input_node = node->input_node(i);
+            if(input_node == nullptr) continue;
+            if(input_node == output_node) continue;       // screen output node
+            if(input_node->subpass_count == 0) continue;  // subpass isn't actually happening
+            // inputs from earlier passes are synchronized with barriers instead
+            if(std::find(pass.nodes.begin(), pass.nodes.end(), input_node) == pass.nodes.end())
+                continue;
+            const auto& fb_desc = input_node->prototype->outputs[node->inputs[i].second];
+
+            auto from_subpass = input_node->subpass_index + input_node->subpass_count - 1;
+            auto to_subpass   = node->subpass_index + rep_index;
+
+            if(node->prototype->inputs[i].mode == framebuffer_mode::blend_input) {
+                // blending onto the previous contents of the attachment
+                pass.dependencies.emplace_back(
+                    from_subpass,
+                    to_subpass,
+                    vk::PipelineStageFlagBits::eColorAttachmentOutput,
+                    vk::PipelineStageFlagBits::eColorAttachmentOutput,
+                    vk::AccessFlagBits::eColorAttachmentWrite,
+                    vk::AccessFlagBits::eColorAttachmentRead
+                        | vk::AccessFlagBits::eColorAttachmentWrite,
+                    vk::DependencyFlagBits::eByRegion
+                );
+            } else if(fb_desc.type == framebuffer_type::color) {
+                pass.dependencies.emplace_back(
+                    from_subpass,
+                    to_subpass,
+                    vk::PipelineStageFlagBits::eColorAttachmentOutput,
+                    vk::PipelineStageFlagBits::eFragmentShader,
+                    vk::AccessFlagBits::eColorAttachmentWrite,
+                    vk::AccessFlagBits::eInputAttachmentRead,
+                    vk::DependencyFlagBits::eByRegion
+                );
+            } else if(fb_desc.type == framebuffer_type::depth || fb_desc.type == framebuffer_type::depth_stencil) {
+                pass.dependencies.emplace_back(
+                    from_subpass,
+                    to_subpass,
+                    vk::PipelineStageFlagBits::eLateFragmentTests,
+                    vk::PipelineStageFlagBits::eFragmentShader,
+                    vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+                    vk::AccessFlagBits::eInputAttachmentRead,
+                    vk::DependencyFlagBits::eByRegion
+                );
+            }
+        }
+    }
+
+    void generate_subpasses(size_t pi) {
+        auto& pass = g.passes[pi];
+        for(const auto& node : pass.nodes) {
+            node->subpass_index = (uint32_t)pass.subpasses.size();
+            if(log)
+                std::cout << "\tassigning " << node->id << ":" << node->prototype->name()
+                          << " subpass index #" << pi << "." << node->subpass_index << " x "
+                          << node->subpass_count << "\n";
+
+            for(uint32_t rep_index = 0; rep_index < node->subpass_count; ++rep_index) {
+                compiled_subpass subpass{node, rep_index};
+                make_node_subpass_input_attachments(pass, subpass, node.get());
+                make_node_subpass_color_attachments(pass, subpass, node.get());
+                make_node_subpass_depth_attachment(pass, subpass, node.get());
+                pass.subpasses.emplace_back(std::move(subpass));
+
+                emit_node_subpass_dependencies(pass, node.get(), rep_index);
+            }
+        }
+    }
+
+    void generate_passes() {
+        for(size_t pi = 0; pi < g.passes.size(); ++pi) {
+            auto& pass = g.passes[pi];
+            if(log)
+                std::cout << "pass #" << pi << " ("
+                          << (pass.kind == node_kind::compute ? "compute" : "graphics") << ")\n";
+            if(pass.kind == node_kind::graphics) keep_swap_chain_image(pi);
+            generate_barriers(pi);
+            if(pass.kind == node_kind::graphics) {
+                generate_attachment_descriptions(pi);
+                generate_subpasses(pi);
+            } else {
+                for(const auto& node : pass.nodes)
+                    node->subpass_index = 0;
+            }
+            finish_pass(pi);
+        }
+
+        auto& swpc_state = state[swap_chain_framebuffer];
+        if(swpc_state.layout == vk::ImageLayout::eUndefined)
+            g.final_barriers.emplace_back(compiled_barrier{
+                swap_chain_framebuffer,
+                vk::ImageLayout::eUndefined,
+                vk::ImageLayout::ePresentSrcKHR,
+                vk::PipelineStageFlagBits::eTopOfPipe,
+                vk::PipelineStageFlagBits::eBottomOfPipe,
+                vk::AccessFlags(),
+                vk::AccessFlags()});
+    }
+};
+
+compiled_graph compile_graph(
+    const std::vector<std::shared_ptr<render_node>>& graph,
+    const std::shared_ptr<render_node>&              output_node,
+    vk::Format                                       swap_chain_format,
+    framebuffer_ref                                  first_ref,
+    bool                                             log
+) {
+    graph_compiler c{output_node, swap_chain_format, first_ref, log};
+
+    for(auto& n : graph) {
+        n->visited = false;
+        for(auto& ou : n->outputs)
+            ou = 0;
+    }
+
+    // assign framebuffers to each node - for now nothing fancy, just give each output its own
+    // buffer assign the actual screen backbuffers
+    auto& [color_src_node, color_src_ix] = output_node->inputs[0];
+    if(color_src_node.has_value()) {
+        auto color_src                   = color_src_node->lock();
+        color_src->outputs[color_src_ix] = swap_chain_framebuffer;
+    }
+    output_node->outputs[0] = swap_chain_framebuffer;
+    for(auto& node : graph) {
+        for(size_t i = 0; i < node->outputs.size(); ++i) {
+            // assign a new framebuffer to each output that is unassigned and not a blend input
+            if(node->outputs[i] == 0
+               && !(
+                   i < node->prototype->inputs.size()
+                   && node->prototype->inputs[i].mode == framebuffer_mode::blend_input
+               ))
+                node->outputs[i] = c.assign_framebuffer(node.get(), i);
+        }
+    }
+    // copy blend mode framebuffers so that nodes that take a blend mode framebuffer also output to
+    // the same framebuffer
+    c.propagate_blended_framebuffers(output_node);
+    c.mark_storage_framebuffers(graph);
+
+    // find an order for the nodes, then split that into render passes and compute passes
+    c.order_nodes(output_node);
+    c.split_passes();
+
+    // collect all subpasses and generate subpass dependencies and barriers between passes
+    c.generate_passes();
+
+    if(log) {
+        for(size_t pi = 0; pi < c.g.passes.size(); ++pi) {
+            const auto& pass = c.g.passes[pi];
+            std::cout << "pass #" << pi << " dependencies:\n";
+            for(size_t i = 0; i < pass.dependencies.size(); ++i) {
+                auto& d = pass.dependencies[i];
+                std::cout << i << ": src=" << d.srcSubpass << " dst=" << d.dstSubpass << "\n";
+            }
+            std::cout << "pass #" << pi << " barriers:\n";
+            for(const auto& b : pass.barriers)
+                std::cout << "fb " << b.fb << ": " << vk::to_string(b.old_layout) << " -> "
+                          << vk::to_string(b.new_layout) << "\n";
+        }
+        std::cout << "----------------------\n";
+    }
+
+    return std::move(c.g);
+}
+
+std::vector<vk::SubpassDescription> compiled_pass::subpass_descriptions() const {
+    std::vector<vk::SubpassDescription> desc;
+    desc.reserve(subpasses.size());
+    for(const auto& s : subpasses) {
+        desc.emplace_back(
+            vk::SubpassDescriptionFlags(),
+            vk::PipelineBindPoint::eGraphics,
+            (uint32_t)s.input_attachments.size(),
+            s.input_attachments.data(),
+            (uint32_t)s.color_attachments.size(),
+            s.color_attachments.data(),
+            nullptr,
+            s.depth_attachment.has_value() ? &s.depth_attachment.value() : nullptr
+        );
+    }
+    return desc;
+}
+
+const compiled_framebuffer* compiled_graph::framebuffer(framebuffer_ref ref) const {
+    for(const auto& fb : framebuffers)
+        if(fb.ref == ref) return &fb;
+    return nullptr;
+}
+
+size_t compiled_graph::subpass_count() const {
+    size_t count = 0;
+    for(const auto& pass : passes)
+        count += pass.subpasses.size();
+    return count;
+}
+
+std::vector<std::string> compiled_graph::validate() const {
+    std::vector<std::string> errors;
+    for(size_t pi = 0; pi < passes.size(); ++pi) {
+        const auto& pass      = passes[pi];
+        auto        pass_name = "pass " + std::to_string(pi);
+        auto        check_ref = [&](size_t si, const vk::AttachmentReference& r) {
+            if(r.attachment != VK_ATTACHMENT_UNUSED && r.attachment >= pass.attachments.size())
+                errors.emplace_back(
+                    pass_name + " subpass " + std::to_string(si) + " references attachment "
+                    + std::to_string(r.attachment) + " which is out of bounds"
+                );
+        };
+        for(size_t si = 0; si < pass.subpasses.size(); ++si) {
+            const auto& s = pass.subpasses[si];
+            for(const auto& r : s.input_attachments)
+                check_ref(si, r);
+            for(const auto& r : s.color_attachments)
+                check_ref(si, r);
+            if(s.depth_attachment.has_value()) check_ref(si, s.depth_attachment.value());
+        }
+
+        for(const auto& d : pass.dependencies) {
+            if(d.srcSubpass == VK_SUBPASS_EXTERNAL || d.dstSubpass == VK_SUBPASS_EXTERNAL)
+                continue;
+            if(d.srcSubpass >= pass.subpasses.size() || d.dstSubpass >= pass.subpasses.size())
+                errors.emplace_back(
+                    pass_name + " dependency " + std::to_string(d.srcSubpass) + " -> "
+                    + std::to_string(d.dstSubpass) + " is out of bounds"
+                );
+            else if(d.srcSubpass > d.dstSubpass)
+                errors.emplace_back(
+                    pass_name + " dependency " + std::to_string(d.srcSubpass) + " -> "
+                    + std::to_string(d.dstSubpass) + " goes backwards"
+                );
+        }
+
+        for(const auto& node : pass.nodes) {
+            auto node_name = pass_name + " node " + std::to_string(node->id) + " ("
+                             + node->prototype->name() + ")";
+            if(pass.kind == node_kind::compute) {
+                for(auto fb : node->outputs)
+                    if(fb == swap_chain_framebuffer)
+                        errors.emplace_back(node_name + " writes to the swap chain from compute");
+            } else {
+                for(auto fb : node->outputs)
+                    if(fb != 0 && pass.attachment_refs.find(fb) == pass.attachment_refs.end())
+                        errors.emplace_back(
+                            node_name + " writes to framebuffer " + std::to_string(fb)
+                            + " which has no attachment"
+                        );
+            }
+
+            for(size_t i = 0; i < node->inputs.size(); ++i) {
+                auto input_node = node->input_node(i);
+                if(input_node == nullptr || input_node->subpass_count == 0) continue;
+                if(std::find(subpass_order.begin(), subpass_order.end(), input_node)
+                   == subpass_order.end())
+                    continue;
+                auto fb = node->input_framebuffer(i).value();
+                if(fb == 0) continue;
+                if(input_node->pass_index == pi) {
+                    // every subpass that reads from a node in the same pass must depend on that
+                    // node's last subpass
+                    uint32_t from = input_node->subpass_index + input_node->subpass_count - 1;
+                    bool     found
+                        = pass.kind == node_kind::graphics
+                          && std::any_of(
+                              pass.dependencies.begin(),
+                              pass.dependencies.end(),
+                              [&](const auto& d) {
+                                  return d.srcSubpass == from
+                                         && d.dstSubpass == node->subpass_index;
+                              }
+                          );
+                    if(!found)
+                        errors.emplace_back(
+                            node_name + " reads input " + std::to_string(i) + " from subpass "
+                            + std::to_string(from) + " without a dependency"
+                        );
+                } else if(input_node->pass_index > pi) {
+                    errors.emplace_back(
+                        node_name + " reads input " + std::to_string(i) + " from a later pass"
+                    );
+                } else {
+                    // reads of framebuffers from earlier passes must be covered by a barrier
+                    bool found = false;
+                    for(size_t p = input_node->pass_index + 1; p <= pi && !found; ++p)
+                        found = std::any_of(
+                            passes[p].barriers.begin(),
+                            passes[p].barriers.end(),
+                            [&](const auto& b) { return b.fb == fb; }
+                        );
+                    if(!found)
+                        errors.emplace_back(
+                            node_name + " reads framebuffer " + std::to_string(fb)
+                            + " from pass " + std::to_string(input_node->pass_index)
+                            + " without a barrier"
+                        );
+                }
+            }
+        }
+    }
+
+    return errors;
+}
@@ -1,17 +1,15 @@
 #include "renderer.h"
 #include "debug_shapes.h"
+#include "frame_stats.h"
 #include "imgui.h"
 #include "imgui_impl_vulkan.h"
 #include "imnodes.h"
+#include "profiler.h"
 #include "renderer_basic_nodes.h"
 #include <iomanip>
 
-render_node::render_node(std::shared_ptr<render_node_prototype> prototype)
-    : visited(false), subpass_index(-1), desc_set(nullptr), id(rand()), prototype(prototype),
-      inputs(prototype->inputs.size(), {{}, 0}), outputs(prototype->outputs.size(), 0),
-      data(prototype->initialize_node_data()) {}
-
-render_node::render_node(renderer* r, size_t id, json data) : subpass_index(123456789), id(id) {
+render_node::render_node(renderer* r, size_t id, json data)
+    : pass_index(0), subpass_index(123456789), id(id) {
     auto prototype_id = data.at("prototype_id").get<int>();
     auto prototypep   = std::find_if(r->prototypes.begin(), r->prototypes.end(), [&](auto p) {
         return p->id() == prototype_id;
@@ -31,30 +29,24 @@ render_node::render_node(renderer* r, size_t id, json data) : subpass_index(1234
     this->data = prototype->deserialize_node_data(data.at("data"));
 }
 
-json render_node::serialize() const {
-    std::cout << "a\n";
-    std::vector<json> ser_inputs;
-    for(const auto& [inp_node, inp_ix] : this->inputs) {
-        if(!inp_node.has_value()) {
-            ser_inputs.emplace_back(nullptr);
-        } else {
-            ser_inputs.push_back(json{
-                {"src_node", inp_node->lock()->id},
-                {"src_idx",  inp_ix              }
-            });
-        }
-    }
-    std::cout << "b\n";
-    return {
-        {"prototype_id", this->prototype->id()                                          },
-        {"inputs",       ser_inputs                                                     },
-        {"data",         this->data != nullptr ? this->data->serialize() : json(nullptr)}
-    };
-}
-
 renderer::renderer(const std::shared_ptr<world>& w)
     : entity_system<renderable>(w), dev(nullptr), next_id(10), desc_pool(nullptr), num_gpu_mats(0),
-      should_recompile(false), log_compile(true), show_shapes(true) {}
+      compile_duration(0.f), should_recompile(false), log_compile(true), show_shapes(true) {}
+
+gpu_memory_stats::gpu_memory_stats(device* dev) : usage(0.f), budget(0.f) {
+    const float mib = 1024.f * 1024.f;
+    framebuffer     = (float)dev->category_bytes[(size_t)memory_category::framebuffer] / mib;
+    mesh            = (float)dev->category_bytes[(size_t)memory_category::mesh] / mib;
+    texture         = (float)dev->category_bytes[(size_t)memory_category::texture] / mib;
+    uniform         = (float)dev->category_bytes[(size_t)memory_category::uniform] / mib;
+    staging         = (float)dev->category_bytes[(size_t)memory_category::staging] / mib;
+    other           = (float)dev->category_bytes[(size_t)memory_category::other] / mib;
+    for(const auto& h : dev->heap_stats()) {
+        if(!h.device_local) continue;
+        usage += (float)h.usage / mib;
+        budget += (float)h.budget / mib;
+    }
+}
 
 void renderer::init(device* _dev) {
     this->dev                                 = _dev;
@@ -64,37 +56,75 @@ void renderer::init(device* _dev) {
         sizeof(frame_uniforms),
         vk::BufferUsageFlagBits::eUniformBuffer,
         vk::MemoryPropertyFlagBits::eHostCoherent,
-        (void**)&mapped_frame_uniforms
+        (void**)&mapped_frame_uniforms,
+        memory_category::uniform
     );
 
-    material_desc_set_layout = dev->create_desc_set_layout({vk::DescriptorSetLayoutBinding(
-        0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eAllGraphics
-    )});
+    // textures are added to the array while it is bound, and most of it stays empty
+    vk::DescriptorBindingFlags texture_binding_flags
+        = vk::DescriptorBindingFlagBits::ePartiallyBound
+          | vk::DescriptorBindingFlagBits::eUpdateAfterBind;
+    vk::DescriptorSetLayoutBindingFlagsCreateInfo texture_binding_flags_info{
+        1, &texture_binding_flags};
+    vk::DescriptorSetLayoutBinding texture_binding(
+        0,
+        vk::DescriptorType::eCombinedImageSampler,
+        max_bindless_textures,
+        vk::ShaderStageFlagBits::eAllGraphics
+    );
+    texture_desc_set_layout
+        = dev->dev->createDescriptorSetLayoutUnique(vk::DescriptorSetLayoutCreateInfo{
+            vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool,
+            1,
+            &texture_binding,
+            &texture_binding_flags_info});
+    vk::DescriptorPoolSize texture_pool_size{
+        vk::DescriptorType::eCombinedImageSampler, max_bindless_textures};
+    texture_desc_pool = dev->dev->createDescriptorPoolUnique(vk::DescriptorPoolCreateInfo{
+        vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind, 1, 1, &texture_pool_size});
+    texture_desc_set = dev->dev->allocateDescriptorSets(vk::DescriptorSetAllocateInfo{
+        texture_desc_pool.get(), 1, &texture_desc_set_layout.get()})[0];
+    next_texture_index = 0;
 
     texture_sampler = dev->dev->createSamplerUnique(vk::SamplerCreateInfo{
         {},
         vk::Filter::eNearest,
         vk::Filter::eNearest,
-        vk::SamplerMipmapMode::eNearest,
+        vk::SamplerMipmapMode::eLinear,
         vk::SamplerAddressMode::eRepeat,
         vk::SamplerAddressMode::eRepeat,
         vk::SamplerAddressMode::eRepeat,
         0.f,
         true,
-        16.f});
+        16.f,
+        false,
+        vk::CompareOp::eNever,
+        0.f,
+        VK_LOD_CLAMP_NONE});
+
+    // queues without valid timestamp bits can't be profiled
+    auto timestamp_bits
+        = dev->pdevice.getQueueFamilyProperties()[dev->qu_fam.graphics].timestampValidBits;
+    timestamp_period = dev->pdevice.getProperties().limits.timestampPeriod;
+    timestamp_mask   = timestamp_bits >= 64 ? ~0ull : (1ull << timestamp_bits) - 1;
+    frame_gpu_ms     = 0.f;
+    if(timestamp_bits > 0) {
+        timestamp_pool = dev->dev->createQueryPoolUnique(vk::QueryPoolCreateInfo{
+            {}, vk::QueryType::eTimestamp, 2 * max_timed_nodes});
+    }
 
     uint32 nil_tex_data = 0xffff'ffff;
-    auto   uplcb        = dev->alloc_tmp_cmd_buffer();
-    uplcb.begin(vk::CommandBufferBeginInfo{vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
-    create_texture2d("nil", 1, 1, vk::Format::eR8G8B8A8Unorm, 4, &nil_tex_data, uplcb);
-    uplcb.end();
-    dev->graphics_qu.submit({vk::SubmitInfo(0, nullptr, nullptr, 1, &uplcb)}, nullptr);
+    create_texture2d("nil", 1, 1, vk::Format::eR8G8B8A8Unorm, 4, &nil_tex_data);
 
     prototypes
         = {std::make_shared<output_render_node_prototype>(),
            std::make_shared<simple_geom_render_node_prototype>(this, dev),
            std::make_shared<color_preview_render_node_prototype>(),
-           std::make_shared<debug_shape_render_node_prototype>(dev)};
+           std::make_shared<debug_shape_render_node_prototype>(dev),
+           std::make_shared<upscale_render_node_prototype>(dev)};
+
+    // the nil texture and debug shape meshes are used without checking if they are ready
+    dev->uploads->wait(dev->uploads->submit());
 
     this->load_initial_render_graph();
 }
@@ -111,24 +141,27 @@ void renderer::load_initial_render_graph() {
     // TODO: get rid of silly cycles required for blending
 }
 
-void renderer::create_swapchain_dependencies(swap_chain* swpc) {
-    /* std::cout << "renderer::create_swapchain_dependencies\n"; */
+void renderer::use_swap_chain(swap_chain* swpc) {
     this->swpc    = swpc;
     full_viewport = vk::Viewport(
         0, 0, (float)this->swpc->extent.width, (float)this->swpc->extent.height, 0.f, 1.f
     );
-    full_scissor = vk::Rect2D({}, this->swpc->extent);
+    full_scissor    = vk::Rect2D({}, this->swpc->extent);
+    render_viewport = full_viewport;
+    render_scissor  = full_scissor;
+}
+
+void renderer::create_swapchain_dependencies(swap_chain* swpc) {
+    /* std::cout << "renderer::create_swapchain_dependencies\n"; */
+    use_swap_chain(swpc);
     buffers.clear();
     this->compile_render_graph();
 }
 
 json renderer::serialize_render_graph() {
     json nodes;
-    for(const auto& n : render_graph) {
-        std::cout << n->id << "\n";
+    for(const auto& n : render_graph)
         nodes[std::to_string(n->id)] = n->serialize();
-        std::cout << nodes << "\n\n";
-    }
     return json{
         {"nodes",    nodes                                       },
         {"ui_state", ImNodes::SaveCurrentEditorStateToIniString()}
@@ -147,8 +180,9 @@ void renderer::deserialize_render_graph(const json& data) {
             return n->id == idn;
         });
         auto inputs = node_data.at("inputs");
-        assert(inputs.size() == node->prototype->inputs.size());
-        for(size_t i = 0; i < node->prototype->inputs.size(); ++i) {
+        // graphs saved before a prototype gained an input have fewer inputs
+        assert(inputs.size() <= node->prototype->inputs.size());
+        for(size_t i = 0; i < inputs.size(); ++i) {
             if(inputs[i].is_null()) continue;
             auto src_id     = inputs[i].at("src_node").get<size_t>();
             auto src        = *std::find_if(render_graph.begin(), render_graph.end(), [&](auto n) {
@@ -211,90 +245,63 @@ gpu_texture& renderer::create_texture2d(
     uint32_t           height,
     vk::Format         fmt,
     size_t             data_size,
-    void*              data,
-    vk::CommandBuffer  uplcb
+    void*              data
 ) {
     auto existing_texture = texture_cache.find(name);
     if(existing_texture != texture_cache.end()) return existing_texture->second;
 
-    auto staging_buffer = std::make_unique<buffer>(
-        dev,
-        data_size,
-        vk::BufferUsageFlagBits::eTransferSrc,
-        vk::MemoryPropertyFlagBits::eHostVisible
-    );
-    memcpy(staging_buffer->map(), data, data_size);
-    staging_buffer->unmap();
+    auto staging = dev->uploads->stage(data_size);
+    memcpy(staging.mapped, data, data_size);
+    uint32_t            mips = dev->uploads->mip_count(fmt, width, height);
     vk::UniqueImageView img_view;
-    auto subresource_range = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
-    auto img               = std::make_shared<image>(
+    auto subresource_range
+        = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, mips, 0, 1);
+    auto img = std::make_shared<image>(
         dev,
+        vk::ImageCreateFlags(),
         vk::ImageType::e2D,
         vk::Extent3D(width, height, 1),
         fmt,
         vk::ImageTiling::eOptimal,
-        vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
+        vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst
+            | vk::ImageUsageFlagBits::eSampled,
         vk::MemoryPropertyFlagBits::eDeviceLocal,
+        mips,
+        1,
         &img_view,
         vk::ImageViewType::e2D,
-        subresource_range
+        subresource_range,
+        memory_category::texture
     );
-    uplcb.pipelineBarrier(
-        vk::PipelineStageFlagBits::eTransfer,
-        vk::PipelineStageFlagBits::eTransfer,
-        {},
-        {},
-        {},
-        {vk::ImageMemoryBarrier(
-            {},
-            vk::AccessFlagBits::eTransferWrite,
-            vk::ImageLayout::eUndefined,
-            vk::ImageLayout::eTransferDstOptimal,
-            VK_QUEUE_FAMILY_IGNORED,
-            VK_QUEUE_FAMILY_IGNORED,
-            img->img,
-            subresource_range
-        )}
+    dev->uploads->copy_to_image(staging, img, width, height);
+
+    // give the texture a slot in the bindless array
+    if(next_texture_index == max_bindless_textures)
+        throw std::runtime_error("ran out of bindless texture slots loading " + name);
+    uint32_t                index = next_texture_index++;
+    vk::DescriptorImageInfo info{
+        texture_sampler.get(), img_view.get(), vk::ImageLayout::eShaderReadOnlyOptimal};
+    dev->dev->updateDescriptorSets(
+        {vk::WriteDescriptorSet{
+            texture_desc_set, 0, index, 1, vk::DescriptorType::eCombinedImageSampler, &info}},
+        {}
     );
-    uplcb.copyBufferToImage(
-        staging_buffer->buf,
-        img->img,
-        vk::ImageLayout::eTransferDstOptimal,
-        {
-            vk::BufferImageCopy{
-                                0, 0,
-                                0, vk::ImageSubresourceLayers{vk::ImageAspectFlagBits::eColor, 0, 0, 1},
-                                {0, 0, 0},
-                                {(uint32_t)width, (uint32_t)height, 1}}
-    }
-    );
-    uplcb.pipelineBarrier(
-        vk::PipelineStageFlagBits::eTransfer,
-        vk::PipelineStageFlagBits::eFragmentShader,
-        {},
-        {},
-        {},
-        {vk::ImageMemoryBarrier(
-            vk::AccessFlagBits::eTransferWrite,
-            vk::AccessFlagBits::eShaderRead,
-            vk::ImageLayout::eTransferDstOptimal,
-            vk::ImageLayout::eShaderReadOnlyOptimal,
-            VK_QUEUE_FAMILY_IGNORED,
-            VK_QUEUE_FAMILY_IGNORED,
-            img->img,
-            subresource_range
-        )}
-    );
-    dev->tmp_upload_buffers.emplace_back(std::move(staging_buffer));
-    return texture_cache.emplace(name, gpu_texture{img, std::move(img_view)}).first->second;
+    return texture_cache
+        .emplace(
+            name,
+            gpu_texture{img, std::move(img_view), index, dev->uploads->pending_value()}
+        )
+        .first->second;
 }
 
-gpu_texture& renderer::load_texture_from_bundle(const std::string& name, vk::CommandBuffer uplcb) {
+gpu_texture& renderer::load_texture_from_bundle(const std::string& name) {
     const auto& btx = current_bundle->textures[name];
-    return create_texture2d(name, btx.width, btx.height, btx.fmt, btx.size_bytes, btx.data, uplcb);
+    return create_texture2d(name, btx.width, btx.height, btx.fmt, btx.size_bytes, btx.data);
 }
 
 void renderer::update(const frame_state& fs) {
+    PROFILE_ZONE("renderer update");
+    // edits to existing materials are uploaded in `render` and don't need to wait
     if(should_recompile || global_buffers[GLOBAL_BUF_MATERIALS] == nullptr
        || current_bundle->materials_changed) {
         dev->graphics_qu.waitIdle();
@@ -315,86 +322,153 @@ void renderer::update(const frame_state& fs) {
                     dev,
                     sizeof(gpu_material) * num_gpu_mats,
                     vk::BufferUsageFlagBits::eUniformBuffer
-                        | vk::BufferUsageFlagBits::eStorageBuffer,
-                    vk::MemoryPropertyFlagBits::eHostCoherent,
-                    (void**)&mapped_materials
+                        | vk::BufferUsageFlagBits::eStorageBuffer
+                        | vk::BufferUsageFlagBits::eTransferDst,
+                    vk::MemoryPropertyFlagBits::eDeviceLocal,
+                    nullptr,
+                    memory_category::uniform
                 );
-                vk::DescriptorPoolSize pool_sizes[] = {vk::DescriptorPoolSize(
-                    vk::DescriptorType::eCombinedImageSampler, num_gpu_mats
-                )};
-                auto new_pool = dev->dev->createDescriptorPoolUnique(vk::DescriptorPoolCreateInfo{
-                    {}, (uint32)num_gpu_mats, 1, pool_sizes});
-                material_desc_pool.swap(new_pool);
-                std::vector<vk::DescriptorSetLayout> material_desc_set_layout_per_set(
-                    num_gpu_mats, material_desc_set_layout.get()
+                // big enough to upload every material at once
+                material_staging = std::make_unique<buffer>(
+                    dev,
+                    sizeof(gpu_material) * num_gpu_mats,
+                    vk::BufferUsageFlagBits::eTransferSrc,
+                    vk::MemoryPropertyFlagBits::eHostCoherent,
+                    (void**)&mapped_material_staging,
+                    memory_category::staging
                 );
-                auto new_sets = dev->dev->allocateDescriptorSets(vk::DescriptorSetAllocateInfo{
-                    material_desc_pool.get(),
-                    (uint32)num_gpu_mats,
-                    material_desc_set_layout_per_set.data()});
-                for(size_t i = 0; i < num_gpu_mats; ++i)
-                    current_bundle->materials[i]->desc_set = new_sets[i];
             }
 
-            // copy new materials to mapping
-            auto                                uplcb = dev->alloc_tmp_cmd_buffer();
-            std::vector<vk::WriteDescriptorSet> desc_writes;
-            arena<vk::DescriptorBufferInfo>     buf_infos;
-            arena<vk::DescriptorImageInfo>      img_infos;
-            auto* default_info = img_infos.alloc(vk::DescriptorImageInfo{
-                texture_sampler.get(),
-                texture_cache.at("nil").img_view.get(),
-                vk::ImageLayout::eShaderReadOnlyOptimal});
-
-            uplcb.begin(vk::CommandBufferBeginInfo{vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+            // everything gets uploaded again in the next render
             for(uint32_t i = 0; i < current_bundle->materials.size(); ++i) {
-                mapped_materials[i] = gpu_material(current_bundle->materials[i].get());
                 current_bundle->materials[i]->_render_index = i;
-                if(current_bundle->materials[i]->diffuse_tex.has_value()) {
-                    auto& tx = load_texture_from_bundle(
-                        current_bundle->materials[i]->diffuse_tex.value(), uplcb
-                    );
-                    auto* info = img_infos.alloc(vk::DescriptorImageInfo{
-                        texture_sampler.get(),
-                        tx.img_view.get(),
-                        vk::ImageLayout::eShaderReadOnlyOptimal});
-                    desc_writes.emplace_back(
-                        current_bundle->materials[i]->desc_set,
-                        0,
-                        0,
-                        1,
-                        vk::DescriptorType::eCombinedImageSampler,
-                        info
-                    );
-                } else {
-                    desc_writes.emplace_back(
-                        current_bundle->materials[i]->desc_set,
-                        0,
-                        0,
-                        1,
-                        vk::DescriptorType::eCombinedImageSampler,
-                        default_info
-                    );
-                }
+                current_bundle->materials[i]->_dirty        = true;
             }
-            uplcb.end();
-            dev->graphics_qu.submit({vk::SubmitInfo(0, nullptr, nullptr, 1, &uplcb)}, nullptr);
 
             if(!should_recompile && recreating_mat_buf) {
                 // make sure render node descriptor sets are up to date
-                for(const auto& node : subpass_order) {
+                std::vector<vk::WriteDescriptorSet> desc_writes;
+                arena<vk::DescriptorBufferInfo>     buf_infos;
+                arena<vk::DescriptorImageInfo>      img_infos;
+                for(const auto& node : compiled.subpass_order) {
                     node->prototype->update_descriptor_sets(
                         this, node.get(), desc_writes, buf_infos, img_infos
                     );
                 }
+                dev->dev->updateDescriptorSets(desc_writes, {});
             }
-            dev->dev->updateDescriptorSets(desc_writes, {});
         }
+        current_bundle->materials_changed = false;
     }
     if(should_recompile) compile_render_graph();
 }
 
+void renderer::upload_dirty_materials(vk::CommandBuffer& cb) {
+    if(material_staging == nullptr) return;
+    // the frame fence guarantees the previous frame is done with the staging buffer by the time
+    // we get here
+    std::vector<vk::BufferCopy> copies;
+    const auto&                 nil_tex = texture_cache.at("nil");
+    for(const auto& mat : current_bundle->materials) {
+        if(!mat->_dirty) continue;
+        auto& tx = mat->diffuse_tex.has_value() ? load_texture_from_bundle(mat->diffuse_tex.value())
+                                                : nil_tex;
+        // until its texture has finished uploading the material uses the nil texture, and stays
+        // dirty so that it gets uploaded again once the texture is ready
+        bool tex_ready = dev->uploads->is_complete(tx.ready_value);
+        mapped_material_staging[copies.size()]
+            = gpu_material(mat.get(), tex_ready ? tx.index : nil_tex.index);
+        copies.emplace_back(
+            copies.size() * sizeof(gpu_material),
+            mat->_render_index * sizeof(gpu_material),
+            sizeof(gpu_material)
+        );
+        mat->_dirty = !tex_ready;
+    }
+    if(copies.empty()) return;
+    frame_stats::add(frame_counter::uploaded_bytes, copies.size() * sizeof(gpu_material));
+
+    cb.copyBuffer(material_staging->buf, global_buffers[GLOBAL_BUF_MATERIALS]->buf, copies);
+    cb.pipelineBarrier(
+        vk::PipelineStageFlagBits::eTransfer,
+        vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eFragmentShader,
+        {},
+        {vk::MemoryBarrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead)},
+        {},
+        {}
+    );
+}
+
+std::optional<uint32_t> renderer::begin_node_timing(vk::CommandBuffer& cb, render_node* node) {
+    if(!timestamp_pool || timed_nodes.size() == max_timed_nodes) return {};
+    auto query = (uint32_t)timed_nodes.size() * 2;
+    timed_nodes.push_back(node->id);
+    cb.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, timestamp_pool.get(), query);
+    return query;
+}
+
+void renderer::end_node_timing(vk::CommandBuffer& cb, std::optional<uint32_t> query) {
+    if(!query.has_value()) return;
+    cb.writeTimestamp(
+        vk::PipelineStageFlagBits::eBottomOfPipe, timestamp_pool.get(), query.value() + 1
+    );
+}
+
+bool renderer::read_timestamps() {
+    if(!timestamp_pool || timed_nodes.empty()) return false;
+    std::vector<uint64_t> ticks(timed_nodes.size() * 2);
+    auto                  res = dev->dev->getQueryPoolResults(
+        timestamp_pool.get(),
+        0,
+        (uint32_t)ticks.size(),
+        ticks.size() * sizeof(uint64_t),
+        ticks.data(),
+        sizeof(uint64_t),
+        vk::QueryResultFlagBits::e64
+    );
+    if(res != vk::Result::eSuccess) return false;
+    uint64_t frame_start = ~0ull, frame_end = 0;
+    for(size_t i = 0; i < timed_nodes.size(); ++i) {
+        auto start  = ticks[2 * i] & timestamp_mask;
+        auto end    = ticks[2 * i + 1] & timestamp_mask;
+        frame_start = glm::min(frame_start, start);
+        frame_end   = glm::max(frame_end, end);
+        auto ms     = (float)((end - start) & timestamp_mask) * timestamp_period / 1e6f;
+        auto t      = node_timings.find(timed_nodes[i]);
+        if(t == node_timings.end()) {
+            node_timings[timed_nodes[i]] = gpu_node_timing{ms, ms};
+        } else {
+            t->second.last_ms = ms;
+            t->second.avg_ms  = glm::mix(t->second.avg_ms, ms, 0.05f);
+        }
+    }
+    frame_gpu_ms = (float)((frame_end - frame_start) & timestamp_mask) * timestamp_period / 1e6f;
+    return true;
+}
+
+void dynamic_resolution_controller::update(float gpu_ms) {
+    if(gpu_ms <= 0.f) return;
+    // GPU time is roughly proportional to the number of pixels, ie the square of the scale. aim a
+    // little under the target so that spikes don't immediately miss it, and only move part of the
+    // way there each frame so that noisy timings don't make the resolution flicker
+    float ideal = scale * glm::sqrt(0.9f * target_frame_time / gpu_ms);
+    scale       = glm::clamp(glm::mix(scale, ideal, 0.1f), min_scale, max_scale);
+}
+
+bool renderer::dynamic_resolution_active() const {
+    if(!resolution.enabled) return false;
+    for(const auto& node : compiled.subpass_order)
+        if(node->prototype->id() == upscale_prototype_id) return true;
+    return false;
+}
+
+void renderer::set_viewport(vk::CommandBuffer& cb, bool scaled) {
+    cb.setViewport(0, {scaled ? render_viewport : full_viewport});
+    cb.setScissor(0, {scaled ? render_scissor : full_scissor});
+}
+
 void renderer::render(vk::CommandBuffer& cb, uint32_t image_index, const frame_state& fs) {
+    PROFILE_ZONE("renderer record");
     auto* cur_world  = this->cur_world.lock().get();
     auto  cam_system = cur_world->system<camera_system>();
     if(cam_system->active_camera_id.has_value()) {
@@ -405,42 +479,113 @@ void renderer::render(vk::CommandBuffer& cb, uint32_t image_index, const frame_s
         mapped_frame_uniforms->proj = glm::perspective(
             cam.fov, (float)swpc->extent.width / (float)swpc->extent.height, 0.1f, 2000.f
         );
-        mapped_frame_uniforms->view = inverse(T);
+        mapped_frame_uniforms->view     = inverse(T);
+        mapped_frame_uniforms->inv_proj = inverse(mapped_frame_uniforms->proj);
     }
 
-    render_pass_begin_info.framebuffer = framebuffers[image_index].get();
-    cb.beginRenderPass(
-        render_pass_begin_info,
-        !subpass_order[0]->subpass_commands.has_value()
-            ? vk::SubpassContents::eInline
-            : vk::SubpassContents::eSecondaryCommandBuffers
+    // the frame fence has already been waited on, so last frame's timestamps are ready
+    bool timed = read_timestamps();
+    timed_nodes.clear();
+
+    // pick this frame's render resolution from the last frame's GPU time
+    bool scaling    = dynamic_resolution_active();
+    render_viewport = full_viewport;
+    render_scissor  = full_scissor;
+    if(scaling) {
+        if(timed) resolution.update(frame_gpu_ms);
+        auto w = glm::max(1u, (uint32_t)(resolution.scale * full_viewport.width));
+        auto h = glm::max(1u, (uint32_t)(resolution.scale * full_viewport.height));
+        render_viewport.width  = (float)w;
+        render_viewport.height = (float)h;
+        render_scissor.extent  = vk::Extent2D(w, h);
+    }
+    mapped_frame_uniforms->viewport = vec4(
+        render_viewport.width,
+        render_viewport.height,
+        1.f / render_viewport.width,
+        1.f / render_viewport.height
     );
 
-    for(size_t i = 0; i < subpass_order.size(); ++i) {
-        for(size_t x = 0; x < subpass_order[i]->subpass_count; ++x) {
-            if(subpass_order[i]->subpass_commands.has_value()) {
-                cb.executeCommands({subpass_order[i]->subpass_commands.value()[x].get()});
-                if(x + 1 < subpass_order[i]->subpass_count)
-                    cb.nextSubpass(vk::SubpassContents::eSecondaryCommandBuffers);
-            } else {
-                subpass_order[i]->prototype->generate_command_buffer_inline(
-                    this, subpass_order[i].get(), cb, x, fs
-                );
-                if(x + 1 < subpass_order[i]->subpass_count)
-                    cb.nextSubpass(vk::SubpassContents::eInline);
+    if(timestamp_pool) cb.resetQueryPool(timestamp_pool.get(), 0, 2 * max_timed_nodes);
+
+    dev->uploads->collect();
+    upload_dirty_materials(cb);
+    // everything loaded since the last frame, including textures for the materials above, goes
+    // out in one batch
+    dev->uploads->submit();
+
+    for(size_t pi = 0; pi < compiled.passes.size(); ++pi) {
+        const auto& cpass = compiled.passes[pi];
+        record_barriers(cb, cpass.barriers, cpass.memory_barrier, image_index);
+
+        const auto& nodes = cpass.nodes;
+        if(cpass.kind == node_kind::compute) {
+            for(const auto& node : nodes) {
+                auto query = begin_node_timing(cb, node.get());
+                for(size_t x = 0; x < node->subpass_count; ++x)
+                    node->prototype->generate_command_buffer_inline(this, node.get(), cb, x, fs);
+                end_node_timing(cb, query);
             }
+            continue;
         }
 
-        if(i + 1 < subpass_order.size()) {
-            cb.nextSubpass(
-                !subpass_order[i + 1]->subpass_commands.has_value()
-                    ? vk::SubpassContents::eInline
-                    : vk::SubpassContents::eSecondaryCommandBuffers
-            );
+        // the swap chain image is always drawn at full resolution, and the render area can only
+        // shrink if every node in the pass renders scaled
+        bool scaled_pass     = scaling && !cpass.uses_swap_chain();
+        bool pass_all_scaled = scaled_pass;
+        for(const auto& node : nodes)
+            pass_all_scaled = pass_all_scaled && node->prototype->scales_with_render_resolution();
+
+        auto& pass = passes[pi];
+        cb.beginRenderPass(
+            vk::RenderPassBeginInfo{
+                pass.render_pass.get(),
+                pass.framebuffers[image_index].get(),
+                pass_all_scaled ? render_scissor : full_scissor,
+                (uint32_t)pass.clear_values.size(),
+                pass.clear_values.data()},
+            !nodes[0]->subpass_commands.has_value() ? vk::SubpassContents::eInline
+                                                    : vk::SubpassContents::eSecondaryCommandBuffers
+        );
+
+        for(size_t i = 0; i < nodes.size(); ++i) {
+            // timestamps can't be written from the primary buffer in subpasses that execute
+            // secondary command buffers
+            std::optional<uint32_t> query;
+            if(!nodes[i]->subpass_commands.has_value()) {
+                query = begin_node_timing(cb, nodes[i].get());
+                // secondary command buffers would have to set their own viewport
+                set_viewport(
+                    cb, scaled_pass && nodes[i]->prototype->scales_with_render_resolution()
+                );
+            }
+            for(size_t x = 0; x < nodes[i]->subpass_count; ++x) {
+                if(nodes[i]->subpass_commands.has_value()) {
+                    cb.executeCommands({nodes[i]->subpass_commands.value()[x].get()});
+                    if(x + 1 < nodes[i]->subpass_count)
+                        cb.nextSubpass(vk::SubpassContents::eSecondaryCommandBuffers);
+                } else {
+                    nodes[i]->prototype->generate_command_buffer_inline(
+                        this, nodes[i].get(), cb, x, fs
+                    );
+                    if(x + 1 < nodes[i]->subpass_count)
+                        cb.nextSubpass(vk::SubpassContents::eInline);
+                }
+            }
+            end_node_timing(cb, query);
+
+            if(i + 1 < nodes.size()) {
+                cb.nextSubpass(
+                    !nodes[i + 1]->subpass_commands.has_value()
+                        ? vk::SubpassContents::eInline
+                        : vk::SubpassContents::eSecondaryCommandBuffers
+                );
+            }
         }
-    }
 
-    cb.endRenderPass();
+        cb.endRenderPass();
+    }
+    record_barriers(cb, compiled.final_barriers, false, image_index);
 }
 
 void renderer::for_each_renderable(
@@ -450,7 +595,9 @@ void renderer::for_each_renderable(
 
     for(auto meshi = this->begin_components(); meshi != this->end_components(); ++meshi) {
         const auto& [id, mesh] = *meshi;
-        if(mesh.geo_src == nullptr || mesh.m == nullptr || mesh.mat == nullptr) continue;
+        // meshes don't have to come from a geometry set, ie generated shapes
+        if(mesh.m == nullptr || mesh.mat == nullptr) continue;
+        if(!dev->uploads->is_complete(mesh.m->ready_value)) continue;
         if(!transforms->has_data_for_entity(id)) continue;
         const auto& transform = transforms->get_data_for_entity(id);
         f(id, mesh, transform);
@@ -458,7 +605,8 @@ void renderer::for_each_renderable(
 }
 
 renderer::~renderer() {
-    subpass_order.clear();
+    compiled.subpass_order.clear();
+    compiled.passes.clear();
     for(auto& n : render_graph) {
         n->desc_set.release();
         n.reset();
@@ -1,6 +1,19 @@
+#include "profiler.h"
 #include "renderer.h"
 
-// is setting the perserveAttachment counts on the subpasses necessary?
+/*
+ * device dependent realization: compiled_graph -> Vulkan objects
+ *
+ * initialize_node_data/deserialize_node_data
+ *
+ * subpass_repeat_count
+ * collect_descriptor_layouts
+ *
+ * update_descriptor_sets
+ * generate_pipelines
+ * generate_command_buffer
+ *
+ */
 
 inline vk::ImageUsageFlags usage_for_type(framebuffer_type ty) {
     switch(ty) {
@@ -12,6 +25,20 @@ inline vk::ImageUsageFlags usage_for_type(framebuffer_type ty) {
     }
 }
 
+inline bool is_integer_format(vk::Format fmt) {
+    switch(fmt) {
+        case vk::Format::eR32Uint:
+        case vk::Format::eR32G32Uint:
+        case vk::Format::eR32G32B32A32Uint:
+        case vk::Format::eR16G16B16A16Uint:
+        case vk::Format::eR8G8B8A8Uint:
+        case vk::Format::eR32Sint:
+        case vk::Format::eR32G32Sint:
+        case vk::Format::eR32G32B32A32Sint: return true;
+        default: return false;
+    }
+}
+
 inline vk::ImageAspectFlags aspects_for_type(framebuffer_type ty) {
     switch(ty) {
         case framebuffer_type::color: return vk::ImageAspectFlagBits::eColor;
@@ -22,471 +49,218 @@ inline vk::ImageAspectFlags aspects_for_type(framebuffer_type ty) {
     }
 }
 
-framebuffer_ref renderer::allocate_framebuffer(
-    const framebuffer_desc& desc, uint32_t subpass_count
-) {
-    if(subpass_count == 0) return 0;
-
-    for(auto& [ref, fb] : buffers) {
-        if(fb.in_use) {
-            if(fb.img->info.format == desc.format) {
-                fb.in_use = true;
-                return ref;
-            }
+void renderer::allocate_framebuffer(const compiled_framebuffer& cfb) {
+    auto usage = vk::ImageUsageFlagBits::eInputAttachment | vk::ImageUsageFlagBits::eSampled
+                 | usage_for_type(cfb.type);
+    if(cfb.storage) usage |= vk::ImageUsageFlagBits::eStorage;
+
+    // reuse an image from a previous compile if one matches. images that don't get reused stay
+    // around since the last frame could still be using them
+    for(auto i = buffers.begin(); i != buffers.end(); ++i) {
+        auto& fb = i->second;
+        if(!fb.in_use && fb.img->info.format == cfb.format && fb.type == cfb.type
+           && fb.num_layers() == cfb.layers && fb.arrayed == cfb.arrayed
+           && fb.img->info.usage == usage && fb.img->info.extent.width == swpc->extent.width
+           && fb.img->info.extent.height == swpc->extent.height) {
+            fb.in_use = true;
+            auto node = buffers.extract(i);
+            node.key() = cfb.ref;
+            buffers.insert(std::move(node));
+            return;
         }
     }
+
     vk::UniqueImageView iv;
-    auto                format = desc.format;
-    if(format == vk::Format::eUndefined) {
-        switch(desc.type) {
-            case framebuffer_type::color: format = swpc->format; break;
-            case framebuffer_type::depth:
-                format = vk::Format::eD32Sfloat;  // swpc->depth_buf->info.format;
-                break;
-            case framebuffer_type::depth_stencil: format = vk::Format::eD24UnormS8Uint; break;
-        }
-    }
-    auto actual_count
-        = desc.count == framebuffer_count_is_subpass_count ? subpass_count : desc.count;
-    auto isrg  = vk::ImageSubresourceRange{aspects_for_type(desc.type), 0, 1, 0, actual_count};
+    auto isrg  = vk::ImageSubresourceRange{aspects_for_type(cfb.type), 0, 1, 0, cfb.layers};
     auto newfb = std::make_unique<image>(
         this->dev,
         vk::ImageCreateFlags(),
         vk::ImageType::e2D,
         vk::Extent3D{swpc->extent.width, swpc->extent.height, 1},
-        format,
+        cfb.format,
         vk::ImageTiling::eOptimal,
-        vk::ImageUsageFlagBits::eInputAttachment | vk::ImageUsageFlagBits::eSampled
-            | usage_for_type(desc.type),
+        usage,
         vk::MemoryPropertyFlagBits::eDeviceLocal,
         1,
-        desc.count,
+        cfb.layers,
         &iv,
-        desc.count > 1 ? vk::ImageViewType::e2DArray : vk::ImageViewType::e2D,
-        isrg
+        cfb.arrayed ? vk::ImageViewType::e2DArray : vk::ImageViewType::e2D,
+        isrg,
+        memory_category::framebuffer
     );
-    framebuffer_ref                  id = next_id++;
     std::vector<vk::UniqueImageView> ivs;
     ivs.emplace_back(std::move(iv));
-    if(actual_count > 1) {
+    if(cfb.layers > 1) {
         isrg.layerCount = 1;
-        for(uint32_t i = 0; i < actual_count; ++i) {
+        for(uint32_t i = 0; i < cfb.layers; ++i) {
             isrg.baseArrayLayer = i;
             ivs.emplace_back(dev->dev->createImageViewUnique(vk::ImageViewCreateInfo{
                 vk::ImageViewCreateFlags(),
                 newfb->img,
                 vk::ImageViewType::e2D,
-                format,
+                cfb.format,
                 vk::ComponentMapping(),
                 isrg}));
         }
     }
-    buffers.emplace(id, framebuffer_values{std::move(newfb), true, std::move(ivs), desc.type});
-    return id;
-}
-
-void make_attachment_ref(
-    vk::AttachmentReference*&                  output,
-    framebuffer_ref                            fb,
-    const framebuffer_desc&                    fb_desc,
-    const std::map<framebuffer_ref, uint32_t>& attachment_refs,
-    uint32_t                                   rep_index,
-    vk::ImageLayout                            layout
-) {
-    if(fb_desc.subpass_binding_order == framebuffer_subpass_binding_order::parallel) {
-        for(uint32_t ai = 0; ai < fb_desc.count; ++ai) {
-            *output = vk::AttachmentReference{attachment_refs.at(fb) + ai, layout};
-            output++;
-        }
-    } else if(fb_desc.subpass_binding_order == framebuffer_subpass_binding_order::sequential) {
-        *output = vk::AttachmentReference{attachment_refs.at(fb) + rep_index, layout};
-        output++;
-    }
-}
-
-void make_node_subpass_input_attachments(
-    vk::SubpassDescription&                    subpass,
-    render_node*                               node,
-    arena<vk::AttachmentReference>&            reference_pool,
-    size_t                                     rep_index,
-    const std::map<framebuffer_ref, uint32_t>& attachment_refs
-) {
-    for(const auto& input : node->prototype->inputs) {
-        // skip blend fbs since they only need output attachment
-        if(input.mode == framebuffer_mode::blend_input
-           || input.mode == framebuffer_mode::shader_input)
-            continue;
-        subpass.inputAttachmentCount
-            += input.subpass_binding_order == framebuffer_subpass_binding_order::parallel
-                   ? input.count
-                   : 1;
-    }
-    auto* input_atch_next     = reference_pool.alloc_array(subpass.inputAttachmentCount);
-    subpass.pInputAttachments = input_atch_next;
-    for(size_t i = 0; i < node->inputs.size(); ++i) {
-        // skip blend fbs since they only need output attachment
-        if(node->prototype->inputs[i].mode == framebuffer_mode::blend_input
-           || node->prototype->inputs[i].mode == framebuffer_mode::shader_input)
-            continue;
-        const auto& [input_node, input_index] = node->inputs[i];
-        if(!input_node.has_value()) continue;
-        make_attachment_ref(
-            input_atch_next,
-            input_node->lock()->outputs[input_index],
-            node->prototype->inputs[i],
-            attachment_refs,
-            rep_index,
-            vk::ImageLayout::eShaderReadOnlyOptimal
-        );
-    }
-}
-
-void make_node_subpass_color_attachments(
-    vk::SubpassDescription&                    subpass,
-    render_node*                               node,
-    arena<vk::AttachmentReference>&            reference_pool,
-    size_t                                     rep_index,
-    const std::map<framebuffer_ref, uint32_t>& attachment_refs
-) {
-    for(size_t i = 0; i < node->prototype->outputs.size(); ++i) {
-        const auto& output = node->prototype->outputs[i];
-        if(output.type == framebuffer_type::color && node->outputs[i] != 0) {
-            subpass.colorAttachmentCount
-                += output.subpass_binding_order == framebuffer_subpass_binding_order::parallel
-                       ? output.count
-                       : 1;
-        }
-    }
-    auto* color_atch_next     = reference_pool.alloc_array(subpass.colorAttachmentCount);
-    subpass.pColorAttachments = color_atch_next;
-    for(size_t i = 0; i < node->prototype->outputs.size(); ++i) {
-        if(node->prototype->outputs[i].type == framebuffer_type::color && node->outputs[i] != 0) {
-            make_attachment_ref(
-                color_atch_next,
-                node->outputs[i],
-                node->prototype->outputs[i],
-                attachment_refs,
-                rep_index,
-                vk::ImageLayout::eColorAttachmentOptimal
-            );
-        }
-    }
+    buffers.emplace(
+        cfb.ref, framebuffer_values{std::move(newfb), true, std::move(ivs), cfb.type, cfb.arrayed}
+    );
 }
 
-void make_node_subpass_depth_attachment(
-    vk::SubpassDescription&                    subpass,
-    render_node*                               node,
-    arena<vk::AttachmentReference>&            reference_pool,
-    size_t                                     rep_index,
-    const std::map<framebuffer_ref, uint32_t>& attachment_refs
-) {
-    for(size_t i = 0; i < node->prototype->outputs.size(); ++i) {
-        if((node->prototype->outputs[i].type == framebuffer_type::depth
-            || node->prototype->outputs[i].type == framebuffer_type::depth_stencil)
-           && node->outputs[i] != 0) {
-            uint32_t offset = 0;
-            if(node->prototype->outputs[i].count > 1) {
-                if(node->prototype->outputs[i].subpass_binding_order
-                   == framebuffer_subpass_binding_order::sequential)
-                    offset = (uint32_t)rep_index;
-                else
-                    throw;  // can't render to multiple depth buffers in parallel, at least for now
+void renderer::generate_clear_values(const compiled_pass& pass, std::vector<vk::ClearValue>& cv) {
+    // attachments are in the same order as the refs
+    for(const auto& [ref, ai] : pass.attachment_refs) {
+        const auto* fb = compiled.framebuffer(ref);
+        auto        ty = fb == nullptr ? framebuffer_type::color : fb->type;
+        for(size_t i = 0; i < (fb == nullptr ? 1 : fb->layers); ++i) {
+            switch(ty) {
+                case framebuffer_type::color:
+                    // integer formats would otherwise get the bit pattern of the float values
+                    if(fb != nullptr && is_integer_format(fb->format))
+                        cv.emplace_back(vk::ClearColorValue(std::array<uint32_t, 4>{0, 0, 0, 0}));
+                    else
+                        cv.emplace_back(
+                            vk::ClearColorValue(std::array<float, 4>{0.f, 0.f, 0.f, 1.f})
+                        );
+                    break;
+                case framebuffer_type::depth:
+                case framebuffer_type::depth_stencil:
+                    cv.emplace_back(vk::ClearDepthStencilValue(1.f, 0));
+                    break;
             }
-            subpass.pDepthStencilAttachment = reference_pool.alloc(vk::AttachmentReference{
-                attachment_refs.at(node->outputs[i]) + offset,
-                vk::ImageLayout::eDepthStencilAttachmentOptimal});
-            break;  // only one is possible
-        }
-    }
-}
-
-void emit_node_subpass_dependencies(
-    render_node* node, std::vector<vk::SubpassDependency>& dependencies, size_t rep_index
-) {
-    // see: https://developer.samsung.com/galaxy-gamedev/resources/articles/renderpasses.html
-    // assuming that we are always consuming inputs in fragment shaders
-    // TODO: create dependencies between repeated subpasses?
-    for(const auto& [_input_node, input_index] : node->inputs) {
-        if(!_input_node.has_value()) continue;
-        auto input_node = _input_node->lock();
-        if(input_node->prototype->id() == 0x0000ffff) continue;  // screen output node
-        if(input_node->subpass_count == 0) continue;             // subpass isn't actually happening
-        const auto& fb_desc = input_node->prototype->outputs[input_index];
-
-        auto from_subpass = input_node->subpass_index + input_node->subpass_count - 1;
-        auto to_subpass   = node->subpass_index + rep_index;
-
-        if(fb_desc.type == framebuffer_type::color
-           && fb_desc.mode != framebuffer_mode::blend_input) {
-            dependencies.emplace_back(
-                from_subpass,
-                to_subpass,
-                vk::PipelineStageFlagBits::eColorAttachmentOutput,
-                vk::PipelineStageFlagBits::eFragmentShader,
-                vk::AccessFlagBits::eColorAttachmentWrite,
-                vk::AccessFlagBits::eShaderRead,
-                vk::DependencyFlagBits::eByRegion
-            );
-        } else if(fb_desc.type == framebuffer_type::depth || fb_desc.type == framebuffer_type::depth_stencil) {
-            std::cout << "DD\n";
-            dependencies.emplace_back(
-                from_subpass,
-                to_subpass,
-                vk::PipelineStageFlagBits::eLateFragmentTests,
-                vk::PipelineStageFlagBits::eFragmentShader,
-                vk::AccessFlagBits::eDepthStencilAttachmentWrite,
-                vk::AccessFlagBits::eShaderRead,
-                vk::DependencyFlagBits::eByRegion
-            );
-        } else {
-            std::cout << "??\n";
         }
     }
 }
 
-void renderer::generate_subpasses(
-    const std::shared_ptr<render_node>&        node,
-    std::vector<vk::SubpassDescription>&       subpasses,
-    std::vector<vk::SubpassDependency>&        dependencies,
-    const std::map<framebuffer_ref, uint32_t>& attachment_refs,
-    arena<vk::AttachmentReference>&            reference_pool
+void renderer::record_barriers(
+    vk::CommandBuffer&                   cb,
+    const std::vector<compiled_barrier>& barriers,
+    bool                                 memory_barrier,
+    uint32_t                             image_index
 ) {
-    if(node->visited) return;
-    if(log_compile)
-        std::cout << "generate_subpasses for " << node->inputs.size() << " children of " << node->id
-                  << ":" << node->prototype->name() << "\n";
-    node->visited = true;
-    for(const auto& [input_node, input_index] : node->inputs) {
-        if(!input_node.has_value()) continue;
-        generate_subpasses(
-            input_node->lock(), subpasses, dependencies, attachment_refs, reference_pool
+    if(barriers.empty() && !memory_barrier) return;
+    vk::PipelineStageFlags              src_stage, dst_stage;
+    std::vector<vk::ImageMemoryBarrier> image_barriers;
+    std::vector<vk::MemoryBarrier>      memory_barriers;
+    for(const auto& b : barriers) {
+        src_stage |= b.src_stage;
+        dst_stage |= b.dst_stage;
+        auto is_swpc = b.fb == swap_chain_framebuffer;
+        image_barriers.emplace_back(
+            b.src_access,
+            b.dst_access,
+            b.old_layout,
+            b.new_layout,
+            VK_QUEUE_FAMILY_IGNORED,
+            VK_QUEUE_FAMILY_IGNORED,
+            is_swpc ? swpc->images[image_index] : vk::Image(buffers.at(b.fb).img->img),
+            vk::ImageSubresourceRange{
+                aspects_for_type(is_swpc ? framebuffer_type::color : buffers.at(b.fb).type),
+                0,
+                VK_REMAINING_MIP_LEVELS,
+                0,
+                VK_REMAINING_ARRAY_LAYERS}
         );
     }
-    if(log_compile)
-        std::cout << "generate_subpasses for " << node->id << ":" << node->prototype->name()
-                  << "\n";
-
-    if(node.get() == screen_output_node.get()) {
-        if(log_compile) std::cout << "\toutput node, skipped\n";
-        return;
-    }
-
-    if(node->subpass_count == 0) {
-        if(log_compile) std::cout << "\tnode subpass count is zero, skipped\n";
-        return;
-    }
-
-    node->subpass_index = (uint32_t)subpasses.size();
-    if(log_compile)
-        std::cout << "\tassigning node subpass index #" << node->subpass_index << " x "
-                  << node->subpass_count << "\n";
-    subpass_order.push_back(node);
-
-    for(size_t rep_index = 0; rep_index < node->subpass_count; ++rep_index) {
-        vk::SubpassDescription subpass(
-            vk::SubpassDescriptionFlags(), vk::PipelineBindPoint::eGraphics
-        );
-
-        make_node_subpass_input_attachments(
-            subpass, node.get(), reference_pool, rep_index, attachment_refs
-        );
-        make_node_subpass_color_attachments(
-            subpass, node.get(), reference_pool, rep_index, attachment_refs
-        );
-        make_node_subpass_depth_attachment(
-            subpass, node.get(), reference_pool, rep_index, attachment_refs
+    if(memory_barrier) {
+        // compute nodes may have written to any storage buffer
+        src_stage |= vk::PipelineStageFlagBits::eComputeShader;
+        dst_stage |= vk::PipelineStageFlagBits::eDrawIndirect
+                     | vk::PipelineStageFlagBits::eVertexInput
+                     | vk::PipelineStageFlagBits::eVertexShader
+                     | vk::PipelineStageFlagBits::eFragmentShader
+                     | vk::PipelineStageFlagBits::eComputeShader;
+        memory_barriers.emplace_back(
+            vk::AccessFlagBits::eShaderWrite,
+            vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eVertexAttributeRead
+                | vk::AccessFlagBits::eIndexRead | vk::AccessFlagBits::eUniformRead
+                | vk::AccessFlagBits::eShaderRead
         );
-
-        subpasses.emplace_back(subpass);
-
-        emit_node_subpass_dependencies(node.get(), dependencies, rep_index);
     }
+    cb.pipelineBarrier(src_stage, dst_stage, {}, memory_barriers, {}, image_barriers);
 }
 
-void renderer::propagate_blended_framebuffers(std::shared_ptr<render_node> node) {
-    for(size_t i = 0; i < node->inputs.size(); ++i) {
-        if(node->input_node(i) != nullptr && node->input_node(i) != screen_output_node)
-            this->propagate_blended_framebuffers(node->input_node(i));
-        if(node->prototype->inputs[i].mode == framebuffer_mode::blend_input) {
-            if(node->input_node(i) != nullptr) {
-                node->outputs[i] = node->input_framebuffer(i).value();
-            } else {
-                node->outputs[i]
-                    = this->allocate_framebuffer(node->prototype->outputs[i], node->subpass_count);
+void renderer::create_pass_framebuffers(size_t pass_index) {
+    const auto& cpass = compiled.passes[pass_index];
+    // attachments are in the same order as the refs, the swap chain image is always first
+    passes[pass_index].framebuffers = swpc->create_framebuffers(
+        passes[pass_index].render_pass.get(),
+        [&](size_t index, std::vector<vk::ImageView>& att) {
+            for(const auto& [ref, ai] : cpass.attachment_refs) {
+                if(ref == swap_chain_framebuffer) continue;
+                const auto& fb = buffers.at(ref);
+                if(fb.is_array())
+                    for(size_t i = 1; i < fb.image_views.size(); ++i)
+                        att.push_back(fb.image_views[i].get());
+                else
+                    att.push_back(fb.image_views[0].get());
             }
-        }
-    }
-}
-
-void renderer::generate_attachment_descriptions(
-    std::vector<vk::AttachmentDescription>& attachments,
-    std::map<framebuffer_ref, uint32_t>&    attachment_refs
-) {
-    attachments.emplace_back(
-        vk::AttachmentDescriptionFlags(),  // swapchain color attachment
-        swpc->format,
-        vk::SampleCountFlagBits::e1,
-        vk::AttachmentLoadOp::eClear,
-        vk::AttachmentStoreOp::eStore,
-        vk::AttachmentLoadOp::eDontCare,
-        vk::AttachmentStoreOp::eDontCare,
-        vk::ImageLayout::eUndefined,
-        vk::ImageLayout::ePresentSrcKHR
+        },
+        false,
+        cpass.uses_swap_chain()
     );
-    attachment_refs[1] = 0;
-
-    for(const auto& fb : buffers) {
-        if(!fb.second.in_use) continue;
-        attachment_refs[fb.first] = (uint32_t)attachments.size();
-        size_t num_layers         = fb.second.num_layers(
-        );  // std::get<2>(fb.second).size() == 1 ? 1 : std::get<2>(fb.second).size()-1;
-        for(size_t i = 0; i < num_layers; ++i) {
-            attachments.emplace_back(
-                vk::AttachmentDescriptionFlags(),
-                fb.second.img->info.format,
-                vk::SampleCountFlagBits::e1,
-                vk::AttachmentLoadOp::eClear,
-                vk::AttachmentStoreOp::eStore,
-                vk::AttachmentLoadOp::eDontCare,
-                vk::AttachmentStoreOp::eDontCare,
-                vk::ImageLayout::eUndefined,
-                vk::ImageLayout::eGeneral
-            );
-        }
-    }
-}
-
-void renderer::generate_clear_values() {
-    clear_values.clear();
-    clear_values.emplace_back(vk::ClearColorValue(std::array<float, 4>{0.f, 0.0f, 0.0f, 1.f}));
-    for(const auto& fb : buffers) {
-        if(!fb.second.in_use) continue;
-        size_t num_layers = fb.second.num_layers();
-        for(size_t i = 0; i < num_layers; ++i) {
-            switch(fb.second.type) {
-                case framebuffer_type::color:
-                    clear_values.emplace_back(vk::ClearColorValue(std::array<float, 4>{
-                        0.f, 0.f, 0.f, 1.f}));
-                    break;
-                case framebuffer_type::depth:
-                case framebuffer_type::depth_stencil:
-                    clear_values.emplace_back(vk::ClearDepthStencilValue(1.f, 0));
-                    break;
-            }
-        }
-    }
 }
 
-/*
- * initialize_node_data/deserialize_node_data
- *
- * subpass_repeat_count
- * collect_descriptor_layouts
- *
- * update_descriptor_sets
- * generate_pipelines
- * generate_command_buffer
- *
- */
-
 void renderer::compile_render_graph() {
+    PROFILE_ZONE("compile render graph");
+    auto compile_start = std::chrono::high_resolution_clock::now();
+
     // free all framebuffers we still have and do other clean up
     for(auto& buf : buffers)
         buf.second.in_use = false;
     for(auto& n : render_graph) {
-        n->visited = false;
-        for(auto& ou : n->outputs)
-            ou = 0;
         n->desc_set.release();
-    }
-
-    // allocate framebuffers to each node - for now nothing fancy, just give each output its own
-    // buffer assign the actual screen backbuffers
-    auto& [color_src_node, color_src_ix] = screen_output_node->inputs[0];
-    if(color_src_node.has_value()) color_src_node->lock()->outputs[color_src_ix] = 1;
-    screen_output_node->outputs[0]  = 1;
-    prototypes[0]->inputs[0].format = swpc->format;
-    for(auto& node : render_graph) {
         // compute subpass count early so we can use it from framebuffer counts as well
-        node->subpass_count = node->prototype->subpass_repeat_count(this, node.get());
-
-        for(size_t i = 0; i < node->outputs.size(); ++i) {
-            // assign a new framebuffer to each output that is unassigned and not a blend input
-            if(node->outputs[i] == 0
-               && !(
-                   i < node->prototype->inputs.size()
-                   && node->prototype->inputs[i].mode == framebuffer_mode::blend_input
-               ))
-                node->outputs[i]
-                    = this->allocate_framebuffer(node->prototype->outputs[i], node->subpass_count);
-        }
+        n->subpass_count = n->prototype->subpass_repeat_count(this, n.get());
     }
-    // copy blend mode framebuffers so that nodes that take a blend mode framebuffer also output to
-    // the same framebuffer
-    this->propagate_blended_framebuffers(screen_output_node);
-
-    std::vector<vk::AttachmentDescription> attachments;
-    std::map<framebuffer_ref, uint32_t>    attachment_refs;
-    generate_attachment_descriptions(attachments, attachment_refs);
-
-    generate_clear_values();
-
-    // collect all subpasses and generate subpass dependencies, one per node except output
-    std::vector<vk::SubpassDescription> subpasses;
-    std::vector<vk::SubpassDependency>  dependencies;
-    arena<vk::AttachmentReference>      reference_pool;
-    subpass_order.clear();
-    generate_subpasses(
-        screen_output_node, subpasses, dependencies, attachment_refs, reference_pool
-    );
+    prototypes[0]->inputs[0].format = swpc->format;
 
-    if(log_compile) {
-        std::cout << "subpass dependencies:\n";
-        for(size_t i = 0; i < dependencies.size(); ++i) {
-            auto& d = dependencies[i];
-            std::cout << i << ": src=" << d.srcSubpass << " dst=" << d.dstSubpass << "\n";
-        }
-        std::cout << "----------------------\n";
+    compiled = compile_graph(render_graph, screen_output_node, swpc->format, next_id, log_compile);
+    next_id  = compiled.next_ref;
+    compile_duration
+        = std::chrono::duration<float, std::milli>(
+              std::chrono::high_resolution_clock::now() - compile_start
+        )
+              .count();
+
+    auto errors = compiled.validate();
+    for(const auto& e : errors)
+        std::cout << "render graph error: " << e << "\n";
+    if(log_compile) std::cout << "compiled render graph in " << compile_duration << "ms\n";
+
+    for(const auto& fb : compiled.framebuffers)
+        allocate_framebuffer(fb);
+
+    // create a render pass and framebuffers for each graphics pass
+    passes.clear();
+    passes.resize(compiled.passes.size());
+    for(size_t pi = 0; pi < compiled.passes.size(); ++pi) {
+        const auto& cpass = compiled.passes[pi];
+        if(cpass.kind != node_kind::graphics) continue;
+        auto& pass = passes[pi];
+
+        generate_clear_values(cpass, pass.clear_values);
+
+        auto                     subpasses = cpass.subpass_descriptions();
+        vk::RenderPassCreateInfo rpcfo{
+            {},
+            (uint32_t)cpass.attachments.size(),
+            cpass.attachments.data(),
+            (uint32_t)subpasses.size(),
+            subpasses.data(),
+            (uint32_t)cpass.dependencies.size(),
+            cpass.dependencies.data()};
+        pass.render_pass = dev->dev->createRenderPassUnique(rpcfo);
+
+        create_pass_framebuffers(pi);
     }
 
-    // create render pass
-    vk::RenderPassCreateInfo rpcfo{
-        {},
-        (uint32_t)attachments.size(),
-        attachments.data(),
-        (uint32_t)subpasses.size(),
-        subpasses.data(),
-        (uint32_t)dependencies.size(),
-        dependencies.data()};
-    render_pass = dev->dev->createRenderPassUnique(rpcfo);
-
-    this->render_pass_begin_info = vk::RenderPassBeginInfo{
-        render_pass.get(),
-        nullptr,
-        vk::Rect2D(vk::Offset2D(), swpc->extent),
-        (uint32_t)clear_values.size(),
-        clear_values.data()};
-
-    // create new framebuffers
-    framebuffers = swpc->create_framebuffers(
-        render_pass.get(),
-        [&](size_t index, std::vector<vk::ImageView>& att) {
-            for(const auto& [ref, fb] : buffers) {
-                if(!fb.in_use) continue;
-                if(fb.is_array())
-                    for(size_t i = 1; i < fb.image_views.size(); ++i)
-                        att.push_back(fb.image_views[i].get());
-                else
-                    att.push_back(fb.image_views[0].get());
-            }
-        }
-    );
-
     // gather information about descriptors
     std::vector<vk::DescriptorPoolSize>   pool_sizes;
     std::vector<vk::DescriptorSetLayout>  layouts;
     std::vector<vk::UniqueDescriptorSet*> outputs;
-    for(const auto& node : subpass_order)
+    for(const auto& node : compiled.subpass_order)
         node->prototype->collect_descriptor_layouts(node.get(), pool_sizes, layouts, outputs);
 
     // allocate descriptors sets and pools
@@ -507,14 +281,14 @@ void renderer::compile_render_graph() {
     std::vector<vk::WriteDescriptorSet> desc_writes;
     arena<vk::DescriptorBufferInfo>     buf_infos;
     arena<vk::DescriptorImageInfo>      img_infos;
-    for(const auto& node : subpass_order) {
+    for(const auto& node : compiled.subpass_order) {
         if(log_compile)
             std::cout << "initializing " << node->id << ":" << node->prototype->name() << "\n";
         node->prototype->update_descriptor_sets(
             this, node.get(), desc_writes, buf_infos, img_infos
         );
         node->prototype->generate_pipelines(
-            this, node.get(), render_pass.get(), node->subpass_index
+            this, node.get(), passes[node->pass_index].render_pass.get(), node->subpass_index
         );
 
         // generate command buffers
@@ -524,3 +298,36 @@ void renderer::compile_render_graph() {
     dev->dev->updateDescriptorSets(desc_writes, {});
     should_recompile = false;
 }
+
+void renderer::resize_swapchain_dependencies(swap_chain* swpc) {
+    PROFILE_ZONE("resize render graph");
+    // render passes only depend on the swap chain's format. a graph that hasn't compiled yet, or
+    // is about to recompile anyway, has nothing worth keeping
+    if(passes.empty() || should_recompile || swpc->format != prototypes[0]->inputs[0].format) {
+        create_swapchain_dependencies(swpc);
+        return;
+    }
+    use_swap_chain(swpc);
+
+    // nothing is in flight, so the old images can go right away instead of waiting to be reused
+    buffers.clear();
+    for(const auto& fb : compiled.framebuffers)
+        allocate_framebuffer(fb);
+    for(size_t pi = 0; pi < compiled.passes.size(); ++pi)
+        if(compiled.passes[pi].kind == node_kind::graphics) create_pass_framebuffers(pi);
+
+    // the descriptor sets are rewritten in place, which also invalidates any command buffers that
+    // bound them
+    std::vector<vk::WriteDescriptorSet> desc_writes;
+    arena<vk::DescriptorBufferInfo>     buf_infos;
+    arena<vk::DescriptorImageInfo>      img_infos;
+    for(const auto& node : compiled.subpass_order) {
+        node->prototype->resize(this, node.get());
+        node->prototype->update_descriptor_sets(
+            this, node.get(), desc_writes, buf_infos, img_infos
+        );
+    }
+    dev->dev->updateDescriptorSets(desc_writes, {});
+    for(const auto& node : compiled.subpass_order)
+        node->subpass_commands = node->prototype->generate_command_buffer(this, node.get());
+}
@@ -1,4 +1,5 @@
 #include "ImGuiFileDialog.h"
+#include "frame_stats.h"
 #include "imgui.h"
 #include "imgui_impl_vulkan.h"
 #include "imgui_stdlib.h"
@@ -28,6 +29,10 @@ void renderer::build_gui_menu(const frame_state& fs) {
         if(ImGui::BeginMenu("Options")) {
             ImGui::MenuItem("Compilation log", nullptr, &log_compile);
             ImGui::MenuItem("Viewport shapes", nullptr, &show_shapes);
+            ImGui::Separator();
+            ImGui::MenuItem("Dynamic resolution", nullptr, &resolution.enabled);
+            ImGui::SliderFloat("Target GPU ms", &resolution.target_frame_time, 2.f, 50.f);
+            ImGui::SliderFloat("Min scale", &resolution.min_scale, 0.25f, resolution.max_scale);
             ImGui::EndMenu();
         }
         ImGui::EndMenuBar();
@@ -51,6 +56,11 @@ void renderer::build_gui_graph_view(const frame_state& fs) {
         ImNodes::BeginNode((int)i);
         ImNodes::BeginNodeTitleBar();
         ImGui::Text("%s[%u]", node->prototype->name(), node->subpass_count);
+        auto timing = node_timings.find(node->id);
+        if(timing != node_timings.end()) {
+            ImGui::SameLine();
+            ImGui::TextDisabled("%.2fms", timing->second.avg_ms);
+        }
         ImGui::SameLine();
         if(ImGui::SmallButton(" x ")) deleted_nodes.push_back(node);
         ImNodes::EndNodeTitleBar();
@@ -169,11 +179,103 @@ void renderer::build_gui_stats(const frame_state& fs) {
     //         active_meshes.size(), active_lights.size(), active_shapes.size(),
     //         subpass_order.size());
     ImGui::Text(
-        "%zu temp command buffers, %zu temp upload buffers",
+        "%zu temp command buffers, %zu upload batches in flight",
         dev->tmp_cmd_buffers.size(),
-        dev->tmp_upload_buffers.size()
+        dev->uploads->batches_in_flight()
+    );
+    ImGui::Text(
+        "staging ring %.1f / %.1f MiB in use, %zu uploads used dedicated staging buffers",
+        (float)dev->staging->bytes_used() / (1024.f * 1024.f),
+        (float)dev->staging->size() / (1024.f * 1024.f),
+        dev->uploads->dedicated_staging_buffers()
     );
 
+    ImGui::Text(
+        "render graph compiled in %.3fms: %zu passes, %zu subpasses, %zu framebuffers",
+        compile_duration,
+        compiled.passes.size(),
+        compiled.subpass_count(),
+        compiled.framebuffers.size()
+    );
+
+    ImGui::Separator();
+    if(!timestamp_pool) {
+        ImGui::Text("GPU timestamps aren't supported on the graphics queue");
+    } else {
+        ImGui::Text("GPU time: %.3fms", frame_gpu_ms);
+        if(dynamic_resolution_active()) {
+            ImGui::Text(
+                "rendering at %.0f x %.0f (%.0f%%)",
+                render_viewport.width,
+                render_viewport.height,
+                resolution.scale * 100.f
+            );
+        } else if(resolution.enabled) {
+            ImGui::Text("dynamic resolution needs an Upscale node in the render graph");
+        }
+        if(ImGui::BeginTable("##RenderNodeTimingTable", 4)) {
+            ImGui::TableSetupColumn("Node");
+            ImGui::TableSetupColumn("ID");
+            ImGui::TableSetupColumn("Last ms");
+            ImGui::TableSetupColumn("Average ms");
+            ImGui::TableHeadersRow();
+            for(const auto& node : compiled.subpass_order) {
+                auto timing = node_timings.find(node->id);
+                if(timing == node_timings.end()) continue;
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::Text("%s", node->prototype->name());
+                ImGui::TableNextColumn();
+                ImGui::Text("%zu", node->id);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", timing->second.last_ms);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", timing->second.avg_ms);
+            }
+            ImGui::EndTable();
+        }
+    }
+
+    ImGui::Separator();
+    ImGui::Text("Frame counters:");
+    ImGui::SameLine();
+    if(frame_stats::recording_csv()) {
+        if(ImGui::SmallButton("Stop CSV")) frame_stats::end_csv();
+    } else if(ImGui::SmallButton("Record CSV")) {
+        frame_stats::begin_csv("eggv-stats.csv");
+    }
+    if(ImGui::BeginTable("##RenderFrameCounterTable", 4)) {
+        ImGui::TableSetupColumn("Counter");
+        ImGui::TableSetupColumn("Last");
+        ImGui::TableSetupColumn("Average");
+        ImGui::TableSetupColumn("History");
+        ImGui::TableHeadersRow();
+        for(size_t i = 0; i < frame_counter_count; ++i) {
+            auto c = (frame_counter)i;
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("%s", frame_counter_name(c));
+            ImGui::TableNextColumn();
+            ImGui::Text("%lu", frame_stats::last(c));
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", frame_stats::average(c));
+            ImGui::TableNextColumn();
+            ImGui::PushID((int)i);
+            ImGui::PlotLines(
+                "##history",
+                frame_stats::history(c).data(),
+                (int)frame_stats::history_length,
+                (int)frame_stats::history_offset(),
+                nullptr,
+                0.f,
+                FLT_MAX,
+                ImVec2(160.f, 20.f)
+            );
+            ImGui::PopID();
+        }
+        ImGui::EndTable();
+    }
+
     ImGui::Separator();
     ImGui::Text("Framebuffers:");
     if(ImGui::BeginTable("##RenderFramebufferTable", 5)) {
@@ -198,6 +300,59 @@ void renderer::build_gui_stats(const frame_state& fs) {
         }
         ImGui::EndTable();
     }
+
+    ImGui::Separator();
+    ImGui::Text("GPU memory:");
+    if(ImGui::BeginTable("##RenderMemoryCategoryTable", 3)) {
+        ImGui::TableSetupColumn("Category");
+        ImGui::TableSetupColumn("Allocations");
+        ImGui::TableSetupColumn("MiB");
+        ImGui::TableHeadersRow();
+        for(size_t i = 0; i < memory_category_count; ++i) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("%s", memory_category_name((memory_category)i));
+            ImGui::TableNextColumn();
+            ImGui::Text("%zu", dev->category_allocations[i]);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f", (float)dev->category_bytes[i] / (1024.f * 1024.f));
+        }
+        ImGui::EndTable();
+    }
+    ImGui::Text(
+        "Heaps (%s):",
+        dev->memory_budget_supported ? "VK_EXT_memory_budget" : "estimated by VMA"
+    );
+    if(ImGui::BeginTable("##RenderMemoryHeapTable", 5)) {
+        ImGui::TableSetupColumn("Heap");
+        ImGui::TableSetupColumn("Device local?");
+        ImGui::TableSetupColumn("Usage MiB");
+        ImGui::TableSetupColumn("Budget MiB");
+        ImGui::TableSetupColumn("Fragmentation");
+        ImGui::TableHeadersRow();
+        auto heaps = dev->heap_stats();
+        for(size_t i = 0; i < heaps.size(); ++i) {
+            const auto& h = heaps[i];
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("%zu", i);
+            ImGui::TableNextColumn();
+            ImGui::Text("%s", h.device_local ? "Y" : "N");
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f", (float)h.usage / (1024.f * 1024.f));
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f", (float)h.budget / (1024.f * 1024.f));
+            ImGui::TableNextColumn();
+            // the part of VMA's blocks that isn't handed out to any allocation
+            ImGui::Text(
+                "%.1f%%",
+                h.block_bytes == 0
+                    ? 0.f
+                    : 100.f * (1.f - (float)h.allocation_bytes / (float)h.block_bytes)
+            );
+        }
+        ImGui::EndTable();
+    }
 }
 
 void renderer::build_gui_textures(const frame_state& fs) {
@@ -216,6 +371,10 @@ void renderer::build_gui_textures(const frame_state& fs) {
             ImGui::TableNextColumn();
             ImGui::Text("%u x %u", tx.img->info.extent.width, tx.img->info.extent.height);
             ImGui::TableNextColumn();
+            if(!dev->uploads->is_complete(tx.ready_value)) {
+                ImGui::Text("uploading");
+                continue;
+            }
             if(tx.imgui_tex_id == 0) {
                 tx.imgui_tex_id = (uint64_t)ImGui_ImplVulkan_AddTexture(
                     (VkSampler)texture_sampler.get(),
@@ -1,4 +1,5 @@
 #include "scene_components.h"
+#include "frame_stats.h"
 #include <imgui.h>
 
 // TODO: break up headers and move modules into directories ie this should go with the other ECS
@@ -11,6 +12,7 @@ void transform_system::update_world_transforms(entity e, const mat4& T) {
         comp.world = glm::scale(
             glm::translate(T, comp.translation) * glm::mat4_cast(comp.rotation), comp.scale
         );
+        frame_stats::add(frame_counter::entities_updated);
     }
     const auto& p = d != this->entity_data.end() ? d->second.world : T;
     e.for_each_child([&](const auto& c) { this->update_world_transforms(c, p); });
@@ -1,4 +1,6 @@
 #include "eggv_app.h"
+#include "frame_stats.h"
+#include "profiler.h"
 #include <utility>
 
 using namespace emlisp;
@@ -42,13 +44,46 @@ void eggv_app::init_script_runtime() {
         this
     );
 
+    script_runtime->define_fn(
+        "gpu-memory",
+        [](runtime* rt, value args, void* cx) {
+            auto* self = (eggv_app*)cx;
+            return rt->make_owned_extern<gpu_memory_stats>(self->dev.get());
+        },
+        this
+    );
+
+    // (stress-scene seed entities branching materials point-lights directional-lights motion)
+    script_runtime->define_fn(
+        "stress-scene",
+        [](runtime* rt, value args, void* cx) {
+            auto*             self = (eggv_app*)cx;
+            stress_scene_desc desc;
+            desc.seed               = (uint32_t)to_float(nth(args, 0));
+            desc.entities           = (uint32_t)to_float(nth(args, 1));
+            desc.branching          = (uint32_t)to_float(nth(args, 2));
+            desc.materials          = (uint32_t)to_float(nth(args, 3));
+            desc.point_lights       = (uint32_t)to_float(nth(args, 4));
+            desc.directional_lights = (uint32_t)to_float(nth(args, 5));
+            desc.motion             = to_float(nth(args, 6)) != 0.f;
+            return rt->make_owned_extern<entity>(
+                generate_stress_scene(self->w, self->bndl, self->dev.get(), desc)
+            );
+        },
+        this
+    );
+
     heap_info hfo;
     script_runtime->collect_garbage(&hfo);
+    frame_stats::add(frame_counter::script_gc_bytes, hfo.old_size - hfo.new_size);
     std::cout << "initializing script runtime created " << (hfo.old_size - hfo.new_size)
               << "b of garbage\n";
 
     if(!bndl->init_script.empty()) {
+        // every mesh the init script creates goes out in one submission
+        mesh_upload_batch mesh_uploads{dev.get()};
         try {
+            PROFILE_ZONE("init script");
             script_runtime->eval_file(bndl->init_script);
         } catch(emlisp::type_mismatch_error e) {
             std::cout << "error: " << e.what() << ". expected: " << e.expected
@@ -57,6 +92,7 @@ void eggv_app::init_script_runtime() {
         } catch(std::runtime_error e) { std::cout << "error: " << e.what(); }
 
         script_runtime->collect_garbage(&hfo);
+        frame_stats::add(frame_counter::script_gc_bytes, hfo.old_size - hfo.new_size);
         std::cout << "running init script created " << (hfo.old_size - hfo.new_size)
                   << "b of garbage\n";
     }
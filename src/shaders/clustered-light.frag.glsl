@@ -0,0 +1,87 @@
+#version 450
+#include "lighting.h"
+#ifdef COMPACT_GBUFFER
+#include "gbuffer.h"
+
+layout(input_attachment_index = 0, set = 0, binding = 0) uniform usubpassInput input_gbuffer;
+layout(input_attachment_index = 1, set = 0, binding = 8) uniform subpassInput input_depth;
+#else
+layout(input_attachment_index = 0, set = 0, binding = 0) uniform subpassInput input_position;
+layout(input_attachment_index = 1, set = 0, binding = 1) uniform subpassInput input_normal;
+layout(input_attachment_index = 2, set = 0, binding = 2) uniform subpassInput input_texcoord_mat;
+#endif
+
+layout(location = 0) out vec4 frag_color;
+
+layout(push_constant) uniform cluster_params {
+    uvec4 grid_size;
+    // (scale, bias, near, far) to find the depth slice from a view space depth
+    vec4 slice;
+} clusters;
+
+layout(set = 0, binding = 3) uniform camera {
+    mat4 view;
+    mat4 proj;
+    mat4 inv_proj;
+    vec4 viewport;
+} cam;
+
+layout(set = 0, binding = 4) buffer materials {
+    material data[];
+} mats;
+
+struct point_light {
+    vec4 view_pos_radius;
+    vec4 color_attenuation;
+};
+
+layout(set = 0, binding = 5) readonly buffer point_lights {
+    point_light data[];
+} lights;
+
+// (offset into light_indices, light count) for each cluster
+layout(set = 0, binding = 6) readonly buffer light_clusters {
+    uvec2 data[];
+} cluster_lights;
+
+layout(set = 0, binding = 7) readonly buffer light_indices {
+    uint data[];
+} indices;
+
+void main() {
+#ifdef COMPACT_GBUFFER
+    uvec4 g = subpassLoad(input_gbuffer);
+    if(g.w < 1) discard;
+    vec3 pos = reconstruct_view_pos(subpassLoad(input_depth).r, gl_FragCoord.xy,
+        cam.inv_proj, cam.viewport);
+    vec3 nor = decode_gbuffer_normal(g);
+    vec3 albedo = decode_gbuffer_albedo(g);
+    material mat = mats.data[g.w - 1];
+#else
+    vec4 txc_mat = subpassLoad(input_texcoord_mat);
+    if(txc_mat.w < 1.f) discard;
+    vec3 pos = subpassLoad(input_position).xyz;
+    vec3 nor = subpassLoad(input_normal).xyz;
+    vec3 albedo = txc_mat.xyz;
+    material mat = mats.data[uint(txc_mat.w) - 1];
+#endif
+
+    uvec3 c = uvec3(
+        uvec2(gl_FragCoord.xy * cam.viewport.zw * vec2(clusters.grid_size.xy)),
+        uint(max(log(-pos.z) * clusters.slice.x + clusters.slice.y, 0.0)));
+    c = min(c, clusters.grid_size.xyz - 1);
+    uvec2 cl = cluster_lights.data[c.x + clusters.grid_size.x * (c.y + clusters.grid_size.y * c.z)];
+
+    vec3 result = vec3(0.0);
+    for(uint i = 0; i < cl.y; ++i) {
+        point_light light = lights.data[indices.data[cl.x + i]];
+        vec3 L = light.view_pos_radius.xyz - pos;
+        float d = length(L);
+        if(d > light.view_pos_radius.w) continue;
+        L /= d;
+
+        vec3 Lcol = light.color_attenuation.xyz * (1.0 / (1.0 + light.color_attenuation.w * d * d));
+        result += compute_lighting(nor, -L, Lcol, mat, albedo);
+    }
+    frag_color = vec4(result, 1.0);
+}
@@ -1,22 +1,38 @@
 #version 450
 #include "lighting.h"
+#ifdef COMPACT_GBUFFER
+#include "gbuffer.h"
 
+layout(input_attachment_index = 0, set = 0, binding = 0) uniform usubpassInput input_gbuffer;
+layout(input_attachment_index = 1, set = 0, binding = 6) uniform subpassInput input_depth;
+#else
 layout(input_attachment_index = 0, set = 0, binding = 0) uniform subpassInput input_position;
 layout(input_attachment_index = 1, set = 0, binding = 1) uniform subpassInput input_normal;
 layout(input_attachment_index = 2, set = 0, binding = 2) uniform subpassInput input_texcoord_mat;
+#endif
 
 layout(location = 0) out vec4 frag_color;
 
-layout(push_constant) uniform light_u {
+layout(push_constant) uniform push_constants {
+    uint light_count;
+} pc;
+
+struct directional_light {
     vec4 direction;
     vec3 color;
     int shadow_index;
     mat4 shadow_viewproj;
-} light;
+};
+
+layout(set = 0, binding = 7) readonly buffer directional_lights {
+    directional_light data[];
+} lights;
 
 layout(set = 0, binding = 3) uniform camera {
     mat4 view;
     mat4 proj;
+    mat4 inv_proj;
+    vec4 viewport;
 } cam;
 
 layout(set = 0, binding = 4) buffer materials {
@@ -26,24 +42,36 @@ layout(set = 0, binding = 4) buffer materials {
 layout(set = 0, binding = 5) uniform sampler2DArray shadow_map;
 
 void main() {
+#ifdef COMPACT_GBUFFER
+    uvec4 g = subpassLoad(input_gbuffer);
+    if(g.w < 1) discard;
+    vec4 view_pos = vec4(reconstruct_view_pos(subpassLoad(input_depth).r, gl_FragCoord.xy,
+        cam.inv_proj, cam.viewport), 1.0f);
+    material mat = mats.data[g.w - 1];
+    vec3 nor = decode_gbuffer_normal(g);
+    vec3 albedo = decode_gbuffer_albedo(g);
+#else
     vec4 txc_mat = subpassLoad(input_texcoord_mat);
     if(txc_mat.w < 1.f) discard;
     vec4 view_pos = vec4(subpassLoad(input_position).xyz, 1.0f);
-
-    vec3 L = light.direction.xyz;
     material mat = mats.data[uint(txc_mat.w) - 1];
     vec3 nor = subpassLoad(input_normal).xyz;
+    vec3 albedo = txc_mat.xyz;
+#endif
 
-    bool in_shadow = false;
-    if(light.shadow_index >= 0) {
-        vec4 shadow_pos = light.shadow_viewproj * view_pos;
-        float v = texture(shadow_map, vec3(shadow_pos.xy, light.shadow_index)).r;
-        /* frag_color = vec4(max(v - shadow_pos.z, 0.0), max(-(v-shadow_pos.z), 0.0), 0.0, 1.); */
-        /* return; */
-        in_shadow = v < shadow_pos.z;
-    }
+    vec3 result = vec3(0.0);
+    for(uint i = 0; i < pc.light_count; ++i) {
+        directional_light light = lights.data[i];
+        vec3 L = light.direction.xyz;
+
+        bool in_shadow = false;
+        if(light.shadow_index >= 0) {
+            vec4 shadow_pos = light.shadow_viewproj * view_pos;
+            float v = texture(shadow_map, vec3(shadow_pos.xy, light.shadow_index)).r;
+            in_shadow = v < shadow_pos.z;
+        }
 
-    frag_color = vec4(compute_lighting(nor, L, light.color.rgb, mat, txc_mat.xyz) * (in_shadow ? 0.2 : 1.0),1.0);
-    /* float x = texture(shadow_map, vec3(txc_mat.xy, light.shadow_index)).r*0.01; */
-    /* frag_color = vec4(x, x, x, 1.f); */
+        result += compute_lighting(nor, L, light.color.rgb, mat, albedo) * (in_shadow ? 0.2 : 1.0);
+    }
+    frag_color = vec4(result, 1.0);
 }
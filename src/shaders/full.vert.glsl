@@ -7,6 +7,16 @@ layout(location = 2) in vec2 in_tex_coord;
 layout(location = 0) out vec3 view_pos;
 layout(location = 1) out vec3 view_nor;
 layout(location = 2) out vec2 tex_coord;
+#ifdef OBJECT_BUFFER
+#include "occlusion.h"
+
+layout(location = 3) flat out uint material_index;
+
+// indirect draws pass the object index as the first instance
+layout(binding = 2) readonly buffer objects_buf {
+    cull_object objects[];
+};
+#endif
 
 layout(push_constant) uniform push_constants {
     mat4 world;
@@ -19,10 +29,16 @@ layout(binding = 0) uniform camera {
 } cam;
 
 void main() {
+#ifdef OBJECT_BUFFER
+    mat4 world = objects[gl_InstanceIndex].world;
+    material_index = objects[gl_InstanceIndex].material_index;
+#else
+    mat4 world = pc.world;
+#endif
     tex_coord = in_tex_coord;
-    vec4 _world_pos =  pc.world * vec4(pos, 1.0);
+    vec4 _world_pos =  world * vec4(pos, 1.0);
     vec4 _view_pos = cam.view * _world_pos;
     view_pos = _view_pos.xyz;
-    view_nor = normalize((cam.view * pc.world * vec4(nor, 0.0)).xyz);
+    view_nor = normalize((cam.view * world * vec4(nor, 0.0)).xyz);
     gl_Position = (cam.proj * _view_pos);
 }
@@ -1,22 +1,49 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
+#include "lighting.h"
+#ifdef COMPACT_GBUFFER
+#include "gbuffer.h"
+#endif
 
 layout(location = 0) in vec3 view_pos;
 layout(location = 1) in vec3 view_nor;
 layout(location = 2) in vec2 tex_coord;
+#ifdef OBJECT_BUFFER
+layout(location = 3) flat in uint object_material_index;
+#endif
 
+#ifdef COMPACT_GBUFFER
+layout(location = 0) out uvec4 gbuffer;
+#else
 layout(location = 0) out vec4 position_buf;
 layout(location = 1) out vec4 normal_buf;
 layout(location = 2) out vec4 texture_material_buf;
+#endif
 
 layout(push_constant) uniform push_constants {
     mat4 world;
     uint material_index;
 } pc;
 
-layout(set = 1, binding = 0) uniform sampler2D tex_diffuse;
+layout(set = 0, binding = 1) readonly buffer materials {
+    material data[];
+} mats;
+
+layout(set = 1, binding = 0) uniform sampler2D textures[];
 
 void main() {
+#ifdef OBJECT_BUFFER
+    uint material_index = object_material_index;
+#else
+    uint material_index = pc.material_index;
+#endif
+    material mat = mats.data[material_index];
+    vec3 albedo = texture(textures[nonuniformEXT(mat.diffuse_tex)], tex_coord).xyz;
+#ifdef COMPACT_GBUFFER
+    gbuffer = encode_gbuffer(normalize(view_nor), albedo, tex_coord, material_index);
+#else
     position_buf = vec4(view_pos, tex_coord.x);
     normal_buf = vec4(view_nor, tex_coord.y);
-    texture_material_buf = vec4(texture(tex_diffuse, tex_coord).xyz, pc.material_index + 1);
+    texture_material_buf = vec4(albedo, material_index + 1);
+#endif
 }
@@ -0,0 +1,49 @@
+// compact geometry buffer layout, packed into a single RGBA32UI attachment:
+//   x: view space normal, octahedral encoded as snorm16x2
+//   y: albedo as unorm8x4
+//   z: texture coordinates as half2
+//   w: material index + 1, zero means no geometry
+// view space position is reconstructed from the depth buffer
+
+vec2 oct_wrap(vec2 v) {
+    return (1.0 - abs(v.yx)) * mix(vec2(-1.0), vec2(1.0), greaterThanEqual(v, vec2(0.0)));
+}
+
+vec2 oct_encode(vec3 n) {
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    return n.z >= 0.0 ? n.xy : oct_wrap(n.xy);
+}
+
+vec3 oct_decode(vec2 f) {
+    vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+    float t = clamp(-n.z, 0.0, 1.0);
+    n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0.0)));
+    return normalize(n);
+}
+
+uvec4 encode_gbuffer(vec3 nor, vec3 albedo, vec2 tex_coord, uint material_index) {
+    return uvec4(
+        packSnorm2x16(oct_encode(nor)),
+        packUnorm4x8(vec4(albedo, 0.0)),
+        packHalf2x16(tex_coord),
+        material_index + 1);
+}
+
+vec3 decode_gbuffer_normal(uvec4 g) {
+    return oct_decode(unpackSnorm2x16(g.x));
+}
+
+vec3 decode_gbuffer_albedo(uvec4 g) {
+    return unpackUnorm4x8(g.y).xyz;
+}
+
+vec2 decode_gbuffer_tex_coord(uvec4 g) {
+    return unpackHalf2x16(g.z);
+}
+
+// viewport is (width, height, 1/width, 1/height)
+vec3 reconstruct_view_pos(float depth, vec2 frag_coord, mat4 inv_proj, vec4 viewport) {
+    vec4 ndc = vec4(frag_coord * viewport.zw * 2.0 - 1.0, depth, 1.0);
+    vec4 p = inv_proj * ndc;
+    return p.xyz / p.w;
+}
@@ -0,0 +1,42 @@
+#version 450
+
+// builds one level of the depth pyramid. level 0 is a copy of the depth buffer, every level after
+// that takes the farthest depth of the texels it covers in the level before it
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(set = 0, binding = 0) uniform sampler2D depth;
+layout(set = 0, binding = 1, r32f) uniform image2D levels[16];
+
+layout(set = 0, binding = 3) uniform frame_uniforms {
+    mat4 view, proj, inv_proj;
+    vec4 viewport;
+} frame;
+
+layout(push_constant) uniform push_constants {
+    uint level;
+    uint level_count;
+    uint object_count;
+} pc;
+
+void main() {
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = imageSize(levels[pc.level]);
+    if(any(greaterThanEqual(p, size))) return;
+#ifdef FROM_DEPTH
+    // with dynamic resolution only the top left corner was rendered this frame, the rest is
+    // whatever an earlier frame left there
+    float d = all(lessThan(p, ivec2(frame.viewport.xy))) ? texelFetch(depth, p, 0).x : 1.0;
+#else
+    ivec2 src_size = imageSize(levels[pc.level - 1]);
+    ivec2 lo = p * 2;
+    // the last texel of a level also covers the leftover texel when the level before it has an
+    // odd size, so that the pyramid stays conservative
+    ivec2 hi = min(lo + 1 + ivec2(equal(p, size - 1)) * (src_size & 1), src_size - 1);
+    float d = 0.0;
+    for(int y = lo.y; y <= hi.y; ++y)
+        for(int x = lo.x; x <= hi.x; ++x)
+            d = max(d, imageLoad(levels[pc.level - 1], ivec2(x, y)).x);
+#endif
+    imageStore(levels[pc.level], p, vec4(d));
+}
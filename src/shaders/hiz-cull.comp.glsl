@@ -0,0 +1,91 @@
+#version 450
+#include "occlusion.h"
+
+// tests every object's bounding box against the depth pyramid built from the first phase. visible
+// objects that weren't drawn in the first phase get a draw command for the second phase, and every
+// object's visibility is written out so the CPU can pick next frame's first phase
+
+layout(local_size_x = 64) in;
+
+// levels 1.. of the pyramid, level 0 is only used to build it
+layout(set = 0, binding = 2) uniform sampler2D pyramid;
+
+layout(set = 0, binding = 3) uniform frame_uniforms {
+    mat4 view, proj, inv_proj;
+    vec4 viewport;
+} frame;
+
+layout(set = 0, binding = 4) readonly buffer objects_buf {
+    cull_object objects[];
+};
+
+layout(set = 0, binding = 5) writeonly buffer visibility_buf {
+    uint visibility[];
+};
+
+layout(set = 0, binding = 6) writeonly buffer commands_buf {
+    draw_command commands[];
+};
+
+layout(set = 0, binding = 7) buffer counts_buf {
+    uint counts[];
+};
+
+layout(push_constant) uniform push_constants {
+    uint level;
+    uint level_count;
+    uint object_count;
+} pc;
+
+bool is_visible(cull_object obj) {
+    mat4 T = frame.proj * frame.view * obj.world;
+    vec3 ndc_min = vec3(1e30), ndc_max = vec3(-1e30);
+    for(int c = 0; c < 8; ++c) {
+        vec3 corner = mix(
+            obj.bounds_min.xyz, obj.bounds_max.xyz, vec3(c & 1, (c >> 1) & 1, c >> 2));
+        vec4 clip = T * vec4(corner, 1.0);
+        // the box reaches past the near plane, so its screen rect would be wrong
+        if(clip.w <= 0.0 || clip.z < 0.0) return true;
+        vec3 ndc = clip.xyz / clip.w;
+        ndc_min = min(ndc_min, ndc);
+        ndc_max = max(ndc_max, ndc);
+    }
+
+    // outside of the frustum
+    if(any(greaterThan(ndc_min.xy, vec2(1.0))) || any(lessThan(ndc_max.xy, vec2(-1.0)))
+        || ndc_min.z > 1.0)
+        return false;
+
+    // the pixels the box covers at the render resolution
+    vec2 size = frame.viewport.xy;
+    ivec2 pmin = ivec2(clamp(floor((ndc_min.xy * 0.5 + 0.5) * size), vec2(0.0), size - 1.0));
+    ivec2 pmax = ivec2(clamp(floor((ndc_max.xy * 0.5 + 0.5) * size), vec2(0.0), size - 1.0));
+
+    // pick the level where the rect covers at most 2x2 texels
+    ivec2 extent = pmax - pmin + 1;
+    int level = max(1, int(ceil(log2(float(max(extent.x, extent.y))))));
+    if(level >= int(pc.level_count)) return true;
+    int mip = level - 1;
+    ivec2 last = textureSize(pyramid, mip) - 1;
+    ivec2 lo = min(pmin >> level, last);
+    ivec2 hi = min(pmax >> level, last);
+    float d = max(
+        max(texelFetch(pyramid, lo, mip).x, texelFetch(pyramid, ivec2(hi.x, lo.y), mip).x),
+        max(texelFetch(pyramid, ivec2(lo.x, hi.y), mip).x, texelFetch(pyramid, hi, mip).x));
+
+    // occluded if the nearest point of the box is behind everything drawn there
+    return ndc_min.z <= d;
+}
+
+void main() {
+    uint i = gl_GlobalInvocationID.x;
+    if(i >= pc.object_count) return;
+    cull_object obj = objects[i];
+    bool visible = is_visible(obj);
+    visibility[i] = visible ? 1u : 0u;
+    if(visible && obj.drawn == 0) {
+        uint slot = atomicAdd(counts[obj.count_index], 1u);
+        commands[obj.command_base + slot]
+            = draw_command(obj.index_count, 1u, obj.first_index, obj.vertex_offset, i);
+    }
+}
@@ -1,6 +1,8 @@
 
 struct material {
     vec4 base_color;
+    // index into the bindless texture array
+    uint diffuse_tex;
 };
 
 vec3 compute_lighting(vec3 nor, vec3 L, vec3 Lcol, material mat, vec3 tex_col) {
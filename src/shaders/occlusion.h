@@ -0,0 +1,25 @@
+// objects tested by the occlusion culling node, see `gpu_cull_object` in occlusion.h
+struct cull_object {
+    mat4 world;
+    vec4 bounds_min;
+    vec4 bounds_max;
+    uint index_count;
+    uint first_index;
+    int vertex_offset;
+    uint material_index;
+    // where the object's second phase draw goes if it turns out to be visible
+    uint count_index;
+    uint command_base;
+    // nonzero if the object was drawn in the first phase
+    uint drawn;
+    uint _pad;
+};
+
+// VkDrawIndexedIndirectCommand
+struct draw_command {
+    uint index_count;
+    uint instance_count;
+    uint first_index;
+    int vertex_offset;
+    uint first_instance;
+};
@@ -1,22 +1,37 @@
 #version 450
 #include "lighting.h"
+#ifdef COMPACT_GBUFFER
+#include "gbuffer.h"
 
+layout(input_attachment_index = 0, set = 0, binding = 0) uniform usubpassInput input_gbuffer;
+layout(input_attachment_index = 1, set = 0, binding = 5) uniform subpassInput input_depth;
+#else
 layout(input_attachment_index = 0, set = 0, binding = 0) uniform subpassInput input_position;
 layout(input_attachment_index = 1, set = 0, binding = 1) uniform subpassInput input_normal;
 layout(input_attachment_index = 2, set = 0, binding = 2) uniform subpassInput input_texcoord_mat;
+#endif
+
+layout(location = 0) flat in uint light_index;
 
 layout(location = 0) out vec4 frag_color;
 
-layout(push_constant) uniform light_u {
+struct point_light_volume {
     mat4 world;
+    // (attenuation, radius, _, _)
     vec4 param;
     vec4 color;
     vec4 view_pos;
-} light;
+};
+
+layout(set = 0, binding = 6) readonly buffer point_light_volumes {
+    point_light_volume data[];
+} lights;
 
 layout(set = 0, binding = 3) uniform camera {
     mat4 view;
     mat4 proj;
+    mat4 inv_proj;
+    vec4 viewport;
 } cam;
 
 layout(set = 0, binding = 4) buffer materials {
@@ -24,17 +39,31 @@ layout(set = 0, binding = 4) buffer materials {
 } mats;
 
 void main() {
+#ifdef COMPACT_GBUFFER
+    uvec4 g = subpassLoad(input_gbuffer);
+    if(g.w < 1) discard;
+    vec3 pos = reconstruct_view_pos(subpassLoad(input_depth).r, gl_FragCoord.xy,
+        cam.inv_proj, cam.viewport);
+    vec3 nor = decode_gbuffer_normal(g);
+    vec3 albedo = decode_gbuffer_albedo(g);
+    material mat = mats.data[g.w - 1];
+#else
     vec4 txc_mat = subpassLoad(input_texcoord_mat);
     if(txc_mat.w < 1.f) discard;
     vec3 pos = subpassLoad(input_position).xyz;
     vec3 nor = subpassLoad(input_normal).xyz;
+    vec3 albedo = txc_mat.xyz;
 
     material mat = mats.data[uint(txc_mat.w) - 1];
+#endif
 
+    point_light_volume light = lights.data[light_index];
     vec3 L = light.view_pos.xyz - pos;
     float d = length(L);
+    // the volume covers pixels in front of and behind the light as well, reject those
+    if(d > light.param.y) discard;
     L /= d;
 
     vec3 Lcol = light.color.xyz * (1.0 / (1.0 + light.param.x * d * d));
-    frag_color = vec4(compute_lighting(nor, -L, Lcol, mat, txc_mat.xyz), 1.0);
+    frag_color = vec4(compute_lighting(nor, -L, Lcol, mat, albedo), 1.0);
 }
@@ -4,10 +4,18 @@ layout(location = 0) in vec3 pos;
 layout(location = 1) in vec3 nor;
 layout(location = 2) in vec2 in_tex_coord;
 
-layout(push_constant) uniform push_constants {
+layout(location = 0) flat out uint light_index;
+
+struct point_light_volume {
     mat4 world;
-    vec4 param, color, light_view_pos;
-} pc;
+    vec4 param;
+    vec4 color;
+    vec4 view_pos;
+};
+
+layout(binding = 6) readonly buffer point_light_volumes {
+    point_light_volume data[];
+} lights;
 
 layout(binding = 3) uniform camera {
     mat4 view;
@@ -15,7 +23,8 @@ layout(binding = 3) uniform camera {
 } cam;
 
 void main() {
-    vec4 _world_pos =  pc.world * vec4(pos, 1.0);
+    light_index = uint(gl_InstanceIndex);
+    vec4 _world_pos =  lights.data[gl_InstanceIndex].world * vec4(pos, 1.0);
     vec4 _view_pos = cam.view * _world_pos;
     gl_Position = (cam.proj * _view_pos);
 }
@@ -1,5 +1,6 @@
 #version 460
 #extension GL_EXT_nonuniform_qualifier : require
+#include "lighting.h"
 
 layout(location = 0) in vec3 view_pos;
 layout(location = 1) in vec3 view_nor;
@@ -8,11 +9,16 @@ layout(location = 0) out vec4 frag_color;
 
 layout(push_constant) uniform push_constants {
 	mat4 world;
-	vec3 color;
+	uint material_index;
 } pc;
 
-layout(set = 1, binding = 0) uniform sampler2D tex_diffuse;
+layout(set = 0, binding = 1) readonly buffer materials {
+	material data[];
+} mats;
+
+layout(set = 1, binding = 0) uniform sampler2D textures[];
 
 void main() {
-   frag_color = vec4(pc.color, 1.f) * texture(tex_diffuse, tex_coord);
+   material mat = mats.data[pc.material_index];
+   frag_color = mat.base_color * texture(textures[nonuniformEXT(mat.diffuse_tex)], tex_coord);
 }
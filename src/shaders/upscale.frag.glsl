@@ -0,0 +1,18 @@
+#version 450
+
+layout(set = 0, binding = 0) uniform sampler2D input_color;
+
+layout(location = 0) out vec4 frag_color;
+
+layout(push_constant) uniform push_constants {
+    // (render width / full width, render height / full height, 1 / full width, 1 / full height)
+    vec4 scale;
+} pc;
+
+void main() {
+    // the input was rendered into the top left corner of a full size framebuffer. stay half a
+    // texel inside that corner so that filtering never picks up anything outside of it
+    vec2 uv = gl_FragCoord.xy * pc.scale.zw * pc.scale.xy;
+    uv = min(uv, pc.scale.xy - 0.5 * pc.scale.zw);
+    frag_color = vec4(texture(input_color, uv).rgb, 1.0);
+}
@@ -0,0 +1,224 @@
+#include "stress_scene.h"
+#include "geometry_set.h"
+#include "mesh_gen.h"
+#include <random>
+
+stress_scene_desc stress_scene_desc::parse(std::string_view spec) {
+    stress_scene_desc desc;
+    while(!spec.empty()) {
+        auto end  = spec.find(',');
+        auto pair = spec.substr(0, end);
+        spec      = end == std::string_view::npos ? std::string_view() : spec.substr(end + 1);
+        auto eq   = pair.find('=');
+        if(eq == std::string_view::npos)
+            throw std::runtime_error("expected key=value in stress scene: " + std::string(pair));
+        auto key   = pair.substr(0, eq);
+        auto value = std::string(pair.substr(eq + 1));
+        if(key == "seed")
+            desc.seed = std::stoul(value);
+        else if(key == "entities")
+            desc.entities = std::stoul(value);
+        else if(key == "branching")
+            desc.branching = std::stoul(value);
+        else if(key == "materials")
+            desc.materials = std::stoul(value);
+        else if(key == "point_lights")
+            desc.point_lights = std::stoul(value);
+        else if(key == "directional_lights")
+            desc.directional_lights = std::stoul(value);
+        else if(key == "bundle_geometry")
+            desc.bundle_geometry = std::stoul(value) != 0;
+        else if(key == "motion")
+            desc.motion = std::stoul(value) != 0;
+        else if(key == "extent")
+            desc.extent = std::stof(value);
+        else
+            throw std::runtime_error("unknown stress scene option: " + std::string(key));
+    }
+    return desc;
+}
+
+void stress_motion_system::update(const frame_state& fs) {
+    auto  w          = cur_world.lock();
+    auto& transforms = *w->system<transform_system>();
+    for(const auto& [id, motion] : entity_data) {
+        auto& trf    = transforms.get_data_for_entity(id);
+        auto  spin   = glm::angleAxis(motion.speed * fs.dt, motion.axis);
+        trf.rotation = glm::normalize(spin * trf.rotation);
+    }
+}
+
+namespace {
+// mt19937 is fully specified by the standard, unlike the distributions, so scenes come out the
+// same with every standard library
+struct scene_rng {
+    std::mt19937 gen;
+
+    scene_rng(uint32_t seed) : gen(seed) {}
+
+    // uniform in [0, 1)
+    float unit() { return (float)(gen() >> 8) * (1.f / 16777216.f); }
+
+    float range(float lo, float hi) { return lo + (hi - lo) * unit(); }
+
+    vec3 in_cube(float half_size) {
+        float x = range(-half_size, half_size);
+        float y = range(-half_size, half_size);
+        float z = range(-half_size, half_size);
+        return vec3(x, y, z);
+    }
+
+    vec3 direction() {
+        vec3 d;
+        // rejection sample so that directions are uniform
+        do
+            d = in_cube(1.f);
+        while(glm::dot(d, d) > 1.f || glm::dot(d, d) < 1e-4f);
+        return glm::normalize(d);
+    }
+
+    size_t index(size_t count) { return (size_t)(unit() * (float)count) % count; }
+};
+
+// either a generated shape or a mesh from one of the bundle's geometry sets
+struct mesh_source {
+    std::shared_ptr<mesh>         m;
+    aabb                          bounds;
+    std::shared_ptr<geometry_set> geo_src;
+    size_t                        mesh_index;
+
+    renderable make(std::shared_ptr<material> mat) const {
+        if(geo_src != nullptr) return renderable(geo_src, mesh_index, std::move(mat));
+        renderable rd(nullptr, 0, std::move(mat));
+        rd.m      = m;
+        rd.bounds = bounds;
+        return rd;
+    }
+};
+
+std::vector<mesh_source> collect_meshes(
+    const std::shared_ptr<bundle>& bndl, device* dev, const stress_scene_desc& desc
+) {
+    std::vector<mesh_source> meshes;
+    {
+        // all the shapes go out in one submission, the renderer skips them until they're ready
+        mesh_upload_batch uploads{dev};
+        auto add_shape = [&](mesh&& m, vec3 lo, vec3 hi) {
+            meshes.push_back(mesh_source{std::make_shared<mesh>(std::move(m)), aabb(lo, hi)});
+        };
+        add_shape(mesh_gen::generate_sphere(dev, 16, 16), vec3(-1.f), vec3(1.f));
+        add_shape(mesh_gen::generate_cylinder(dev, 16, 4), vec3(-1.f, -1.f, 0.f), vec3(1.f));
+        add_shape(mesh_gen::generate_cone(dev, 16, 4), vec3(-1.f, -1.f, 0.f), vec3(1.f));
+        add_shape(
+            mesh_gen::generate_torus(dev, 16, 16, 0.25f),
+            vec3(-1.25f, -1.25f, -0.25f),
+            vec3(1.25f, 1.25f, 0.25f)
+        );
+    }
+    if(desc.bundle_geometry) {
+        // geometry sets are in an unordered map, so sort them to keep the scene deterministic
+        std::vector<std::shared_ptr<geometry_set>> sets;
+        for(const auto& [_, gs] : bndl->geometry_sets)
+            sets.push_back(gs);
+        std::sort(sets.begin(), sets.end(), [](const auto& a, const auto& b) {
+            return a->name < b->name;
+        });
+        for(const auto& gs : sets)
+            for(int32 i = 0; i < gs->num_meshes(); ++i)
+                meshes.push_back(mesh_source{nullptr, aabb(), gs, (size_t)i});
+    }
+    return meshes;
+}
+}  // namespace
+
+entity generate_stress_scene(
+    const std::shared_ptr<world>&  w,
+    const std::shared_ptr<bundle>& bndl,
+    device*                        dev,
+    const stress_scene_desc&       desc
+) {
+    scene_rng rng{desc.seed};
+
+    std::vector<std::shared_ptr<material>> materials;
+    for(uint32_t i = 0; i < desc.materials; ++i) {
+        auto name = "stress " + std::to_string(desc.seed) + "/" + std::to_string(i);
+        materials.push_back(std::make_shared<material>(
+            bndl, name, vec3(rng.unit(), rng.unit(), rng.unit())
+        ));
+        bndl->materials.push_back(materials.back());
+    }
+    if(!materials.empty())
+        bndl->materials_changed = true;
+    else
+        materials = bndl->materials;
+
+    auto meshes = collect_meshes(bndl, dev, desc);
+
+    auto root = w->create_entity("stress scene " + std::to_string(desc.seed));
+    root.add_component<transform_system>(transform{});
+
+    std::vector<entity> entities;
+    std::vector<float>  levels;
+    entities.reserve(desc.entities);
+    levels.reserve(desc.entities);
+    for(uint32_t i = 0; i < desc.entities; ++i) {
+        // with branching, entity i is a child of entity (i-1)/branching, so the tree is filled
+        // level by level
+        bool   nested = desc.branching > 0 && i > 0;
+        size_t parent = nested ? (i - 1) / desc.branching : 0;
+        float  level  = nested ? levels[parent] + 1.f : 0.f;
+        auto   e      = nested ? entities[parent].add_child() : root.add_child();
+
+        // children are placed around their parent, closer the deeper they are
+        float spread = desc.extent / glm::pow(2.f, level);
+        e.add_component<transform_system>(transform(
+            rng.in_cube(spread),
+            glm::angleAxis(rng.range(0.f, glm::two_pi<float>()), rng.direction()),
+            vec3(rng.range(0.75f, 1.25f))
+        ));
+        const auto& src = meshes[rng.index(meshes.size())];
+        auto        mat = materials.empty() ? nullptr : materials[rng.index(materials.size())];
+        e.add_component<renderer>(src.make(mat));
+        if(desc.motion) {
+            e.add_component<stress_motion_system>(
+                stress_motion{rng.direction(), rng.range(0.1f, 2.f)}
+            );
+        }
+
+        entities.push_back(e);
+        levels.push_back(level);
+    }
+
+    for(uint32_t i = 0; i < desc.point_lights; ++i) {
+        auto e = root.add_child();
+        e.add_component<transform_system>(transform(rng.in_cube(desc.extent)));
+        light l;
+        l.type  = light_type::point;
+        l.param = vec3(rng.range(0.05f, 0.5f), 0.f, 0.f);
+        l.color = vec3(rng.unit(), rng.unit(), rng.unit()) * 4.f;
+        e.add_component<light_system>(l);
+    }
+
+    for(uint32_t i = 0; i < desc.directional_lights; ++i) {
+        auto e = root.add_child();
+        e.add_component<transform_system>(transform{});
+        light l;
+        l.type  = light_type::directional;
+        // always from above
+        auto d  = rng.direction();
+        l.param = glm::normalize(vec3(d.x, -glm::abs(d.y) - 0.1f, d.z));
+        l.color = vec3(rng.range(0.5f, 1.f));
+        e.add_component<light_system>(l);
+    }
+
+    // a camera that sees the whole scene, unless the bundle already has an active one
+    auto cams = w->system<camera_system>();
+    if(!cams->active_camera_id.has_value()) {
+        auto cam = root.add_child("camera");
+        cam.add_component<transform_system>(transform(vec3(0.f, 0.f, desc.extent * 2.5f)));
+        cam.add_component<camera_system>(camera{});
+        cams->active_camera_id = cam;
+    }
+
+    return root;
+}
@@ -2,6 +2,11 @@
 #include "app.h"
 
 result<uint32_t, vk::Result> swap_chain::aquire_next() {
+    if(offscreen()) {
+        auto index           = next_offscreen_image;
+        next_offscreen_image = (index + 1) % (uint32_t)offscreen_images.size();
+        return result<uint32_t, vk::Result>(index);
+    }
     auto v = dev->dev->acquireNextImageKHR(
         sch.get(), std::numeric_limits<uint64_t>::max(), image_ava_sp.get(), vk::Fence(nullptr)
     );
@@ -12,7 +17,8 @@ result<uint32_t, vk::Result> swap_chain::aquire_next() {
 }
 
 void swap_chain::present(uint32_t index) {
-    vk::PresentInfoKHR ifo{1, &render_fin_sp.get(), 1, &sch.get(), &index};
+    if(offscreen()) return;
+    vk::PresentInfoKHR ifo{1, &render_fin_sps[index].get(), 1, &sch.get(), &index};
     dev->present_qu.presentKHR(ifo);
 }
 
@@ -21,19 +27,20 @@ void swap_chain::recreate(app* app) {
         iv.reset();
     sch.reset();
     dev->dev->waitIdle();
+    offscreen_images.clear();
     create(app);
 }
 
 std::vector<vk::UniqueFramebuffer> swap_chain::create_framebuffers(
     vk::RenderPass                                           rnp,
     std::function<void(size_t, std::vector<vk::ImageView>&)> additional_image_views,
-    bool                                                     include_depth
+    bool                                                     include_depth,
+    bool                                                     include_swap_chain_image
 ) {
     std::vector<vk::UniqueFramebuffer> framebuffers(image_views.size());
     for(size_t i = 0; i < image_views.size(); ++i) {
-        std::vector<vk::ImageView> att = {
-            image_views[i].get(),
-        };
+        std::vector<vk::ImageView> att;
+        if(include_swap_chain_image) att.push_back(image_views[i].get());
         additional_image_views(i, att);
         framebuffers[i] = dev->dev->createFramebufferUnique(vk::FramebufferCreateInfo{
             vk::FramebufferCreateFlags(),
@@ -47,25 +54,39 @@ std::vector<vk::UniqueFramebuffer> swap_chain::create_framebuffers(
     return framebuffers;
 }
 
-swap_chain::swap_chain(app* app, device* dev) : dev(dev) {
+swap_chain::swap_chain(app* app, device* dev, present_options options)
+    : dev(dev), options(options), present_mode(options.mode), next_offscreen_image(0) {
     create(app);
-    vk::SemaphoreCreateInfo spcfo;
-    image_ava_sp  = dev->dev->createSemaphoreUnique(spcfo);
-    render_fin_sp = dev->dev->createSemaphoreUnique(spcfo);
+    image_ava_sp = dev->dev->createSemaphoreUnique(vk::SemaphoreCreateInfo{});
 }
 
-swap_chain::~swap_chain() {}
+swap_chain::~swap_chain() {
+    // views first, offscreen images are destroyed along with the swap chain
+    image_views.clear();
+}
 
 void swap_chain::create(app* app) {
+    if(app->headless) {
+        create_offscreen(app);
+        return;
+    }
     auto surf_caps = dev->pdevice.getSurfaceCapabilitiesKHR(app->surface);
     /*std::cout << "Surface capabilities:\n"
         << "\tMin images  = " << surf_caps.minImageCount << "\n"
         << "\tMax images  = " << surf_caps.maxImageCount << "\n"
         << "\tComp alpha  = " << vk::to_string(surf_caps.supportedCompositeAlpha) << "\n"
         << "\tUsage flags = " << vk::to_string(surf_caps.supportedUsageFlags) << "\n";*/
-    uint32_t image_count = surf_caps.minImageCount + 1;
+    uint32_t image_count = std::max(
+        options.image_count > 0 ? options.image_count : surf_caps.minImageCount + 1,
+        surf_caps.minImageCount
+    );
     if(surf_caps.maxImageCount > 0 && image_count > surf_caps.maxImageCount)
         image_count = surf_caps.maxImageCount;
+    supported_present_modes = dev->pdevice.getSurfacePresentModesKHR(app->surface);
+    present_mode            = vk::PresentModeKHR::eFifo;
+    if(std::find(supported_present_modes.begin(), supported_present_modes.end(), options.mode)
+       != supported_present_modes.end())
+        present_mode = options.mode;
     vk::SwapchainCreateInfoKHR cfo;
     cfo.surface       = app->surface;
     cfo.minImageCount = image_count;
@@ -86,7 +107,7 @@ void swap_chain::create(app* app) {
     }
     cfo.preTransform   = surf_caps.currentTransform;
     cfo.compositeAlpha = vk::CompositeAlphaFlagBitsKHR::eOpaque;
-    cfo.presentMode    = vk::PresentModeKHR::eFifo;
+    cfo.presentMode    = present_mode;
     cfo.clipped        = true;
 
     sch = dev->dev->createSwapchainKHRUnique(cfo);
@@ -101,8 +122,42 @@ void swap_chain::create(app* app) {
     ivcfo.subresourceRange.baseArrayLayer = 0;
     ivcfo.subresourceRange.layerCount     = 1;
     image_views.clear();
+    render_fin_sps.clear();
     for(auto img : images) {
         ivcfo.image = img;
         image_views.push_back(dev->dev->createImageViewUnique(ivcfo));
+        render_fin_sps.push_back(dev->dev->createSemaphoreUnique(vk::SemaphoreCreateInfo{}));
+    }
+}
+
+void swap_chain::create_offscreen(app* app) {
+    // two images, so that one can be recorded while the other is still in flight
+    const uint32_t image_count = 2;
+    format                     = vk::Format::eB8G8R8A8Unorm;
+    auto winsize               = app->size();
+    extent                     = vk::Extent2D(winsize.x, winsize.y);
+    images.clear();
+    image_views.clear();
+    for(uint32_t i = 0; i < image_count; ++i) {
+        vk::UniqueImageView iv;
+        offscreen_images.emplace_back(std::make_unique<image>(
+            dev,
+            vk::ImageCreateFlags(),
+            vk::ImageType::e2D,
+            vk::Extent3D(extent, 1),
+            format,
+            vk::ImageTiling::eOptimal,
+            vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc,
+            vk::MemoryPropertyFlagBits::eDeviceLocal,
+            1,
+            1,
+            &iv,
+            vk::ImageViewType::e2D,
+            vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1),
+            memory_category::framebuffer
+        ));
+        images.push_back(offscreen_images.back()->img);
+        image_views.push_back(std::move(iv));
     }
+    next_offscreen_image = 0;
 }
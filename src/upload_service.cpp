@@ -0,0 +1,262 @@
+#include "upload_service.h"
+#include "frame_stats.h"
+
+upload_service::upload_service(device* dev)
+    : dev(dev), last_value(0), last_completed(0), dedicated_staging_count(0) {
+    // image copies need offsets that are a multiple of the texel block size, which is at most 16
+    copy_alignment = glm::max(
+        (vk::DeviceSize)16, dev->pdevice.getProperties().limits.optimalBufferCopyOffsetAlignment
+    );
+    transfer_cmdpool = dev->dev->createCommandPoolUnique(vk::CommandPoolCreateInfo{
+        vk::CommandPoolCreateFlagBits::eTransient, (uint32_t)dev->qu_fam.transfer});
+
+    vk::SemaphoreTypeCreateInfo timeline_info{vk::SemaphoreType::eTimeline, last_value};
+    timeline = dev->dev->createSemaphoreUnique(vk::SemaphoreCreateInfo{{}, &timeline_info});
+}
+
+upload_service::batch& upload_service::current_batch() {
+    if(current.has_value()) return current.value();
+    current = batch{};
+    vk::CommandBufferAllocateInfo afo{transfer_cmdpool.get(), vk::CommandBufferLevel::ePrimary, 1};
+    current->transfer_cb = std::move(dev->dev->allocateCommandBuffersUnique(afo)[0]);
+    current->graphics_cb = std::move(dev->alloc_cmd_buffers(1)[0]);
+    current->transfer_cb->begin(
+        vk::CommandBufferBeginInfo{vk::CommandBufferUsageFlagBits::eOneTimeSubmit}
+    );
+    current->dst_stages = vk::PipelineStageFlagBits::eTransfer;
+    return current.value();
+}
+
+staging_allocation upload_service::stage(vk::DeviceSize size) {
+    auto& b = current_batch();
+    frame_stats::add(frame_counter::uploaded_bytes, size);
+    if(size <= dev->staging->size() / 4) {
+        auto offset = dev->staging->allocate(size, copy_alignment);
+        if(offset.has_value()) {
+            return staging_allocation{
+                dev->staging->buffer_handle(),
+                offset.value(),
+                dev->staging->mapped_at(offset.value())};
+        }
+    }
+    dedicated_staging_count++;
+    void* mapped;
+    b.staging.emplace_back(std::make_unique<buffer>(
+        dev,
+        size,
+        vk::BufferUsageFlagBits::eTransferSrc,
+        vk::MemoryPropertyFlagBits::eHostCoherent,
+        &mapped,
+        memory_category::staging
+    ));
+    return staging_allocation{b.staging.back()->buf, 0, mapped};
+}
+
+void upload_service::copy_to_buffer(
+    const staging_allocation& src,
+    vk::DeviceSize            src_offset,
+    vk::Buffer                dst,
+    vk::DeviceSize            dst_offset,
+    vk::DeviceSize            size,
+    vk::PipelineStageFlags    dst_stage,
+    vk::AccessFlags           dst_access
+) {
+    auto& b = current_batch();
+    b.transfer_cb->copyBuffer(
+        src.buf, dst, {vk::BufferCopy(src.offset + src_offset, dst_offset, size)}
+    );
+    bool dedicated = dedicated_transfer();
+    b.buffer_barriers.emplace_back(
+        vk::AccessFlagBits::eTransferWrite,
+        dst_access,
+        dedicated ? (uint32_t)dev->qu_fam.transfer : VK_QUEUE_FAMILY_IGNORED,
+        dedicated ? (uint32_t)dev->qu_fam.graphics : VK_QUEUE_FAMILY_IGNORED,
+        dst,
+        dst_offset,
+        size
+    );
+    b.dst_stages |= dst_stage;
+}
+
+void upload_service::copy_to_image(
+    const staging_allocation& src, const std::shared_ptr<image>& img, uint32_t w, uint32_t h
+) {
+    auto& b = current_batch();
+    auto  all_levels
+        = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, img->info.mipLevels, 0, 1);
+    b.transfer_cb->pipelineBarrier(
+        vk::PipelineStageFlagBits::eTopOfPipe,
+        vk::PipelineStageFlagBits::eTransfer,
+        {},
+        {},
+        {},
+        {vk::ImageMemoryBarrier(
+            {},
+            vk::AccessFlagBits::eTransferWrite,
+            vk::ImageLayout::eUndefined,
+            vk::ImageLayout::eTransferDstOptimal,
+            VK_QUEUE_FAMILY_IGNORED,
+            VK_QUEUE_FAMILY_IGNORED,
+            img->img,
+            all_levels
+        )}
+    );
+    b.transfer_cb->copyBufferToImage(
+        src.buf,
+        img->img,
+        vk::ImageLayout::eTransferDstOptimal,
+        {vk::BufferImageCopy{
+            src.offset,
+            0,
+            0,
+            vk::ImageSubresourceLayers{vk::ImageAspectFlagBits::eColor, 0, 0, 1},
+            {0, 0, 0},
+            {w, h, 1}}}
+    );
+    // ownership moves to the graphics queue still in the transfer layout, mip generation there
+    // does the final transition
+    bool dedicated = dedicated_transfer();
+    b.image_barriers.emplace_back(
+        vk::AccessFlagBits::eTransferWrite,
+        vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite,
+        vk::ImageLayout::eTransferDstOptimal,
+        vk::ImageLayout::eTransferDstOptimal,
+        dedicated ? (uint32_t)dev->qu_fam.transfer : VK_QUEUE_FAMILY_IGNORED,
+        dedicated ? (uint32_t)dev->qu_fam.graphics : VK_QUEUE_FAMILY_IGNORED,
+        img->img,
+        all_levels
+    );
+    b.images.push_back(pending_image{img, w, h});
+}
+
+uint32_t upload_service::mip_count(vk::Format fmt, uint32_t w, uint32_t h) const {
+    auto features = dev->pdevice.getFormatProperties(fmt).optimalTilingFeatures;
+    auto required = vk::FormatFeatureFlagBits::eBlitSrc | vk::FormatFeatureFlagBits::eBlitDst
+                    | vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+    if((features & required) != required) return 1;
+    return glm::max(image::calculate_mipmap_count(w, h), (uint32_t)1);
+}
+
+uint64_t upload_service::pending_value() const {
+    if(!current.has_value()) return last_value;
+    return last_value + (dedicated_transfer() ? 2 : 1);
+}
+
+uint64_t upload_service::submit() {
+    if(!current.has_value()) return last_value;
+    auto& b = current.value();
+
+    bool dedicated = dedicated_transfer();
+    if(dedicated) {
+        // release everything to the graphics queue
+        b.transfer_cb->pipelineBarrier(
+            vk::PipelineStageFlagBits::eTransfer,
+            vk::PipelineStageFlagBits::eBottomOfPipe,
+            {},
+            {},
+            b.buffer_barriers,
+            b.image_barriers
+        );
+    }
+    b.transfer_cb->end();
+
+    // acquire on the graphics queue, which is also the only queue that can blit
+    b.graphics_cb->begin(
+        vk::CommandBufferBeginInfo{vk::CommandBufferUsageFlagBits::eOneTimeSubmit}
+    );
+    b.graphics_cb->pipelineBarrier(
+        vk::PipelineStageFlagBits::eTransfer,
+        b.dst_stages,
+        {},
+        {},
+        b.buffer_barriers,
+        b.image_barriers
+    );
+    for(const auto& pi : b.images) {
+        if(pi.img->info.mipLevels > 1) {
+            pi.img->generate_mipmaps(pi.width, pi.height, b.graphics_cb.get());
+            continue;
+        }
+        b.graphics_cb->pipelineBarrier(
+            vk::PipelineStageFlagBits::eTransfer,
+            vk::PipelineStageFlagBits::eFragmentShader,
+            {},
+            {},
+            {},
+            {vk::ImageMemoryBarrier(
+                vk::AccessFlagBits::eTransferWrite,
+                vk::AccessFlagBits::eShaderRead,
+                vk::ImageLayout::eTransferDstOptimal,
+                vk::ImageLayout::eShaderReadOnlyOptimal,
+                VK_QUEUE_FAMILY_IGNORED,
+                VK_QUEUE_FAMILY_IGNORED,
+                pi.img->img,
+                vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1)
+            )}
+        );
+    }
+    b.graphics_cb->end();
+
+    if(dedicated) {
+        // the graphics side waits for the copies through the same timeline
+        uint64_t                        copied = ++last_value;
+        vk::TimelineSemaphoreSubmitInfo copied_info{0, nullptr, 1, &copied};
+        vk::SubmitInfo                  copy_sfo{
+            0, nullptr, nullptr, 1, &b.transfer_cb.get(), 1, &timeline.get(), &copied_info};
+        dev->transfer_qu.submit(copy_sfo, nullptr);
+
+        b.value                                    = ++last_value;
+        vk::PipelineStageFlags          wait_stage = vk::PipelineStageFlagBits::eAllCommands;
+        vk::TimelineSemaphoreSubmitInfo done_info{1, &copied, 1, &b.value};
+        vk::SubmitInfo                  sfo{
+            1,
+            &timeline.get(),
+            &wait_stage,
+            1,
+            &b.graphics_cb.get(),
+            1,
+            &timeline.get(),
+            &done_info};
+        dev->graphics_qu.submit(sfo, nullptr);
+    } else {
+        b.value                               = ++last_value;
+        vk::CommandBuffer               cbs[] = {b.transfer_cb.get(), b.graphics_cb.get()};
+        vk::TimelineSemaphoreSubmitInfo done_info{0, nullptr, 1, &b.value};
+        vk::SubmitInfo sfo{0, nullptr, nullptr, 2, cbs, 1, &timeline.get(), &done_info};
+        dev->graphics_qu.submit(sfo, nullptr);
+    }
+
+    dev->staging->retire(b.value);
+
+    // the barriers are only needed while recording
+    b.buffer_barriers.clear();
+    b.image_barriers.clear();
+    in_flight.emplace_back(std::move(b));
+    current.reset();
+    return last_value;
+}
+
+uint64_t upload_service::completed_value() const {
+    return dev->dev->getSemaphoreCounterValue(timeline.get());
+}
+
+void upload_service::wait(uint64_t value) {
+    vk::SemaphoreWaitInfo info{{}, 1, &timeline.get(), &value};
+    auto                  res = dev->dev->waitSemaphores(info, UINT64_MAX);
+    assert(res == vk::Result::eSuccess);
+    last_completed = glm::max(last_completed, value);
+}
+
+void upload_service::collect() {
+    if(in_flight.empty()) return;
+    last_completed = completed_value();
+    while(!in_flight.empty() && in_flight.front().value <= last_completed)
+        in_flight.pop_front();
+    dev->staging->reclaim(last_completed);
+}
+
+upload_service::~upload_service() {
+    submit();
+    wait(last_value);
+    in_flight.clear();
+}
@@ -0,0 +1,349 @@
+#include "render_graph.h"
+
+// compiles render graphs with stand-in node prototypes that only describe their framebuffers, so
+// that the graph compiler can be checked and timed without a device
+// usage: render_graph_compile <directory containing test.rg.json and full-render-graph.json>
+
+const vk::Format swap_chain_format = vk::Format::eB8G8R8A8Unorm;
+// a compile that takes longer than this is almost certainly doing something superlinear
+const float compile_time_budget_ms = 1000.f;
+
+struct stub_prototype : public render_node_prototype {
+    size_t      _id;
+    const char* _name;
+    node_kind   _kind;
+    size_t      repeat_count;
+
+    stub_prototype(
+        size_t                        id,
+        const char*                   name,
+        std::vector<framebuffer_desc> in,
+        std::vector<framebuffer_desc> out,
+        size_t                        repeat_count = 1,
+        node_kind                     kind         = node_kind::graphics
+    )
+        : _id(id), _name(name), _kind(kind), repeat_count(repeat_count) {
+        inputs  = std::move(in);
+        outputs = std::move(out);
+    }
+
+    node_kind kind() const override { return _kind; }
+
+    size_t subpass_repeat_count(class renderer* r, struct render_node* node) override {
+        return repeat_count;
+    }
+
+    const char* name() const override { return _name; }
+
+    size_t id() const override { return _id; }
+};
+
+// mirrors the framebuffers of the real prototypes, with a fixed number of lights
+struct stub_prototypes {
+    std::shared_ptr<stub_prototype> output, preview, debug_shapes, physics_shapes, gbuffer,
+        directional_light, point_light, shadowmap, hiz_cull;
+
+    stub_prototypes() {
+        auto geo    = vk::Format::eR32G32B32A32Sfloat;
+        auto undef  = vk::Format::eUndefined;
+        auto color  = framebuffer_type::color;
+        auto depth  = framebuffer_type::depth;
+        auto blend  = framebuffer_mode::blend_input;
+        auto in_att = framebuffer_mode::input_attachment;
+        auto out    = framebuffer_mode::output;
+
+        output = std::make_shared<stub_prototype>(
+            0x0000ffff,
+            "Display Output",
+            std::vector{framebuffer_desc{"color", swap_chain_format, color}},
+            std::vector{framebuffer_desc{"color", undef, color}}
+        );
+        preview = std::make_shared<stub_prototype>(
+            0x0000fffe,
+            "Preview [Color]",
+            std::vector{framebuffer_desc{"color", undef, color}},
+            std::vector<framebuffer_desc>{}
+        );
+        debug_shapes = std::make_shared<stub_prototype>(
+            0x0000fffc,
+            "Viewport Shapes",
+            std::vector{framebuffer_desc{"color", undef, color, blend}},
+            std::vector{framebuffer_desc{"color", undef, color}}
+        );
+        physics_shapes = std::make_shared<stub_prototype>(
+            0x0000aaaa,
+            "Physics Debug Shapes",
+            std::vector{framebuffer_desc{"color", undef, color, blend}},
+            std::vector{framebuffer_desc{"color", undef, color}}
+        );
+        gbuffer = std::make_shared<stub_prototype>(
+            0x00010000,
+            "Geometry Buffer",
+            std::vector{
+                framebuffer_desc{"geometery", geo, color, blend, 3},
+                framebuffer_desc{"depth", undef, depth, blend},
+                framebuffer_desc{
+                    "occlusion", vk::Format::eR32Sfloat, color, framebuffer_mode::shader_input}},
+            std::vector{
+                framebuffer_desc{"geometery", geo, color, out, 3},
+                framebuffer_desc{"depth", undef, depth, out}}
+        );
+        directional_light = std::make_shared<stub_prototype>(
+            0x00010001,
+            "Directional Light",
+            std::vector{
+                framebuffer_desc{"input_color", geo, color, blend},
+                framebuffer_desc{"geometry", geo, color, in_att, 3},
+                framebuffer_desc{"shadowmap", undef, depth, framebuffer_mode::shader_input},
+                framebuffer_desc{"depth", undef, depth, in_att}},
+            std::vector{framebuffer_desc{"color", geo, color, out}},
+            2
+        );
+        point_light = std::make_shared<stub_prototype>(
+            0x00010002,
+            "Point Lights",
+            std::vector{
+                framebuffer_desc{"input_color", geo, color, blend},
+                framebuffer_desc{"geometry", geo, color, in_att, 3},
+                framebuffer_desc{"depth", undef, depth, in_att}},
+            std::vector{framebuffer_desc{"color", geo, color, out}},
+            3
+        );
+        shadowmap = std::make_shared<stub_prototype>(
+            0x00010003,
+            "Directional Light Shadowmap",
+            std::vector<framebuffer_desc>{},
+            std::vector{framebuffer_desc{
+                "depth",
+                undef,
+                depth,
+                out,
+                framebuffer_count_is_subpass_count,
+                framebuffer_subpass_binding_order::sequential}},
+            2
+        );
+        hiz_cull = std::make_shared<stub_prototype>(
+            0x00010006,
+            "Hi-Z Occlusion Cull",
+            std::vector{framebuffer_desc{"depth", undef, depth, framebuffer_mode::shader_input}},
+            std::vector{framebuffer_desc{
+                "hiz", vk::Format::eR32Sfloat, color, framebuffer_mode::storage}},
+            1,
+            node_kind::compute
+        );
+    }
+
+    std::shared_ptr<stub_prototype> find(size_t id) const {
+        for(const auto& p :
+            {output,
+             preview,
+             debug_shapes,
+             physics_shapes,
+             gbuffer,
+             directional_light,
+             point_light,
+             shadowmap,
+             hiz_cull})
+            if(p->id() == id) return p;
+        throw std::runtime_error("no stub for node prototype with id=" + std::to_string(id));
+    }
+};
+
+struct test_graph {
+    std::string                               name;
+    std::vector<std::shared_ptr<render_node>> nodes;
+    std::shared_ptr<render_node>              output;
+
+    std::shared_ptr<render_node> add(const std::shared_ptr<stub_prototype>& p) {
+        auto n = std::make_shared<render_node>(p);
+        n->id  = nodes.size() + 1;
+        nodes.push_back(n);
+        return n;
+    }
+
+    static void connect(
+        const std::shared_ptr<render_node>& src,
+        size_t                              src_idx,
+        const std::shared_ptr<render_node>& dst,
+        size_t                              dst_idx
+    ) {
+        dst->inputs[dst_idx] = {src, src_idx};
+    }
+};
+
+// same layout as renderer::deserialize_render_graph
+test_graph load_graph(const stub_prototypes& protos, const std::filesystem::path& path) {
+    test_graph g{path.filename().string()};
+    std::ifstream input(path);
+    if(!input) throw std::runtime_error("failed to open " + path.string());
+    json data = json::parse(input);
+    for(const auto& [id, node_data] : data.at("nodes").items()) {
+        auto n = std::make_shared<render_node>(
+            protos.find(node_data.at("prototype_id").get<size_t>())
+        );
+        n->id = std::atoll(id.c_str());
+        g.nodes.push_back(n);
+    }
+    for(const auto& [id, node_data] : data.at("nodes").items()) {
+        auto idn  = (size_t)std::atoll(id.c_str());
+        auto node = *std::find_if(g.nodes.begin(), g.nodes.end(), [&](auto n) {
+            return n->id == idn;
+        });
+        auto inputs = node_data.at("inputs");
+        for(size_t i = 0; i < inputs.size(); ++i) {
+            if(inputs[i].is_null()) continue;
+            auto src_id = inputs[i].at("src_node").get<size_t>();
+            auto src    = *std::find_if(g.nodes.begin(), g.nodes.end(), [&](auto n) {
+                return n->id == src_id;
+            });
+            node->inputs[i] = {src, inputs[i].at("src_idx").get<size_t>()};
+        }
+        if(node->prototype == protos.output) g.output = node;
+    }
+    return g;
+}
+
+// a geometry buffer with hi-z culling, then a long chain of alternating directional and point
+// lights that all blend onto the same color buffer
+test_graph light_chain_graph(const stub_prototypes& protos, size_t num_lights) {
+    test_graph g{"synthetic light chain (" + std::to_string(num_lights) + " lights)"};
+    auto       first_phase  = g.add(protos.gbuffer);
+    auto       hiz          = g.add(protos.hiz_cull);
+    auto       second_phase = g.add(protos.gbuffer);
+    auto       shadowmap    = g.add(protos.shadowmap);
+    test_graph::connect(first_phase, 1, hiz, 0);
+    test_graph::connect(first_phase, 0, second_phase, 0);
+    test_graph::connect(first_phase, 1, second_phase, 1);
+    test_graph::connect(hiz, 0, second_phase, 2);
+
+    std::shared_ptr<render_node> color;
+    for(size_t i = 0; i < num_lights; ++i) {
+        bool directional = i % 2 == 0;
+        auto light       = g.add(directional ? protos.directional_light : protos.point_light);
+        if(color != nullptr) test_graph::connect(color, 0, light, 0);
+        test_graph::connect(second_phase, 0, light, 1);
+        if(directional) test_graph::connect(shadowmap, 0, light, 2);
+        test_graph::connect(second_phase, 1, light, directional ? 3 : 2);
+        color = light;
+    }
+
+    g.output = g.add(protos.output);
+    test_graph::connect(color, 0, g.output, 0);
+    return g;
+}
+
+// every directional light gets its own shadowmap, so each light reads a framebuffer written in
+// its own earlier subpasses
+test_graph shadow_fan_graph(const stub_prototypes& protos, size_t num_lights) {
+    test_graph g{"synthetic shadow fan (" + std::to_string(num_lights) + " lights)"};
+    auto       gbuffer = g.add(protos.gbuffer);
+
+    std::shared_ptr<render_node> color;
+    for(size_t i = 0; i < num_lights; ++i) {
+        auto shadowmap = g.add(protos.shadowmap);
+        auto light     = g.add(protos.directional_light);
+        if(color != nullptr) test_graph::connect(color, 0, light, 0);
+        test_graph::connect(gbuffer, 0, light, 1);
+        test_graph::connect(shadowmap, 0, light, 2);
+        test_graph::connect(gbuffer, 1, light, 3);
+        color = light;
+    }
+
+    g.output = g.add(protos.output);
+    test_graph::connect(color, 0, g.output, 0);
+    return g;
+}
+
+// a single light followed by a long run of overlays blended onto the swap chain image, with a
+// preview of every tenth overlay that isn't reachable from the output
+test_graph overlay_chain_graph(const stub_prototypes& protos, size_t num_overlays) {
+    test_graph g{"synthetic overlay chain (" + std::to_string(num_overlays) + " overlays)"};
+    auto       gbuffer = g.add(protos.gbuffer);
+    auto       light   = g.add(protos.point_light);
+    test_graph::connect(gbuffer, 0, light, 1);
+    test_graph::connect(gbuffer, 1, light, 2);
+
+    auto color = light;
+    for(size_t i = 0; i < num_overlays; ++i) {
+        auto overlay = g.add(i % 2 == 0 ? protos.debug_shapes : protos.physics_shapes);
+        test_graph::connect(color, 0, overlay, 0);
+        if(i % 10 == 0) test_graph::connect(overlay, 0, g.add(protos.preview), 0);
+        color = overlay;
+    }
+
+    g.output = g.add(protos.output);
+    test_graph::connect(color, 0, g.output, 0);
+    return g;
+}
+
+// returns false if the compiled graph is invalid or the compile took too long
+bool check_graph(test_graph& g) {
+    if(g.output == nullptr) {
+        std::cout << g.name << ": no output node\n";
+        return false;
+    }
+    for(auto& n : g.nodes)
+        n->subpass_count = n->prototype->subpass_repeat_count(nullptr, n.get());
+
+    auto start = std::chrono::high_resolution_clock::now();
+    auto compiled
+        = compile_graph(g.nodes, g.output, swap_chain_format, swap_chain_framebuffer + 1);
+    auto duration = std::chrono::duration<float, std::milli>(
+                        std::chrono::high_resolution_clock::now() - start
+    )
+                        .count();
+
+    std::cout << g.name << ": " << g.nodes.size() << " nodes, " << compiled.passes.size()
+              << " passes, " << compiled.subpass_count() << " subpasses, "
+              << compiled.framebuffers.size() << " framebuffers, compiled in " << duration
+              << "ms\n";
+
+    bool ok     = true;
+    auto errors = compiled.validate();
+    for(const auto& e : errors)
+        std::cout << "\terror: " << e << "\n";
+    ok = ok && errors.empty();
+    if(compiled.passes.empty() || compiled.subpass_count() == 0) {
+        std::cout << "\terror: nothing was compiled\n";
+        ok = false;
+    }
+    if(duration > compile_time_budget_ms) {
+        std::cout << "\terror: compile took longer than " << compile_time_budget_ms << "ms\n";
+        ok = false;
+    }
+
+    // compiling again must give the same result, since the renderer recompiles the same graph
+    auto recompiled
+        = compile_graph(g.nodes, g.output, swap_chain_format, swap_chain_framebuffer + 1);
+    if(recompiled.passes.size() != compiled.passes.size()
+       || recompiled.subpass_count() != compiled.subpass_count()
+       || recompiled.framebuffers.size() != compiled.framebuffers.size()) {
+        std::cout << "\terror: recompiling the graph gave a different result\n";
+        ok = false;
+    }
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    std::filesystem::path dir = argc > 1 ? argv[1] : ".";
+    stub_prototypes       protos;
+
+    std::vector<test_graph> graphs;
+    try {
+        graphs.push_back(load_graph(protos, dir / "test.rg.json"));
+        graphs.push_back(load_graph(protos, dir / "full-render-graph.json"));
+    } catch(const std::exception& e) {
+        std::cout << "failed to load graph: " << e.what() << "\n";
+        return 1;
+    }
+    graphs.push_back(light_chain_graph(protos, 495));
+    graphs.push_back(shadow_fan_graph(protos, 250));
+    graphs.push_back(overlay_chain_graph(protos, 450));
+
+    size_t failed = 0;
+    for(auto& g : graphs)
+        if(!check_graph(g)) failed++;
+
+    std::cout << graphs.size() - failed << "/" << graphs.size() << " graphs compiled correctly\n";
+    return failed == 0 ? 0 : 1;
+}